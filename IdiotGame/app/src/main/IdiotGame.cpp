@@ -16,10 +16,10 @@ Done list of features:
 	- drawing faster or slower produces different color
 	- holding finger still for a moment before drawing produces a gradually wider line
 	- erase after a double tap
+	- animated trashing of the texture
 
 Todo list of features:
 	- smooth(er) line tangents derived from previous sections
-	- animate trashing the texture
 
 	- bigger canvas and zoom (default view to max zoom out), maybe translate moving two fingers to same direction
 	- draw line between 2 fingers (how, are we not using 2 fingers to zoom)
@@ -64,6 +64,7 @@ Todo "levels":
 #include <sched.h>
 
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 
 // C standard things
@@ -78,6 +79,14 @@ Todo "levels":
 
 #include <type_traits>
 
+static void * memory_stbi_malloc(size_t size);
+static void * memory_stbi_realloc(void * memory, size_t size);
+static void memory_stbi_free(void * memory);
+
+#define STBI_MALLOC(size) 			memory_stbi_malloc(size)
+#define STBI_REALLOC(memory, size) 	memory_stbi_realloc(memory, size)
+#define STBI_FREE(memory) 			memory_stbi_free(memory)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -95,14 +104,32 @@ Todo "levels":
 using bool32 	= __int32_t;
 using int32 	= __int32_t;
 using uint8 	= __uint8_t;
+using uint16 	= __uint16_t;
 using uint32 	= __uint32_t;
+using int64 	= __int64_t;
 
 #include "math_and_utils.cpp"
+#include "memory.cpp"
+#include "profiler.cpp"
+#include "stroke.cpp"
+#include "stroke_log.cpp"
+#include "undo_history.cpp"
+#include "canvas_document.cpp"
+#include "latency.cpp"
+#include "damage_history.cpp"
+#include "frame_pacer.cpp"
+#include "input_samples.cpp"
+#include "event_pump.cpp"
+#include "app_command_queue.cpp"
+#include "jobs.cpp"
+#include "compositor.cpp"
+#include "png_writer.cpp"
 
 /// ------------------------------------------------------------------------
 /// GAME RELATED THINGS
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES3/gl3.h>
 
 // Todo(Leo): define these away in release build
@@ -149,6 +176,14 @@ struct GLContext
 	int32 width;
 	int32 height;
 	float ratio () { return (float)width / height; }
+
+	// EGL_KHR_mutable_render_buffer
+	bool32 supportsSingleBuffer;
+	bool32 singleBuffered;
+
+	// EGL_EXT_buffer_age and EGL_KHR_swap_buffers_with_damage
+	bool32 supportsBufferAge;
+	PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swapBuffersWithDamage;
 };
 
 internal GLContext initialize_opengl(ANativeWindow * window)
@@ -160,16 +195,45 @@ internal GLContext initialize_opengl(ANativeWindow * window)
 	context.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
 	eglInitialize(context.display, nullptr, nullptr);
 
-	const EGLint attributes[] = {
-		EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+	char const * eglExtensions = eglQueryString(context.display, EGL_EXTENSIONS);
+	auto has_egl_extension = [eglExtensions](char const * name) -> bool32
+	{
+		return eglExtensions != nullptr && strstr(eglExtensions, name) != nullptr;
+	};
+
+	context.supportsSingleBuffer 	= has_egl_extension("EGL_KHR_mutable_render_buffer");
+	context.supportsBufferAge 		= has_egl_extension("EGL_EXT_buffer_age");
+
+	if (has_egl_extension("EGL_KHR_swap_buffers_with_damage"))
+	{
+		context.swapBuffersWithDamage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+	}
+	else if (has_egl_extension("EGL_EXT_swap_buffers_with_damage"))
+	{
+		context.swapBuffersWithDamage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+	}
+
+	EGLint attributes[] = {
+		EGL_SURFACE_TYPE, EGL_WINDOW_BIT | EGL_MUTABLE_RENDER_BUFFER_BIT_KHR,
 		EGL_RED_SIZE, 8,
 		EGL_GREEN_SIZE, 8,
 		EGL_BLUE_SIZE, 8,
 		EGL_CONFORMANT, EGL_OPENGL_ES3_BIT,
 		EGL_NONE
 	};
-	EGLint configCount;
-	eglChooseConfig(context.display, attributes, nullptr, 0, &configCount);
+	EGLint configCount = 0;
+	if (context.supportsSingleBuffer)
+	{
+		eglChooseConfig(context.display, attributes, nullptr, 0, &configCount);
+	}
+
+	if (configCount == 0)
+	{
+		// Extension may be there, but not for configs we want
+		context.supportsSingleBuffer = false;
+		attributes[1] = EGL_WINDOW_BIT;
+		eglChooseConfig(context.display, attributes, nullptr, 0, &configCount);
+	}
 	assert(configCount >= 0);
 	assert(configCount < 100);
 	EGLConfig supportedConfigs [100];
@@ -223,6 +287,9 @@ internal GLContext initialize_opengl(ANativeWindow * window)
 	eglQuerySurface(context.display, context.surface, EGL_WIDTH, &context.width);
 	eglQuerySurface(context.display, context.surface, EGL_HEIGHT, &context.height);
 
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Single buffer: %d, buffer age: %d, swap with damage: %d",
+						context.supportsSingleBuffer, context.supportsBufferAge, context.swapBuffersWithDamage != nullptr);
+
 	__android_log_print(ANDROID_LOG_INFO, "Game", "OpenGL vendor: %s", glGetString(GL_VENDOR));
 	__android_log_print(ANDROID_LOG_INFO, "Game", "OpenGL renderer: %s", glGetString(GL_RENDERER));
 	__android_log_print(ANDROID_LOG_INFO, "Game", "OpenGL version: %s", glGetString(GL_VERSION));
@@ -236,10 +303,51 @@ internal GLContext initialize_opengl(ANativeWindow * window)
 	return context;
 }
 
+// Takes effect on next eglSwapBuffers
+internal bool32 set_single_buffered(GLContext * context, bool32 singleBuffered)
+{
+	if (context->supportsSingleBuffer == false)
+	{
+		return false;
+	}
+
+	EGLint renderBuffer = singleBuffered ? EGL_SINGLE_BUFFER : EGL_BACK_BUFFER;
+	if (eglSurfaceAttrib(context->display, context->surface, EGL_RENDER_BUFFER, renderBuffer) == EGL_FALSE)
+	{
+		log_error("Failed to change render buffer, disabling single buffered rendering");
+		context->supportsSingleBuffer = false;
+		return false;
+	}
+
+	context->singleBuffered = singleBuffered;
+	return true;
+}
+
+// From top left to x, y, width, height from bottom left, as GL and EGL want them
+internal void get_pixel_rect(GLContext const * context, rect r, GLint (&outRect)[4])
+{
+	GLint minX = (GLint)std::floor(r.min.x);
+	GLint minY = (GLint)std::floor(context->height - r.max.y);
+	GLint maxX = (GLint)std::ceil(r.max.x);
+	GLint maxY = (GLint)std::ceil(context->height - r.min.y);
+
+	minX = minX < 0 ? 0 : minX;
+	minY = minY < 0 ? 0 : minY;
+	maxX = maxX > context->width ? context->width : maxX;
+	maxY = maxY > context->height ? context->height : maxY;
+
+	outRect[0] = minX;
+	outRect[1] = minY;
+	outRect[2] = maxX > minX ? maxX - minX : 0;
+	outRect[3] = maxY > minY ? maxY - minY : 0;
+}
+
 internal void terminate_opengl(GLContext * context)
 {
 	eglMakeCurrent(context->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
 	eglTerminate(context->display);
+
+	memory_track_gpu_released();
 }
 
 enum ViewState
@@ -250,13 +358,6 @@ enum ViewState
 	VIEW_TRANSITION_TO_MENU,
 };
 
-// Note(Leo): these map directly to values in brush shader, so explicitly define their values
-enum BrushMode : int32
-{
-	BRUSH_DRAW 	= 0,
-	BRUSH_ERASE = 1,
-};
-
 struct Game
 {
 	bool32 initialized = false;
@@ -265,22 +366,46 @@ struct Game
 	GLContext context;
 	bool canvasStoredToFile;
 
+	// Full document is uploaded in bands after preview, strokes drawn meanwhile are replayed on top of each
+	static constexpr int32 canvasRestoreBytesPerFrame = 1024 * 1024;
+	CanvasDocument 	canvasRestoreDocument;
+	bool32 			canvasRestorePending;
+	bool32 			canvasPreviewShown;
+	int32 			canvasRestoreRow;
+	int32 			canvasRestoreLogStart;
+	int32 			canvasRestoreCheckpointSlot;
+
+	int64 			startTime;
+	bool32 			startupReported;
+
 	// ----------------------------------------------
 	GLuint brushShaderId;
 	GLuint brushMaskTextureId;
 	GLuint brushGradientTexture0;
 	GLuint brushGradientTexture1;
-	GLuint brushGradientTexture;
 	int brushGradientTextureIndex;
 
 	GLuint canvasShaderId;
 	GLuint canvasTextureId;
 	GLuint canvasFramebuffer;
 
+	// Previous canvas while clearing animates, swapped with canvas on every clear
+	GLuint clearingCanvasTextureId;
+	GLuint clearingCanvasFramebuffer;
+
+	// Half size mipmapped copies for menu button, swapped on clear like canvases
+	GLuint canvasThumbnailTextureId;
+	GLuint clearingCanvasThumbnailTextureId;
+	GLuint thumbnailFramebuffer;
+	int32 thumbnailWidth;
+	int32 thumbnailHeight;
+	bool32 canvasThumbnailDirty = true;
+
 	GLuint quadShader;
 	GLuint buttonTextTexture;
 
 	GLuint creditsTexture;
+	int64 creditsTextureBytes;
 
 	// Note(Leo): From top left
 	// Todo(Leo): Compute according to actual screen
@@ -298,29 +423,80 @@ struct Game
 	static constexpr float drawViewPosition 		= 0.0f;
 	static constexpr float menuViewPosition 		= 1.0f;
 	static constexpr float viewTransitionDuration 	= 0.4f;
+	static constexpr float canvasClearDuration 		= 0.7f;
 
 	ViewState state 	= VIEW_DRAW; 
 	float viewPosition 	= drawViewPosition;
 
+	// 1 means there is no clearing going on
+	float canvasClearProgress = 1;
+
 	BrushMode brushMode = BRUSH_DRAW;
 
 	static constexpr float doubleTapTimeThreshold = 0.5f;
 
 	timespec 	touchDownTime;
-	bool 		strokeMoved;
-	float 		strokeWidth;
 
-	static constexpr int drawPositionQueueCapacity = 10;
-	v2 drawPositionQueue [drawPositionQueueCapacity];
-	int drawPositionQueueCount;
+	bool32 		strokeActive;
+	StrokeState stroke;
+	StrokeLog 	strokeLog;
+
+	// Roughly 30 minutes of continuous drawing at 120 Hz
+	static constexpr int strokeLogCapacity = 256 * 1024;
+
+	static constexpr int dabCapacity = 1024;
+	Dab 		dabMemory [dabCapacity];
+	DabBuffer 	dabs;
+
+	// Predicted end of stroke, drawn on screen only
+	static constexpr int wetDabCapacity = 256;
+	Dab 		wetDabMemory [wetDabCapacity];
+	DabBuffer 	wetDabs;
+	v2 			predictedDrawPosition;
+	bool32 		hasPredictedDrawPosition;
+
+	// Enabled with debug.idiotgame.frontbuffer
+	bool32 		lowLatencyDrawing;
+
+	// Full redraws left after something else than canvas changed, see draw_frame
+	int32 			fullRedrawCount;
+	rect 			canvasDirtyRect 	= rect_empty();
+	rect 			wetTailRect 		= rect_empty();
+	DamageHistory 	damageHistory;
+
+	// Two finger tap undoes, three finger tap redoes, four finger tap exports
+	int32 		undoGesturePointerCount;
+
+	static constexpr int undoCheckpointMemoryBudget = 32 * 1024 * 1024;
+	UndoHistory undoHistory;
+	GLuint 		undoCheckpointTextures [UndoHistory::maxCheckpointCount];
+	GLuint 		undoCheckpointFramebuffer;
+
+	LatencyTracker 	latency;
+	FramePacer 		framePacer;
 
-	bool32 drawPositionQueueRefreshed;
+	InputSampleQueue inputSamples;
 
-	v2 lastDequedDrawPosition;
+	static constexpr size_t frameArenaCapacity = 4 * 1024 * 1024;
+	MemoryArena frameArena;
 
-	float currentStrokeLength;
-	float lastStrokeSectionLength;
-	float currentStrokeColourSelection;
+	JobSystem 	jobs;
+
+	CompositorBrush compositorBrush;
+	bool32 			compositorBenchmark;
+
+	// Waited for only when we exit
+	int32 		exportScale;
+	int32 		timelapseSpeed;
+	JobCounter 	exportCounter;
+
+	// Job is started when readback fence has passed
+	struct ExportJob * 	exportReadbackJob;
+	GLuint 				exportReadbackBuffer;
+	GLsync 				exportReadbackFence;
+
+	// Stroke log does not have what is under restored canvas
+	bool32 		canvasFromEarlierProcess;
 
 	// ----------------------------------------------
 
@@ -329,12 +505,10 @@ struct Game
 	pthread_mutex_t mutex;
 	pthread_cond_t 	cond;
 
-	int msgread;
-	int msgwrite;
+	AppCommandQueue commands;
 
 	void* 	savedState;
 	size_t 	savedStateSize;
-	int 	canvasFile;
 
 	int stateSaved;
 	int destroyed;
@@ -346,20 +520,90 @@ struct Game
 	ANativeWindow* 		window;
 	AInputQueue* 		inputQueue;
 
+	// Input thread reads 'inputQueue', changes to it are done under 'inputMutex'
+	pthread_t 			inputThread;
+	pthread_mutex_t 	inputMutex;
+	ALooper* 			inputLooper;
+	std::atomic<bool32> inputThreadRunning;
+
 	// Todo(Leo): we probably want to take this into account too
 	// ARect 				contentRect;
 
-	// Todo(Leo): Check if we really need pending stuffs
-	ANativeWindow* 		pendingWindow;
-	AInputQueue* 		pendingInputQueue;
 	// ARect 				pendingContentRect;
 };
 
-internal void queue_draw_position(Game * game, v2 position)
+// Grows the longer finger is held still
+internal float stroke_width_from_hold_time(Game * game)
+{
+	float timeSinceTouchDownMS 	= time_elapsed_milliseconds(game->touchDownTime);
+	float interpolatonTime 		= float_clamp(timeSinceTouchDownMS / game->maxBrushSizeTimeMS, 0, 1);
+	float strokeWidth 			= float_lerp(game->minBrushSize, game->maxBrushSize, interpolatonTime);
+
+	return stroke_log_quantize_width(strokeWidth);
+}
+
+// Stroke is certain to be a stroke and not a gesture after it has moved
+internal void record_stroke_width(Game * game)
+{
+	if (game->stroke.strokeMoved)
+	{
+		undo_history_truncate(&game->undoHistory, &game->strokeLog);
+		stroke_log_record_width(&game->strokeLog, game->stroke.strokeWidth);
+	}
+}
+
+// 'receiveTime' is when input thread read event, for latency measurement
+internal void begin_draw_stroke(Game * game, v2 position, StrokeDynamics dynamics, bool32 stylus, int64 eventTime, int64 receiveTime)
+{
+	dynamics = stroke_log_quantize_dynamics(dynamics);
+	position = stroke_log_record_begin(&game->strokeLog, position, dynamics, stylus, game->brushMode, game->brushGradientTextureIndex, eventTime);
+	stroke_begin(&game->stroke, position, dynamics, stylus, game->brushMode, game->brushGradientTextureIndex);
+	game->strokeActive = true;
+	game->hasPredictedDrawPosition = false;
+
+	latency_begin(&game->latency, eventTime, receiveTime);
+}
+
+internal void queue_draw_position(Game * game, v2 position, StrokeDynamics dynamics, int64 eventTime, int64 receiveTime)
+{
+	int32 queueCount = game->stroke.drawPositionQueueCount;
+
+	dynamics = stroke_log_quantize_dynamics(dynamics);
+	position = stroke_log_record_sample(&game->strokeLog, position, dynamics, eventTime);
+	stroke_advance_time(&game->stroke, stroke_log_last_time_step(&game->strokeLog));
+
+	if (game->hasPredictedDrawPosition)
+	{
+		PROFILER_SET(PROFILER_COUNTER_PREDICTION_ERROR, v2_magnitude(position - game->predictedDrawPosition));
+		game->hasPredictedDrawPosition = false;
+	}
+	stroke_queue_position(&game->stroke, position, dynamics, stroke_width_from_hold_time(game), &game->dabs);
+	record_stroke_width(game);
+
+	latency_queue(&game->latency, eventTime, receiveTime);
+	for (int32 i = game->stroke.drawPositionQueueCount; i < queueCount + 1; ++i)
+	{
+		latency_dequeue(&game->latency, game->stroke.strokeMoved);
+	}
+}
+
+internal void flush_draw_position_queue(Game * game)
+{
+	stroke_log_record_flush(&game->strokeLog, time_now_nanoseconds());
+	stroke_advance_time(&game->stroke, stroke_log_last_time_step(&game->strokeLog));
+	stroke_dequeue(&game->stroke, stroke_width_from_hold_time(game), &game->dabs);
+	record_stroke_width(game);
+
+	latency_dequeue(&game->latency, game->stroke.strokeMoved);
+}
+
+internal void cancel_draw_stroke(Game * game)
 {
-	game->drawPositionQueue[game->drawPositionQueueCount] 	= position;
-	game->drawPositionQueueCount 							+= 1;
-	game->drawPositionQueueRefreshed 						= true;
+	stroke_log_cancel_stroke(&game->strokeLog);
+	game->stroke.drawPositionQueueCount = 0;
+	game->strokeActive = false;
+
+	latency_cancel(&game->latency);
 }
 
 internal void clear_canvas(Game * game)
@@ -368,6 +612,29 @@ internal void clear_canvas(Game * game)
 	glViewport(0, 0, game->context.width, game->context.height);
 	glClearColor(1, 1, 1, 1);
 	glClear(GL_COLOR_BUFFER_BIT);
+
+	game->canvasThumbnailDirty = true;
+}
+
+internal void clear_canvas_animated(Game * game)
+{
+	// Dabs carried over belong to canvas that is going away
+	flush_dabs(&game->dabs);
+
+	GLuint canvasTextureId 			= game->canvasTextureId;
+	GLuint canvasFramebuffer 		= game->canvasFramebuffer;
+
+	game->canvasTextureId 			= game->clearingCanvasTextureId;
+	game->canvasFramebuffer 		= game->clearingCanvasFramebuffer;
+	game->clearingCanvasTextureId 	= canvasTextureId;
+	game->clearingCanvasFramebuffer = canvasFramebuffer;
+
+	GLuint canvasThumbnailTextureId 		= game->canvasThumbnailTextureId;
+	game->canvasThumbnailTextureId 			= game->clearingCanvasThumbnailTextureId;
+	game->clearingCanvasThumbnailTextureId 	= canvasThumbnailTextureId;
+
+	clear_canvas(game);
+	game->canvasClearProgress = 0;
 }
 
 internal void generate_gradient_texture_strip(int colourCount, v4 * colours, int pixelCount, uint8 * pixelMemory)
@@ -444,6 +711,99 @@ internal void generate_gradient_texture_strip(int colourCount, v4 * colours, int
 	}
 }
 
+struct GradientStripJob
+{
+	int 	colourCount;
+	v4 * 	colours;
+	int 	pixelCount;
+	uint8 * pixelMemory;
+};
+
+internal void generate_gradient_texture_strip_job(void * data)
+{
+	GradientStripJob * job = (GradientStripJob*)data;
+	generate_gradient_texture_strip(job->colourCount, job->colours, job->pixelCount, job->pixelMemory);
+}
+
+struct DecodedImage
+{
+	char const * 	assetName;
+	AAssetManager * assetManager;
+
+	int32 			width;
+	int32 			height;
+	uint8 * 		pixels;
+};
+
+// Runs in a job, asset manager and stb_image are thread safe
+internal void decode_image(DecodedImage * image)
+{
+	PROFILE_SCOPE("decode_image");
+
+	AAsset * asset 	= AAssetManager_open(image->assetManager, image->assetName, AASSET_MODE_BUFFER);
+	int length 		= AAsset_getLength(asset);
+	uint8 * buffer 	= (uint8*)AAsset_getBuffer(asset);
+
+	// Note(Leo): assume 4 channel textures
+	int width, height, channels;
+	image->pixels 	= stbi_load_from_memory(buffer, length, &width, &height, &channels, 4);
+	image->width 	= width;
+	image->height 	= height;
+
+	AAsset_close(asset);
+}
+
+internal void decode_image_job(void * data)
+{
+	decode_image((DecodedImage*)data);
+}
+
+struct CompositorBrushJob
+{
+	CompositorBrush * 		brush;
+	DecodedImage const * 	maskImage;
+	uint8 const * 			gradientPixels0;
+	uint8 const * 			gradientPixels1;
+};
+
+internal void compositor_brush_job(void * data)
+{
+	CompositorBrushJob * job = (CompositorBrushJob*)data;
+	compositor_brush_initialize(job->brush, job->maskImage->pixels, job->maskImage->width, job->maskImage->height,
+								job->gradientPixels0, job->gradientPixels1);
+}
+
+// Biggest texture we have and only seen in menu, so it is released on low memory
+internal void load_credits_texture(Game * game, DecodedImage * image)
+{
+	PROFILE_SCOPE("load_credits_texture");
+
+	glGenTextures(1, &game->creditsTexture);
+	glBindTexture(GL_TEXTURE_2D, game->creditsTexture);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels);
+
+	game->creditsTextureBytes = (int64)image->width * image->height * 4;
+	memory_track(MEMORY_CATEGORY_MENU_TEXTURES, game->creditsTextureBytes);
+
+	stbi_image_free(image->pixels);
+	image->pixels = nullptr;
+}
+
+internal void release_credits_texture(Game * game)
+{
+	glDeleteTextures(1, &game->creditsTexture);
+	game->creditsTexture = 0;
+
+	memory_track(MEMORY_CATEGORY_MENU_TEXTURES, -game->creditsTextureBytes);
+	game->creditsTextureBytes = 0;
+}
+
 internal void initialize_shaders(Game * game)
 {
 	auto load_shader = [](const char * source, GLenum type) ->GLuint
@@ -482,6 +842,63 @@ internal void initialize_shaders(Game * game)
 		return shader;
 	};
 
+	// Images are decoded and gradients generated in jobs while shaders compile
+	AAssetManager * assetManager = game->activity->assetManager;
+
+	char const * brushNames [] =
+	{
+		"brush_0.png",
+		"brush_1.png",
+		"brush_2.png",
+	};
+
+	DecodedImage brushImage 		= {brushNames[0], assetManager};
+	DecodedImage buttonTextImage 	= {"clear_link.png", assetManager};
+	DecodedImage creditsImage 		= {"credits.png", assetManager};
+
+	constexpr int gradientPixelCount = CompositorBrush::gradientPixelCount;
+
+	v4 gradientValues_0 [] = 
+	{
+		204.0f / 255, 38.0f / 255, 0, 		0.3f,
+		1, 230.0f / 255, 200.0f / 255, 		0.45f,
+		0, 230.0f /255, 1, 					0.6f,
+	};
+
+	v4 gradientValues_1 [] = 
+	{
+		0.352, 0.858, 0.556, 	0.15,
+		1, 0.494, 0.176, 		0.4,
+		1, 0.956, 0.301, 		0.59,
+	};
+
+	GradientStripJob gradientJobs [] =
+	{
+		{3, gradientValues_0, gradientPixelCount, arena_push_array<uint8>(&game->frameArena, gradientPixelCount * 4)},
+		{3, gradientValues_1, gradientPixelCount, arena_push_array<uint8>(&game->frameArena, gradientPixelCount * 4)},
+	};
+
+	JobCounter loadCounter = {};
+
+	Job * brushJobs [] =
+	{
+		job_run(&game->jobs, decode_image_job, &brushImage, &loadCounter),
+		job_run(&game->jobs, generate_gradient_texture_strip_job, &gradientJobs[0], &loadCounter),
+		job_run(&game->jobs, generate_gradient_texture_strip_job, &gradientJobs[1], &loadCounter),
+	};
+
+	job_run(&game->jobs, decode_image_job, &buttonTextImage, &loadCounter);
+	job_run(&game->jobs, decode_image_job, &creditsImage, &loadCounter);
+
+	CompositorBrushJob compositorBrushJob = {&game->compositorBrush, &brushImage, gradientJobs[0].pixelMemory, gradientJobs[1].pixelMemory};
+
+	Job * compositorJob = job_create(compositor_brush_job, &compositorBrushJob, &loadCounter);
+	for (Job * brushJob : brushJobs)
+	{
+		job_depends_on(&game->jobs, compositorJob, brushJob);
+	}
+	job_submit(&game->jobs, compositorJob);
+
 	auto log_gl_shader_program = [](GLuint program)
 	{
 		GLsizei length;
@@ -524,13 +941,14 @@ internal void initialize_shaders(Game * game)
 			#define BRUSH_ERASE 1
 
 			uniform int brushMode;
+			uniform float opacity;
 			
 			uniform vec3 color;
 
 			out vec4 fragColor;
 			void main()
 			{
-				float alpha = texture(brushTexture, uv).r;
+				float alpha = texture(brushTexture, uv).r * opacity;
 				
 				if (brushMode == BRUSH_DRAW)
 				{
@@ -555,25 +973,14 @@ internal void initialize_shaders(Game * game)
 		glLinkProgram(game->brushShaderId);
 
 
-		{
-			char const * brushNames [] =
-			{
-				"brush_0.png",
-				"brush_1.png",
-				"brush_2.png",
-			};
-			char const * brushName = brushNames[0];
+		job_wait(&game->jobs, &loadCounter);
 
+		{
 			glGenTextures(1, &game->brushMaskTextureId);
 
-			AAssetManager * assetManager 	= game->activity->assetManager;
-			AAsset * textureAsset 			= AAssetManager_open(assetManager, brushName, AASSET_MODE_BUFFER);
-			int length 						= AAsset_getLength(textureAsset);
-			uint8 * buffer 					= (uint8*)AAsset_getBuffer(textureAsset);
-
-			// Note(Leo): assume 4 channel textures
-			int width, height, channels;
-			uint8 * textureMemory 			= stbi_load_from_memory(buffer, length, &width, &height, &channels, 4);
+			int width 				= brushImage.width;
+			int height 				= brushImage.height;
+			uint8 * textureMemory 	= brushImage.pixels;
 
 			glBindTexture(GL_TEXTURE_2D, game->brushMaskTextureId);
 
@@ -585,22 +992,11 @@ internal void initialize_shaders(Game * game)
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, textureMemory);
 
 			glGenerateMipmap(GL_TEXTURE_2D);
+			memory_track(MEMORY_CATEGORY_BRUSH_TEXTURES, (int64)width * height * 4 * 4 / 3);
 
 			stbi_image_free(textureMemory);
 		}
 
-		int gradientPixelCount = 128;
-		uint8 * gradientTextureMemory = new uint8[gradientPixelCount * 4];
-
-		v4 gradientValues_0 [] = 
-		{
-			204.0f / 255, 38.0f / 255, 0, 		0.3f,
-			1, 230.0f / 255, 200.0f / 255, 		0.45f,
-			0, 230.0f /255, 1, 					0.6f,
-		};
-
-		generate_gradient_texture_strip(3, gradientValues_0, gradientPixelCount, gradientTextureMemory);
-
 		GLuint brushGradientTexture0;
 		glGenTextures(1, &brushGradientTexture0);
 		glBindTexture(GL_TEXTURE_2D, brushGradientTexture0);
@@ -610,23 +1006,12 @@ internal void initialize_shaders(Game * game)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gradientPixelCount, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gradientTextureMemory);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gradientPixelCount, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gradientJobs[0].pixelMemory);
 
 		game->brushGradientTexture0 	= brushGradientTexture0;
-		game->brushGradientTexture 		= game->brushGradientTexture0;
 		game->brushGradientTextureIndex = 0;
 
 
-		v4 gradientValues_1 [] = 
-		{
-			0.352, 0.858, 0.556, 	0.15,
-			1, 0.494, 0.176, 		0.4,
-			1, 0.956, 0.301, 		0.59,
-		};
-
-		generate_gradient_texture_strip(3, gradientValues_1, gradientPixelCount, gradientTextureMemory);
-
-
 		GLuint brushGradientTexture1;
 		glGenTextures(1, &brushGradientTexture1);
 		glBindTexture(GL_TEXTURE_2D, brushGradientTexture1);
@@ -636,11 +1021,11 @@ internal void initialize_shaders(Game * game)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gradientPixelCount, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gradientTextureMemory);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gradientPixelCount, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gradientJobs[1].pixelMemory);
 
 		game->brushGradientTexture1 = brushGradientTexture1;
 
-		delete [] gradientTextureMemory;
+		memory_track(MEMORY_CATEGORY_BRUSH_TEXTURES, 2 * gradientPixelCount * 4);
 	}
 
 	/// CANVAS
@@ -664,11 +1049,29 @@ internal void initialize_shaders(Game * game)
 			in vec2 uv;
 
 			uniform sampler2D canvasTexture;
+			uniform sampler2D clearingCanvasTexture;
+			uniform float clearProgress;
+
+			highp float hash(highp vec2 p)
+			{
+				return fract(sin(dot(p, vec2(12.9898, 78.233))) * 43758.5453);
+			}
 
 			out vec4 fragColor;
 			void main()
 			{
 				fragColor = texture(canvasTexture, uv);
+
+				if (clearProgress < 1.0)
+				{
+					// Old canvas dissolves in blocks, starting from top
+					vec2 block 			= floor(uv * vec2(27.0, 48.0));
+					float threshold 	= hash(block) * 0.6 + (1.0 - uv.y) * 0.4;
+					float cleared 		= smoothstep(threshold - 0.05, threshold + 0.05, clearProgress * 1.1);
+
+					vec4 clearingColor 	= texture(clearingCanvasTexture, uv);
+					fragColor 			= mix(clearingColor, fragColor, cleared);
+				}
 			}
 		)";
 
@@ -681,28 +1084,36 @@ internal void initialize_shaders(Game * game)
 		glAttachShader(game->canvasShaderId, canvasFragmentShader);
 		glLinkProgram(game->canvasShaderId);
 
-		GLuint canvasTexture;
-		glGenTextures(1, &canvasTexture);
-		glBindTexture(GL_TEXTURE_2D, canvasTexture);
+		auto create_canvas_target = [game](GLuint * outTexture, GLuint * outFramebuffer)
+		{
+			GLuint canvasTexture;
+			glGenTextures(1, &canvasTexture);
+			glBindTexture(GL_TEXTURE_2D, canvasTexture);
 
-		int screenWidth = game->context.width;
-		int screenHeight = game->context.height;
+			int screenWidth = game->context.width;
+			int screenHeight = game->context.height;
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, screenWidth, screenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, screenWidth, screenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			memory_track(MEMORY_CATEGORY_CANVAS, (int64)screenWidth * screenHeight * 4);
 
-		game->canvasTextureId = canvasTexture;
+			*outTexture = canvasTexture;
 
-		glGenFramebuffers(1, &game->canvasFramebuffer);
-		glBindFramebuffer(GL_FRAMEBUFFER, game->canvasFramebuffer);
+			glGenFramebuffers(1, outFramebuffer);
+			glBindFramebuffer(GL_FRAMEBUFFER, *outFramebuffer);
+
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, canvasTexture, 0);
+		};
 
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, game->canvasTextureId, 0);
+		create_canvas_target(&game->clearingCanvasTextureId, &game->clearingCanvasFramebuffer);
+		create_canvas_target(&game->canvasTextureId, &game->canvasFramebuffer);
 
 		clear_canvas(game);
+		game->canvasClearProgress = 1;
 
 		log_gl_shader_program(game->canvasShaderId);
 
@@ -781,14 +1192,9 @@ internal void initialize_shaders(Game * game)
 		{
 			glGenTextures(1, &game->buttonTextTexture);
 
-			AAssetManager * assetManager 	= game->activity->assetManager;
-			AAsset * textureAsset 			= AAssetManager_open(assetManager, "clear_link.png", AASSET_MODE_BUFFER);
-			int length 						= AAsset_getLength(textureAsset);
-			uint8 * buffer 					= (uint8*)AAsset_getBuffer(textureAsset);
-
-			// Note(Leo): assume 4 channel textures
-			int width, height, channels;
-			uint8 * textureMemory 			= stbi_load_from_memory(buffer, length, &width, &height, &channels, 4);
+			int width 				= buttonTextImage.width;
+			int height 				= buttonTextImage.height;
+			uint8 * textureMemory 	= buttonTextImage.pixels;
 
 			glBindTexture(GL_TEXTURE_2D, game->buttonTextTexture);
 
@@ -798,38 +1204,17 @@ internal void initialize_shaders(Game * game)
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, textureMemory);
+			memory_track(MEMORY_CATEGORY_MENU_TEXTURES, (int64)width * height * 4);
 
 			stbi_image_free(textureMemory);
 		}
 
-		/// CREDITS TEXTURE
-		{
-			glGenTextures(1, &game->creditsTexture);
-
-			AAssetManager * assetManager 	= game->activity->assetManager;
-			AAsset * textureAsset 			= AAssetManager_open(assetManager, "credits.png", AASSET_MODE_BUFFER);
-			int length 						= AAsset_getLength(textureAsset);
-			uint8 * buffer 					= (uint8*)AAsset_getBuffer(textureAsset);
-
-			// Note(Leo): assume 4 channel textures
-			int width, height, channels;
-			uint8 * textureMemory 			= stbi_load_from_memory(buffer, length, &width, &height, &channels, 4);
-
-			glBindTexture(GL_TEXTURE_2D, game->creditsTexture);
-
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, textureMemory);
-
-			stbi_image_free(textureMemory);
-		}
+		load_credits_texture(game, &creditsImage);
 	}
 }
 
-internal void draw_brush(Game * game, v2 screenPosition, float size, float gradientPosition)
+// Dabs are in stroke log's coordinate space, and scaled here to size of target framebuffer
+internal void draw_dabs(Game * game, int32 dabCount, Dab const * dabs, GLuint framebuffer, int32 width, int32 height)
 {
 	GLfloat vertices [] =
 	{
@@ -841,8 +1226,8 @@ internal void draw_brush(Game * game, v2 screenPosition, float size, float gradi
 
 	GLfloat projection [] =
 	{
-		2 / (float)game->context.width, 0, 0, 0,
-		0, 2 / (float)game->context.height, 0, 0,
+		2 / (float)width, 0, 0, 0,
+		0, 2 / (float)height, 0, 0,
 		0, 0, 1, 0,
 		0, 0, 0, 1
 	};
@@ -855,16 +1240,12 @@ internal void draw_brush(Game * game, v2 screenPosition, float size, float gradi
 		0, 0, 0, 1
 	};
 
-	float x = screenPosition.x - (game->context.width / 2);
-	float y = (game->context.height / 2) - screenPosition.y;
+	PROFILE_SCOPE("draw_dabs");
+	PROFILER_ADD(PROFILER_COUNTER_DABS, dabCount);
 
-	GLfloat model [] =
-	{
-		size, 0, 0, 0,
-		0, size, 0, 0,
-		0, 0, 1, 0,
-		x, y, 0, 1,
-	};
+	float scaleX 	= (float)width / game->strokeLog.width;
+	float scaleY 	= (float)height / game->strokeLog.height;
+	float sizeScale = scaleX < scaleY ? scaleX : scaleY;
 
 	glUseProgram(game->brushShaderId);
 
@@ -874,21 +1255,19 @@ internal void draw_brush(Game * game, v2 screenPosition, float size, float gradi
 	GLint viewLocation				= glGetUniformLocation(game->brushShaderId, "view");
 	GLint modelMatrixLocation 		= glGetUniformLocation(game->brushShaderId, "model");
 	GLint brushTextureLocation 		= glGetUniformLocation(game->brushShaderId, "brushTexture");
-	GLint colorLocation				= glGetUniformLocation(game->brushShaderId, "color");
 	GLint gradientTextureLocation 	= glGetUniformLocation(game->brushShaderId, "gradientColor");
 	GLint gradientPositionLocation 	= glGetUniformLocation(game->brushShaderId, "gradientPosition");
 	GLint brushModeLocation 		= glGetUniformLocation(game->brushShaderId, "brushMode");
+	GLint opacityLocation 			= glGetUniformLocation(game->brushShaderId, "opacity");
 
-	// Bind canvas framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, game->canvasFramebuffer);
-	glViewport(0, 0, game->context.width, game->context.height);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
 
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, vertices);
 	glEnableVertexAttribArray(0);
 
 	glUniformMatrix4fv(projectionLocation, 1, false, projection);
 	glUniformMatrix4fv(viewLocation, 1, false, view);
-	glUniformMatrix4fv(modelMatrixLocation, 1, false, model);
 
 	glUniform1i(brushTextureLocation, 0);
 	glActiveTexture(GL_TEXTURE0);
@@ -896,64 +1275,561 @@ internal void draw_brush(Game * game, v2 screenPosition, float size, float gradi
 
 	glUniform1i(gradientTextureLocation, 1);
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, game->brushGradientTexture);
-
-	glUniform1f(gradientPositionLocation, gradientPosition);
-	glUniform1i(brushModeLocation, game->brushMode);
 
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glEnable( GL_BLEND );
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	for (int32 dabIndex = 0; dabIndex < dabCount; ++dabIndex)
+	{
+		Dab const & dab = dabs[dabIndex];
+
+		float size 	= dab.size * sizeScale;
+		float x 	= dab.position.x * scaleX - (width / 2);
+		float y 	= (height / 2) - dab.position.y * scaleY;
+
+		GLfloat model [] =
+		{
+			size, 0, 0, 0,
+			0, size, 0, 0,
+			0, 0, 1, 0,
+			x, y, 0, 1,
+		};
+
+		GLuint gradientTexture = dab.gradientIndex == 0 ? game->brushGradientTexture0 : game->brushGradientTexture1;
+
+		glUniformMatrix4fv(modelMatrixLocation, 1, false, model);
+		glBindTexture(GL_TEXTURE_2D, gradientTexture);
+		glUniform1f(gradientPositionLocation, dab.gradientPosition);
+		glUniform1i(brushModeLocation, dab.mode);
+		glUniform1f(opacityLocation, dab.opacity);
+
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		PROFILER_ADD(PROFILER_COUNTER_DRAW_CALLS, 1);
+
+		// Blending reads and writes target, and mask is read once per pixel
+		PROFILER_ADD(PROFILER_COUNTER_GPU_BYTES, (int64)(size * size) * 9);
+	}
 
 	glDisableVertexAttribArray(0);
 }
 
-internal void draw_canvas(Game * game)
+// From top left like touch positions
+internal rect get_dab_screen_bounds(Game * game, int32 dabCount, Dab const * dabs)
 {
-	float tweenedPosition;
-	{
-		float i = std::floor(game->viewPosition);
-		float f = game->viewPosition - i;
-		f = f * (f * (f * -2 + 3));
-		tweenedPosition = i + f;
-		}
+	float scaleX 	= (float)game->context.width / game->strokeLog.width;
+	float scaleY 	= (float)game->context.height / game->strokeLog.height;
+	float sizeScale = scaleX < scaleY ? scaleX : scaleY;
 
-	// Note(Leo): Draw the mighty "full screen triangle"
-	GLfloat canvasVertices [] =
+	rect bounds = rect_empty();
+	for (int32 dabIndex = 0; dabIndex < dabCount; ++dabIndex)
 	{
-		-1 + 2 * (tweenedPosition - game->drawViewPosition), -1, 0, 0,
-		 3 + 2 * (tweenedPosition - game->drawViewPosition), -1, 2, 0,
-		-1 + 2 * (tweenedPosition - game->drawViewPosition),  3, 0, 2,
-	};
+		Dab const & dab = dabs[dabIndex];
 
-	// Bind screen framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, game->context.width, game->context.height);
+		v2 position 	= {dab.position.x * scaleX, dab.position.y * scaleY};
+		float radius 	= dab.size * sizeScale / 2;
 
-	glClearColor(1,1,1,1);
-	glClear(GL_COLOR_BUFFER_BIT);
+		bounds = rect_union(bounds, {{position.x - radius, position.y - radius}, {position.x + radius, position.y + radius}});
+	}
+	return bounds;
+}
 
-	glUseProgram(game->canvasShaderId);
-	glDisable( GL_BLEND );
+internal void draw_dabs_to_canvas(Game * game, int32 dabCount, Dab const * dabs)
+{
+	draw_dabs(game, dabCount, dabs, game->canvasFramebuffer, game->context.width, game->context.height);
+	game->canvasDirtyRect 		= rect_union(game->canvasDirtyRect, get_dab_screen_bounds(game, dabCount, dabs));
+	game->canvasThumbnailDirty 	= true;
+}
 
-	// Todo(Leo): read once in init place
-	GLint textureLocation 			= glGetUniformLocation(game->canvasShaderId, "canvasTexture");
+internal void flush_dabs_to_canvas(void * data, DabBuffer * buffer)
+{
+	Game * game = (Game*)data;
+	draw_dabs_to_canvas(game, buffer->count, buffer->dabs);
+	buffer->count = 0;
+}
 
-	glUniform1i(textureLocation, 0);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, game->canvasTextureId);
+/*
+Rest is carried over to next frame and shown in wet tail meanwhile, so that a fast swipe does
+not miss vsync. Full buffer flushes everything when next dab is pushed, so backlog is never
+more than a buffer. Budget is cpu time, which we can measure without stalling.
+*/
+internal void flush_dabs_to_canvas_with_budget(Game * game, int64 budget)
+{
+	PROFILE_SCOPE("flush_dabs_to_canvas_with_budget");
 
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, canvasVertices);
-	glEnableVertexAttribArray(0);
+	constexpr int32 batchSize = 64;
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 3);
+	DabBuffer * buffer 	= &game->dabs;
+	int64 startTime 	= time_now_nanoseconds();
+	int32 drawnCount 	= 0;
 
-	// Unbind so we can draw to this on next frame
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glDisableVertexAttribArray(0);
+	while (drawnCount < buffer->count)
+	{
+		int32 count = buffer->count - drawnCount;
+		count = count < batchSize ? count : batchSize;
 
-	/// ------------------------------------------------------
+		draw_dabs_to_canvas(game, count, buffer->dabs + drawnCount);
+		drawnCount += count;
+
+		if (time_now_nanoseconds() - startTime > budget)
+		{
+			break;
+		}
+	}
+
+	buffer->count -= drawnCount;
+	memmove(buffer->dabs, buffer->dabs + drawnCount, buffer->count * sizeof(Dab));
+
+	PROFILER_SET(PROFILER_COUNTER_CARRIED_DABS, buffer->count);
+}
+
+internal void flush_dabs_to_screen(void * data, DabBuffer * buffer)
+{
+	Game * game = (Game*)data;
+	draw_dabs(game, buffer->count, buffer->dabs, 0, game->context.width, game->context.height);
+	game->wetTailRect = rect_union(game->wetTailRect, get_dab_screen_bounds(game, buffer->count, buffer->dabs));
+	buffer->count = 0;
+}
+
+// Positions held back for lookahead tangent and a predicted one, on screen only
+internal void draw_wet_stroke_tail(Game * game)
+{
+	game->hasPredictedDrawPosition 	= false;
+	game->wetTailRect 				= rect_empty();
+
+	// Dabs carried over to next frame are not yet on canvas
+	if (game->dabs.count > 0 && game->state == VIEW_DRAW)
+	{
+		draw_dabs(game, game->dabs.count, game->dabs.dabs, 0, game->context.width, game->context.height);
+		game->wetTailRect = get_dab_screen_bounds(game, game->dabs.count, game->dabs.dabs);
+	}
+
+	if (game->strokeActive == false || game->state != VIEW_DRAW)
+	{
+		return;
+	}
+
+	PROFILE_SCOPE("draw_wet_stroke_tail");
+
+	game->predictedDrawPosition 	= stroke_predict_next_position(&game->stroke);
+	game->hasPredictedDrawPosition 	= true;
+
+	stroke_draw_wet_tail(&game->stroke, game->predictedDrawPosition, stroke_width_from_hold_time(game), &game->wetDabs);
+	flush_dabs(&game->wetDabs);
+
+	latency_mark_wet(&game->latency);
+}
+
+internal void rasterize_stroke_log(Game * game, GLuint framebuffer, int32 width, int32 height)
+{
+	struct RasterizeTarget
+	{
+		Game * 	game;
+		GLuint 	framebuffer;
+		int32 	width;
+		int32 	height;
+	};
+
+	RasterizeTarget target = {game, framebuffer, width, height};
+
+	auto flush = [](void * data, DabBuffer * buffer)
+	{
+		RasterizeTarget * target = (RasterizeTarget*)data;
+		draw_dabs(target->game, buffer->count, buffer->dabs, target->framebuffer, target->width, target->height);
+		buffer->count = 0;
+	};
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+	glClearColor(1, 1, 1, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	Dab dabMemory [256];
+	DabBuffer dabs = {dabMemory, 0, 256, flush, &target};
+
+	int32 cursor = game->undoHistory.cursor;
+	replay_stroke_log(&game->strokeLog, stroke_log_drawing_start(&game->strokeLog, cursor), cursor, &dabs);
+	flush_dabs(&dabs);
+}
+
+internal void composite_stroke_log(Game * game, Compositor * compositor)
+{
+	compositor_clear(compositor);
+
+	int32 cursor = game->undoHistory.cursor;
+	replay_stroke_log(&game->strokeLog, stroke_log_drawing_start(&game->strokeLog, cursor), cursor, &compositor->dabs);
+	compositor_finish(compositor);
+}
+
+// Enable with 'adb shell setprop debug.idiotgame.compositor 1', runs when window is created
+internal void benchmark_cpu_compositor(Game * game)
+{
+	int32 width 	= game->context.width * 2;
+	int32 height 	= game->context.height * 2;
+	size_t size 	= (size_t)width * height * 4;
+
+	uint8 * pixels 			= (uint8*)memory_heap_allocate(size, MEMORY_CATEGORY_COMPOSITOR);
+	Compositor * compositor = new Compositor();
+
+	int64 singleThreadTime = 0;
+
+	for (int32 threadCount = 1; pixels != nullptr && threadCount <= 8 && threadCount <= game->jobs.workerCount; threadCount *= 2)
+	{
+		if (compositor_initialize(	compositor, &game->jobs, &game->compositorBrush, threadCount,
+									pixels, width, height, game->strokeLog.width, game->strokeLog.height) == false)
+		{
+			break;
+		}
+
+		int64 startTime = time_now_nanoseconds();
+		composite_stroke_log(game, compositor);
+		int64 elapsedTime = time_now_nanoseconds() - startTime;
+
+		if (threadCount == 1)
+		{
+			singleThreadTime = elapsedTime;
+		}
+
+		__android_log_print(ANDROID_LOG_INFO, "Game", "Cpu compositor %d x %d, %d threads: %lld dabs in %.2f ms, %.1f megapixels/s, %.2fx",
+							width, height, threadCount, (long long)compositor->dabCount, elapsedTime / 1'000'000.0,
+							(double)width * height / elapsedTime * 1000.0, (double)singleThreadTime / elapsedTime);
+	}
+
+	delete compositor;
+	memory_heap_free(pixels, size, MEMORY_CATEGORY_COMPOSITOR);
+}
+
+internal void initialize_undo_checkpoints(Game * game)
+{
+	int32 checkpointSize = game->context.width * game->context.height * 4;
+	undo_history_initialize(&game->undoHistory, game->undoCheckpointMemoryBudget, checkpointSize);
+
+	int32 checkpointCount = game->undoHistory.checkpointCapacity;
+	glGenTextures(checkpointCount, game->undoCheckpointTextures);
+
+	for (int32 i = 0; i < checkpointCount; ++i)
+	{
+		glBindTexture(GL_TEXTURE_2D, game->undoCheckpointTextures[i]);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, game->context.width, game->context.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	memory_track(MEMORY_CATEGORY_UNDO_CHECKPOINTS, (int64)checkpointCount * checkpointSize);
+
+	glGenFramebuffers(1, &game->undoCheckpointFramebuffer);
+}
+
+internal int64 canvas_thumbnails_size(Game * game)
+{
+	return 2 * (int64)game->thumbnailWidth * game->thumbnailHeight * 4 * 4 / 3;
+}
+
+internal void initialize_canvas_thumbnails(Game * game)
+{
+	game->thumbnailWidth 	= game->context.width / 2;
+	game->thumbnailHeight 	= game->context.height / 2;
+
+	int32 largerSize 	= game->thumbnailWidth > game->thumbnailHeight ? game->thumbnailWidth : game->thumbnailHeight;
+	int32 levelCount 	= (int32)std::floor(std::log2((float)largerSize)) + 1;
+
+	GLuint textures [2];
+	glGenTextures(2, textures);
+
+	for (GLuint texture : textures)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glTexStorage2D(GL_TEXTURE_2D, levelCount, GL_RGBA8, game->thumbnailWidth, game->thumbnailHeight);
+	}
+
+	game->canvasThumbnailTextureId 			= textures[0];
+	game->clearingCanvasThumbnailTextureId 	= textures[1];
+
+	memory_track(MEMORY_CATEGORY_THUMBNAILS, canvas_thumbnails_size(game));
+
+	glGenFramebuffers(1, &game->thumbnailFramebuffer);
+
+	// Clearing canvas is white at start, and this is the only time we need that thumbnail
+	glBindFramebuffer(GL_FRAMEBUFFER, game->thumbnailFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, game->clearingCanvasThumbnailTextureId, 0);
+	glViewport(0, 0, game->thumbnailWidth, game->thumbnailHeight);
+	glClearColor(1, 1, 1, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glBindTexture(GL_TEXTURE_2D, game->clearingCanvasThumbnailTextureId);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	game->canvasThumbnailDirty = true;
+}
+
+// Made again from canvas when we go to menu
+internal void release_canvas_thumbnails(Game * game)
+{
+	GLuint textures [2] = {game->canvasThumbnailTextureId, game->clearingCanvasThumbnailTextureId};
+	glDeleteTextures(2, textures);
+	glDeleteFramebuffers(1, &game->thumbnailFramebuffer);
+
+	game->canvasThumbnailTextureId 			= 0;
+	game->clearingCanvasThumbnailTextureId 	= 0;
+	game->thumbnailFramebuffer 				= 0;
+
+	memory_track(MEMORY_CATEGORY_THUMBNAILS, -canvas_thumbnails_size(game));
+}
+
+// Linear blit to exactly half size averages each 2x2 block, and mipmaps take it from there
+internal void update_canvas_thumbnail(Game * game)
+{
+	PROFILE_SCOPE("update_canvas_thumbnail");
+
+	glBindFramebuffer(GL_FRAMEBUFFER, game->thumbnailFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, game->canvasThumbnailTextureId, 0);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, game->canvasFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, game->thumbnailFramebuffer);
+	glBlitFramebuffer(	0, 0, game->thumbnailWidth * 2, game->thumbnailHeight * 2,
+						0, 0, game->thumbnailWidth, game->thumbnailHeight,
+						GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	glBindTexture(GL_TEXTURE_2D, game->canvasThumbnailTextureId);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	game->canvasThumbnailDirty = false;
+}
+
+internal void copy_undo_checkpoint(Game * game, int32 slot, bool32 toCanvas)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, game->undoCheckpointFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, game->undoCheckpointTextures[slot], 0);
+
+	GLuint source 		= toCanvas ? game->undoCheckpointFramebuffer : game->canvasFramebuffer;
+	GLuint destination 	= toCanvas ? game->canvasFramebuffer : game->undoCheckpointFramebuffer;
+
+	int32 width 	= game->context.width;
+	int32 height 	= game->context.height;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destination);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+internal void commit_undo_step(Game * game)
+{
+	int32 checkpointSlot = undo_history_commit_step(&game->undoHistory, &game->strokeLog);
+	if (checkpointSlot >= 0)
+	{
+		flush_dabs(&game->dabs);
+		copy_undo_checkpoint(game, checkpointSlot, false);
+	}
+}
+
+internal void move_undo_cursor(Game * game, int32 cursor)
+{
+	// Any dabs still waiting are either replayed below or undone
+	game->dabs.count = 0;
+
+	int32 checkpointSlot;
+	int32 replayStart = undo_history_find_base(&game->undoHistory, &game->strokeLog, cursor, &checkpointSlot);
+
+	if (checkpointSlot >= 0)
+	{
+		copy_undo_checkpoint(game, checkpointSlot, true);
+	}
+	else
+	{
+		clear_canvas(game);
+	}
+
+	replay_stroke_log(&game->strokeLog, replayStart, cursor, &game->dabs);
+	flush_dabs(&game->dabs);
+
+	undo_history_move_cursor(&game->undoHistory, &game->strokeLog, cursor, replayStart);
+	game->brushGradientTextureIndex = stroke_log_gradient_index(&game->strokeLog, cursor);
+
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Undo history moved to %d, replayed %d entries", cursor, cursor - replayStart);
+
+	game->fullRedrawCount 		= 1;
+	game->canvasThumbnailDirty 	= true;
+}
+
+internal void undo(Game * game)
+{
+	int32 cursor = undo_history_previous_step(&game->undoHistory, &game->strokeLog);
+	if (cursor >= 0)
+	{
+		move_undo_cursor(game, cursor);
+	}
+}
+
+internal void redo(Game * game)
+{
+	int32 cursor = undo_history_next_step(&game->undoHistory, &game->strokeLog);
+	if (cursor >= 0)
+	{
+		move_undo_cursor(game, cursor);
+	}
+}
+
+internal void end_draw_stroke(Game * game, int64 eventTime)
+{
+	undo_history_truncate(&game->undoHistory, &game->strokeLog);
+
+	float strokeWidth = stroke_width_from_hold_time(game);
+	if (game->stroke.strokeMoved == false)
+	{
+		stroke_log_record_width(&game->strokeLog, strokeWidth);
+	}
+
+	stroke_log_record_end(&game->strokeLog, eventTime);
+	stroke_advance_time(&game->stroke, stroke_log_last_time_step(&game->strokeLog));
+	latency_end(&game->latency, game->stroke.strokeMoved);
+	stroke_end(&game->stroke, strokeWidth, &game->dabs);
+	game->strokeActive = false;
+
+	commit_undo_step(game);
+}
+
+internal void feed_synthetic_input(Game * game)
+{
+	v2 center 		= {game->context.width / 2.0f, game->context.height / 2.0f};
+	float radius 	= 0.3f * (game->context.width < game->context.height ? game->context.width : game->context.height);
+
+	v2 position;
+	int64 eventTime;
+
+	SyntheticInputAction action;
+	while((action = latency_next_synthetic_input(&game->latency, center, radius, &position, &eventTime)) != SYNTHETIC_INPUT_NONE)
+	{
+		int64 receiveTime = time_now_nanoseconds();
+		switch(action)
+		{
+			case SYNTHETIC_INPUT_BEGIN:
+				if (game->strokeActive)
+				{
+					end_draw_stroke(game, eventTime);
+				}
+				game->touchDownTime = time_now();
+				begin_draw_stroke(game, position, strokeDynamicsNone, false, eventTime, receiveTime);
+				break;
+
+			case SYNTHETIC_INPUT_MOVE:
+				if (game->strokeActive)
+				{
+					queue_draw_position(game, position, strokeDynamicsNone, eventTime, receiveTime);
+				}
+				break;
+
+			case SYNTHETIC_INPUT_END:
+				if (game->strokeActive)
+				{
+					queue_draw_position(game, position, strokeDynamicsNone, eventTime, receiveTime);
+					end_draw_stroke(game, eventTime);
+				}
+				break;
+
+			case SYNTHETIC_INPUT_NONE:
+				break;
+		}
+	}
+}
+
+// Everything outside 'region' is left as is
+internal void draw_canvas(Game * game, rect region)
+{
+	PROFILE_SCOPE("draw_canvas");
+
+	float tweenedPosition;
+	{
+		float i = std::floor(game->viewPosition);
+		float f = game->viewPosition - i;
+		f = f * (f * (f * -2 + 3));
+		tweenedPosition = i + f;
+		}
+
+	// Note(Leo): Draw the mighty "full screen triangle"
+	GLfloat canvasVertices [] =
+	{
+		-1 + 2 * (tweenedPosition - game->drawViewPosition), -1, 0, 0,
+		 3 + 2 * (tweenedPosition - game->drawViewPosition), -1, 2, 0,
+		-1 + 2 * (tweenedPosition - game->drawViewPosition),  3, 0, 2,
+	};
+
+	// Bind screen framebuffer
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, game->context.width, game->context.height);
+
+	GLint pixelRect [4];
+	get_pixel_rect(&game->context, region, pixelRect);
+
+	bool32 fullScreen = pixelRect[2] == game->context.width && pixelRect[3] == game->context.height;
+	if (fullScreen == false)
+	{
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(pixelRect[0], pixelRect[1], pixelRect[2], pixelRect[3]);
+	}
+
+	bool32 menuVisible = tweenedPosition != game->drawViewPosition;
+
+	// Canvas covers everything in draw view, but tell driver old contents are not needed, so tiled gpus do not load them
+	if (menuVisible)
+	{
+		glClearColor(1,1,1,1);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	else if (fullScreen)
+	{
+		GLenum attachments [] = { GL_COLOR };
+		glInvalidateFramebuffer(GL_FRAMEBUFFER, 1, attachments);
+	}
+
+	glUseProgram(game->canvasShaderId);
+	glDisable( GL_BLEND );
+
+	// Todo(Leo): read once in init place
+	GLint textureLocation 			= glGetUniformLocation(game->canvasShaderId, "canvasTexture");
+	GLint clearingTextureLocation 	= glGetUniformLocation(game->canvasShaderId, "clearingCanvasTexture");
+	GLint clearProgressLocation 	= glGetUniformLocation(game->canvasShaderId, "clearProgress");
+
+	glUniform1i(textureLocation, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, game->canvasTextureId);
+
+	glUniform1i(clearingTextureLocation, 1);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, game->clearingCanvasTextureId);
+	glUniform1f(clearProgressLocation, game->canvasClearProgress);
+
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, canvasVertices);
+	glEnableVertexAttribArray(0);
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 3);
+	PROFILER_ADD(PROFILER_COUNTER_DRAW_CALLS, 1);
+
+	PROFILER_ADD(PROFILER_COUNTER_GPU_BYTES, (int64)pixelRect[2] * pixelRect[3] * (game->canvasClearProgress < 1 ? 12 : 8));
+
+	glDisable(GL_SCISSOR_TEST);
+
+	if (menuVisible == false)
+	{
+		// Unbind so we can draw to these on next frame
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glDisableVertexAttribArray(0);
+		return;
+	}
+
+	/// ------------------------------------------------------
 	/// BUTTONS
 
 	// Todo(Leo): better naming, what fukin context
@@ -962,266 +1838,883 @@ internal void draw_canvas(Game * game)
 		size.x /= (context.width / 2);
 		size.y /= (context.height / 2);
 
-		position.x = position.x / (context.width / 2) - 1;
-		position.y = 1 - position.y / (context.height / 2) - size.y; 
+		position.x = position.x / (context.width / 2) - 1;
+		position.y = 1 - position.y / (context.height / 2) - size.y; 
+
+
+		struct Vertex
+		{
+			v2 position;
+			v2 texcoord;
+		};
+
+		float x = position.x;
+		float y = position.y;
+
+		float w = size.x;
+		float h = size.y;
+
+		Vertex * vertices = (Vertex*)vertexArray;
+		vertices[0] = { x, 		y, 		uvStart.x, 	uvStart.y };
+		vertices[1] = { x + w, 	y, 		uvEnd.x, 	uvStart.y };
+		vertices[2] = { x,  	y + h, 	uvStart.x, 	uvEnd.y };
+		vertices[3] = { x + w,  y + h, 	uvEnd.x, 	uvEnd.y };
+	};
+
+	GLfloat quadVertices [16];
+
+	v2 menuViewOffset = {(tweenedPosition - game->menuViewPosition) * game->context.width, 0};
+
+	// Same shader for thumbnails, so that clearing animates there too
+	compute_quad_vertices(quadVertices, game->clearCanvasPosition + menuViewOffset, game->clearCanvasSize, {0,0}, {1,1});
+
+	glBindTexture(GL_TEXTURE_2D, game->clearingCanvasThumbnailTextureId);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, game->canvasThumbnailTextureId);
+	glActiveTexture(GL_TEXTURE1);
+
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, quadVertices);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	PROFILER_ADD(PROFILER_COUNTER_DRAW_CALLS, 1);
+
+	// Unbind so we can draw to these on next frame
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glUseProgram(game->quadShader);
+
+	GLint buttonTextureLocation = glGetUniformLocation(game->quadShader, "_texture");
+	GLint quadDrawModeLocation = glGetUniformLocation(game->quadShader, "mode");
+
+	enum 
+	{
+		QUAD_MODE_TEXT 	= 0,
+		QUAD_MODE_IMAGE = 1,
+	};
+
+	compute_quad_vertices(quadVertices, game->creditsPosition + menuViewOffset, game->clearCanvasSize, {0,0}, {1,1});
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBindTexture(GL_TEXTURE_2D, game->creditsTexture);
+	glUniform1i(quadDrawModeLocation, QUAD_MODE_TEXT);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	PROFILER_ADD(PROFILER_COUNTER_DRAW_CALLS, 1);
+
+	glDisableVertexAttribArray(0);
+}
+
+/*
+Redraw only where buffer we got is out of date, single buffered is always one frame old.
+Anything else than strokes changing in draw view is a full redraw. Returns what changed.
+*/
+internal rect draw_frame(Game * game)
+{
+	rect screenRect = {{0, 0}, {(float)game->context.width, (float)game->context.height}};
+
+	EGLint bufferAge = 0;
+	if (game->context.singleBuffered)
+	{
+		bufferAge = 1;
+	}
+	else if (game->context.supportsBufferAge)
+	{
+		eglQuerySurface(game->context.display, game->context.surface, EGL_BUFFER_AGE_EXT, &bufferAge);
+	}
+
+	bool32 onlyCanvasChanged = game->state == VIEW_DRAW
+							&& game->canvasClearProgress >= 1
+							&& game->fullRedrawCount == 0;
+
+	// Wet tail drawn this frame is added after it is drawn
+	rect frameDamage = rect_union(game->canvasDirtyRect, game->wetTailRect);
+	rect olderDamage;
+
+	if (onlyCanvasChanged && damage_history_get(&game->damageHistory, bufferAge, &olderDamage))
+	{
+		rect redrawRect = rect_union(frameDamage, olderDamage);
+		if (rect_is_empty(redrawRect) == false)
+		{
+			draw_canvas(game, redrawRect);
+		}
+	}
+	else
+	{
+		draw_canvas(game, screenRect);
+		frameDamage = screenRect;
+	}
+
+	draw_wet_stroke_tail(game);
+	frameDamage = rect_union(frameDamage, game->wetTailRect);
+
+	damage_history_push(&game->damageHistory, frameDamage);
+	game->canvasDirtyRect = rect_empty();
+
+	if (game->fullRedrawCount > 0)
+	{
+		game->fullRedrawCount -= 1;
+	}
+
+	return frameDamage;
+}
+
+internal void present_frame(GLContext * context, rect damage)
+{
+	if (context->swapBuffersWithDamage != nullptr && context->singleBuffered == false && rect_is_empty(damage) == false)
+	{
+		EGLint damageRect [4];
+		get_pixel_rect(context, damage, damageRect);
+		context->swapBuffersWithDamage(context->display, context->surface, damageRect, 1);
+	}
+	else
+	{
+		eglSwapBuffers(context->display, context->surface);
+	}
+}
+
+internal void update_low_latency_drawing(Game * game)
+{
+	bool32 singleBuffered = game->lowLatencyDrawing && game->state == VIEW_DRAW && game->canvasClearProgress >= 1;
+	if (singleBuffered == game->context.singleBuffered)
+	{
+		return;
+	}
+
+	if (set_single_buffered(&game->context, singleBuffered) == false)
+	{
+		game->lowLatencyDrawing = false;
+		return;
+	}
+
+	// Mode changes on next swap, and we do not know what is in the buffer we get after that
+	game->fullRedrawCount = 2;
+}
+
+enum
+{
+	LOOPER_ID_MAIN 	= 1,
+	LOOPER_ID_INPUT = 2,
+	LOOPER_ID_USER 	= 3,
+};
+
+enum
+{
+	APP_CMD_INPUT_CHANGED,
+	APP_CMD_INIT_WINDOW,
+	APP_CMD_TERM_WINDOW,
+	APP_CMD_WINDOW_RESIZED,
+	APP_CMD_WINDOW_REDRAW_NEEDED,
+	APP_CMD_CONTENT_RECT_CHANGED,
+	APP_CMD_GAINED_FOCUS,
+	APP_CMD_LOST_FOCUS,
+	APP_CMD_CONFIG_CHANGED,
+	APP_CMD_LOW_MEMORY,
+	APP_CMD_START,
+	APP_CMD_RESUME,
+	APP_CMD_SAVE_STATE,
+	APP_CMD_PAUSE,
+	APP_CMD_STOP,
+	APP_CMD_DESTROY,
+};
+
+internal void free_saved_state(Game * game)
+{
+	pthread_mutex_lock(&game->mutex);
+	if (game->savedState != NULL) {
+		free(game->savedState);
+		game->savedState = NULL;
+		game->savedStateSize = 0;
+	}
+	pthread_mutex_unlock(&game->mutex);
+}
+ 
+internal void android_app_write_cmd(Game * game, int8_t cmd)
+{
+	AppCommand command 	= {};
+	command.type 		= cmd;
+	app_command_queue_push(&game->commands, command);
+}
+
+internal void print_cur_config(Game * game)
+{
+	char lang[2], country[2];
+	AConfiguration_getLanguage(game->config, lang);
+	AConfiguration_getCountry(game->config, country);
+
+	GLUE_LOGV("Config: mcc=%d mnc=%d lang=%c%c cnt=%c%c orien=%d touch=%d dens=%d "
+			"keys=%d nav=%d keysHid=%d navHid=%d sdk=%d size=%d long=%d "
+			"modetype=%d modenight=%d",
+			AConfiguration_getMcc(game->config),
+			AConfiguration_getMnc(game->config),
+			lang[0], lang[1], country[0], country[1],
+			AConfiguration_getOrientation(game->config),
+			AConfiguration_getTouchscreen(game->config),
+			AConfiguration_getDensity(game->config),
+			AConfiguration_getKeyboard(game->config),
+			AConfiguration_getNavigation(game->config),
+			AConfiguration_getKeysHidden(game->config),
+			AConfiguration_getNavHidden(game->config),
+			AConfiguration_getSdkVersion(game->config),
+			AConfiguration_getScreenSize(game->config),
+			AConfiguration_getScreenLong(game->config),
+			AConfiguration_getUiModeType(game->config),
+			AConfiguration_getUiModeNight(game->config));
+}
+
+// Preview is read from thumbnail's second level, which is quarter of canvas size
+internal bool32 save_canvas_document(Game * game)
+{
+	PROFILE_SCOPE("save_canvas_document");
+
+	if (game->canvasThumbnailTextureId == 0)
+	{
+		initialize_canvas_thumbnails(game);
+	}
+
+	if (game->canvasThumbnailDirty)
+	{
+		update_canvas_thumbnail(game);
+	}
+
+	int32 width 		= game->context.width;
+	int32 height 		= game->context.height;
+	int32 previewWidth 	= game->thumbnailWidth / 2 > 0 ? game->thumbnailWidth / 2 : 1;
+	int32 previewHeight = game->thumbnailHeight / 2 > 0 ? game->thumbnailHeight / 2 : 1;
+
+	char const * directory = game->activity->internalDataPath;
+
+	CanvasDocument document;
+	if (canvas_document_begin_write(&document, directory, width, height, previewWidth, previewHeight) == false)
+	{
+		return false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, game->thumbnailFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, game->canvasThumbnailTextureId, 1);
+	glReadPixels(0, 0, previewWidth, previewHeight, GL_RGBA, GL_UNSIGNED_BYTE, document.preview);
+
+	// Read back through pack buffer, so that driver copies straight into mapped pages
+	size_t pixelDataSize = (size_t)width * height * 4;
+
+	GLuint packBuffer;
+	glGenBuffers(1, &packBuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, pixelDataSize, nullptr, GL_STREAM_READ);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, game->canvasFramebuffer);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+	void * pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixelDataSize, GL_MAP_READ_BIT);
+	if (pixels != nullptr)
+	{
+		memcpy(document.pixels, pixels, pixelDataSize);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glDeleteBuffers(1, &packBuffer);
+
+	if (pixels == nullptr)
+	{
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, document.pixels);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return canvas_document_commit(&document, directory);
+}
+
+internal void report_startup_time(Game * game, char const * what)
+{
+	double milliseconds = (time_now_nanoseconds() - game->startTime) / 1'000'000.0;
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Startup: %s %.1f ms after onCreate", what, milliseconds);
+}
 
+// Returns false if there is no document that fits current canvas
+internal bool32 begin_canvas_restore(Game * game)
+{
+	CanvasDocument * document = &game->canvasRestoreDocument;
+	if (canvas_document_open(document, game->activity->internalDataPath) == false)
+	{
+		return false;
+	}
 
-		struct Vertex
-		{
-			v2 position;
-			v2 texcoord;
-		};
+	CanvasDocumentHeader const & header = *document->header;
+	if (header.width != game->context.width || header.height != game->context.height)
+	{
+		__android_log_print(ANDROID_LOG_INFO, "Game", "Canvas document is %d x %d, but canvas is %d x %d",
+							header.width, header.height, game->context.width, game->context.height);
+		canvas_document_close(document);
+		return false;
+	}
 
-		float x = position.x;
-		float y = position.y;
+	GLuint previewTexture;
+	glGenTextures(1, &previewTexture);
+	glBindTexture(GL_TEXTURE_2D, previewTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, header.previewWidth, header.previewHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, document->preview);
 
-		float w = size.x;
-		float h = size.y;
+	glBindFramebuffer(GL_FRAMEBUFFER, game->thumbnailFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, previewTexture, 0);
 
-		Vertex * vertices = (Vertex*)vertexArray;
-		vertices[0] = { x, 		y, 		uvStart.x, 	uvStart.y };
-		vertices[1] = { x + w, 	y, 		uvEnd.x, 	uvStart.y };
-		vertices[2] = { x,  	y + h, 	uvStart.x, 	uvEnd.y };
-		vertices[3] = { x + w,  y + h, 	uvEnd.x, 	uvEnd.y };
-	};
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, game->thumbnailFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, game->canvasFramebuffer);
+	glBlitFramebuffer(	0, 0, header.previewWidth, header.previewHeight,
+						0, 0, header.width, header.height,
+						GL_COLOR_BUFFER_BIT, GL_LINEAR);
 
-	GLfloat quadVertices [16];
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteTextures(1, &previewTexture);
 
-	glUseProgram(game->quadShader);
+	StrokeLog const & log = game->strokeLog;
 
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, quadVertices);
-	glEnableVertexAttribArray(0);
+	game->canvasRestorePending 			= true;
+	game->canvasPreviewShown 			= false;
+	game->canvasRestoreRow 				= 0;
+	game->canvasRestoreLogStart 		= log.strokeBeginIndex >= 0 ? log.strokeBeginIndex : log.count;
+	game->canvasRestoreCheckpointSlot 	= -1;
+	game->canvasThumbnailDirty 			= true;
+	return true;
+}
 
-	GLint buttonTextureLocation = glGetUniformLocation(game->quadShader, "_texture");
-	GLint quadDrawModeLocation = glGetUniformLocation(game->quadShader, "mode");
+// Replay strokes drawn since restore began, clipped to rows that were just uploaded
+internal void replay_strokes_on_restored_rows(Game * game, int32 firstRow, int32 rowCount)
+{
+	if (game->strokeLog.count <= game->canvasRestoreLogStart)
+	{
+		return;
+	}
 
-	enum 
+	auto flush = [](void * data, DabBuffer * buffer)
 	{
-		QUAD_MODE_TEXT 	= 0,
-		QUAD_MODE_IMAGE = 1,
+		Game * game = (Game*)data;
+		draw_dabs(game, buffer->count, buffer->dabs, game->canvasFramebuffer, game->context.width, game->context.height);
+		buffer->count = 0;
 	};
 
-	glActiveTexture(GL_TEXTURE0);
+	Dab dabMemory [256];
+	DabBuffer dabs = {dabMemory, 0, 256, flush, game};
 
-	v2 menuViewOffset = {(tweenedPosition - game->menuViewPosition) * game->context.width, 0};
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, firstRow, game->context.width, rowCount);
 
-	compute_quad_vertices(quadVertices, game->clearCanvasPosition + menuViewOffset, game->clearCanvasSize, {0,0}, {1,1});
+	replay_stroke_log(&game->strokeLog, game->canvasRestoreLogStart, game->strokeLog.count, &dabs);
+	flush_dabs(&dabs);
+
+	glDisable(GL_SCISSOR_TEST);
+}
+
+// Always at least one row. Document rows are bottom up like GL rows.
+internal void continue_canvas_restore(Game * game, int64 byteBudget)
+{
+	PROFILE_SCOPE("continue_canvas_restore");
+
+	CanvasDocument * document 			= &game->canvasRestoreDocument;
+	CanvasDocumentHeader const & header = *document->header;
+
+	size_t rowSize 	= (size_t)header.width * 4;
+	int64 rowBudget = byteBudget / (int64)rowSize;
+
+	int32 firstRow 	= game->canvasRestoreRow;
+	int32 rowCount 	= header.height - firstRow;
+	if (rowBudget >= 1 && rowBudget < rowCount)
+	{
+		rowCount = (int32)rowBudget;
+	}
+
+	// Dabs still waiting would otherwise be drawn twice on these rows
+	flush_dabs(&game->dabs);
+
+	uint8 * rows = document->pixels + firstRow * rowSize;
 
-	glDisable(GL_BLEND);
 	glBindTexture(GL_TEXTURE_2D, game->canvasTextureId);
-	glUniform1i(quadDrawModeLocation, QUAD_MODE_IMAGE);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, header.width, rowCount, GL_RGBA, GL_UNSIGNED_BYTE, rows);
 
-	compute_quad_vertices(quadVertices, game->creditsPosition + menuViewOffset, game->clearCanvasSize, {0,0}, {1,1});
+	// First checkpoint was taken from preview, and it must not have new strokes
+	int32 slot = game->canvasRestoreCheckpointSlot;
+	if (slot >= 0 && game->undoHistory.checkpointCount > 0 && undo_history_checkpoint_slot(&game->undoHistory, 0) == slot)
+	{
+		glBindTexture(GL_TEXTURE_2D, game->undoCheckpointTextures[slot]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, header.width, rowCount, GL_RGBA, GL_UNSIGNED_BYTE, rows);
+	}
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glBindTexture(GL_TEXTURE_2D, game->creditsTexture);
-	glUniform1i(quadDrawModeLocation, QUAD_MODE_TEXT);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	replay_strokes_on_restored_rows(game, firstRow, rowCount);
 
-	glDisableVertexAttribArray(0);
+	// Rows rarely start at page boundary, so drop from start of document
+	canvas_document_drop_pages(document, (rows + rowCount * rowSize) - document->mapping);
+
+	game->canvasRestoreRow 		= firstRow + rowCount;
+	game->canvasThumbnailDirty 	= true;
+	game->fullRedrawCount 		= 1;
+
+	PROFILER_ADD(PROFILER_COUNTER_GPU_BYTES, rowCount * rowSize);
+
+	if (game->canvasRestoreRow == header.height)
+	{
+		canvas_document_close(document);
+		game->canvasRestorePending = false;
+	}
+}
+
+// Before anything that does not work on top of a partially restored canvas
+internal void finish_canvas_restore(Game * game)
+{
+	if (game->canvasRestorePending)
+	{
+		continue_canvas_restore(game, INT64_MAX);
+	}
 }
 
-internal void update_stroke(Game * game, v2 oneBeforeStrokeStart, v2 strokeStart, v2 strokeEnd, v2 oneAfterStrokeEnd)
+/*
+Give back what can be made again later. Undo keeps only its newest checkpoint until window is
+created again, stroke log is kept so that nothing drawn is lost.
+*/
+internal void handle_low_memory(Game * game)
 {
-		// Todo(Leo): Thoroughly evaluate these two
-	constexpr float maxStrokeLength 			= 50;
-	constexpr float strokeStartMoveThreshold 	= 10;
+	memory_report("before low memory");
 
-	if (game->strokeMoved == false)
+	if (game->initialized)
 	{
-		float strokeLength = v2_magnitude(strokeEnd - strokeStart);
+		if (game->creditsTexture != 0)
+		{
+			release_credits_texture(game);
+		}
 
-		if (strokeLength >= strokeStartMoveThreshold)
+		// Clear animation reads old thumbnail, which can not be made again
+		if (game->state == VIEW_DRAW && game->canvasClearProgress >= 1 && game->canvasThumbnailTextureId != 0)
 		{
-			float timeSinceTouchDownMS 			= time_elapsed_milliseconds(game->touchDownTime);
-			float interpolatonTime 				= float_clamp(timeSinceTouchDownMS / game->maxBrushSizeTimeMS, 0, 1);
-			game->strokeWidth 					= float_lerp(game->minBrushSize, game->maxBrushSize, interpolatonTime);
-			game->strokeMoved 					= true;
-			game->lastStrokeSectionLength 		= strokeLength;
-			game->currentStrokeColourSelection 	= float_clamp(strokeLength / maxStrokeLength, 0, 1);
+			release_canvas_thumbnails(game);
 		}
-		else
+
+		if (game->canvasRestorePending)
+		{
+			canvas_document_drop_pages(&game->canvasRestoreDocument, game->canvasRestoreDocument.size);
+		}
+
+		int32 oldCheckpointCapacity = game->undoHistory.checkpointCapacity;
+		int32 newestSlot 			= undo_history_keep_newest_checkpoint(&game->undoHistory);
+
+		if (newestSlot > 0)
+		{
+			GLuint newestTexture 						= game->undoCheckpointTextures[newestSlot];
+			game->undoCheckpointTextures[newestSlot] 	= game->undoCheckpointTextures[0];
+			game->undoCheckpointTextures[0] 			= newestTexture;
+		}
+
+		// Restore also fills the checkpoint it started from, if that one was kept it is in slot 0 now
+		if (game->canvasRestoreCheckpointSlot >= 0)
+		{
+			game->canvasRestoreCheckpointSlot = game->canvasRestoreCheckpointSlot == newestSlot ? 0 : -1;
+		}
+
+		if (oldCheckpointCapacity > 1)
 		{
-			return;
+			int32 releasedCount = oldCheckpointCapacity - 1;
+			glDeleteTextures(releasedCount, game->undoCheckpointTextures + 1);
+			memory_track(MEMORY_CATEGORY_UNDO_CHECKPOINTS, -(int64)releasedCount * game->context.width * game->context.height * 4);
 		}
 	}
 
-	/// --------------------------------------------------------
+	// Commands are handled before frame, so frame arena is mostly empty now
+	size_t decommittedBytes = arena_decommit(&game->frameArena);
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Gave back %zu KiB of frame arena", decommittedBytes / 1024);
+
+	memory_report("after low memory");
+}
+
+/*
+Scale is set with 'adb shell setprop debug.idiotgame.exportscale 1..4', default is 2. Game
+thread only copies stroke log and brush, rest happens in jobs. If stroke log does not have
+whole drawing, canvas is read back instead and exported at its own size.
+*/
+struct ExportJob
+{
+	JobSystem * 	jobs;
+	CompositorBrush brush;
+
+	// Drawing visible at undo cursor
+	StrokeLog 		log;
+	size_t 			logMemorySize;
+
+	// Top down when composited, bottom up when read back from canvas
+	uint8 * 		pixels;
+	size_t 			pixelsSize;
+	int32 			width;
+	int32 			height;
+	bool32 			pixelsReadBack;
+
+	char 			path [256];
+	int64 			startTime;
+
+	int32 			timelapseSpeed;
+};
+
+internal void flip_rows(uint8 * pixels, int32 width, int32 height)
+{
+	size_t rowSize 	= (size_t)width * 4;
+	uint8 * row 	= (uint8*)memory_heap_allocate(rowSize, MEMORY_CATEGORY_EXPORT);
+	if (row == nullptr)
+	{
+		return;
+	}
+
+	for (int32 y = 0; y < height / 2; ++y)
+	{
+		uint8 * top 	= pixels + y * rowSize;
+		uint8 * bottom 	= pixels + (height - 1 - y) * rowSize;
+		memcpy(row, top, rowSize);
+		memcpy(top, bottom, rowSize);
+		memcpy(bottom, row, rowSize);
+	}
+
+	memory_heap_free(row, rowSize, MEMORY_CATEGORY_EXPORT);
+}
 
-	// Note(Leo): roughly a third, and half to account for averages of in and out tangents
-	float tangentScale = 0.16;
+#ifndef NDEBUG
+internal void verify_exported_png(ExportJob const * job)
+{
+	int file = open(job->path, O_RDONLY | O_CLOEXEC);
+	struct stat fileStat;
+	if (file < 0 || fstat(file, &fileStat) != 0)
+	{
+		log_error("Could not open exported png to verify it");
+		if (file >= 0)
+		{
+			close(file);
+		}
+		return;
+	}
 
-	v2 startInTangent = (strokeStart - oneBeforeStrokeStart);
-	v2 startOutTangent = (strokeEnd - strokeStart);
-	v2 startTangent = (startInTangent + startOutTangent) * tangentScale;
+	size_t fileSize 	= fileStat.st_size;
+	uint8 * fileData 	= (uint8*)memory_heap_allocate(fileSize, MEMORY_CATEGORY_EXPORT);
+	bool32 read 		= fileData != nullptr && pread(file, fileData, fileSize, 0) == (ssize_t)fileSize;
+	close(file);
 
-	v2 endInTangent = startOutTangent;
-	v2 endOutTangent = (oneAfterStrokeEnd - strokeEnd);
-	v2 endTangent = (endInTangent + endOutTangent) * tangentScale;
+	int width, height, channels;
+	uint8 * decoded = read ? stbi_load_from_memory(fileData, fileSize, &width, &height, &channels, 3) : nullptr;
 
-	v2 a = strokeStart;
-	v2 b = strokeStart + startTangent;
-	v2 c = strokeEnd - endTangent;
-	v2 d = strokeEnd;
+	bool32 matches = decoded != nullptr && width == job->width && height == job->height;
+	for (size_t i = 0; matches && i < (size_t)width * height; ++i)
+	{
+		matches = memcmp(decoded + i * 3, job->pixels + i * 4, 3) == 0;
+	}
 
-	struct ArcLengthMapEntry
+	if (matches)
 	{
-		float length;
-		float t;
-	};
-	constexpr int precision = 10;
-	ArcLengthMapEntry arcLengthMap[precision] = {{0, 0}};
+		log_info("Exported png verified");
+	}
+	else
+	{
+		log_error("Exported png does not match drawing");
+	}
+
+	stbi_image_free(decoded);
+	memory_heap_free(fileData, fileSize, MEMORY_CATEGORY_EXPORT);
+}
+#endif
+
+/*
+Enabled with 'adb shell setprop debug.idiotgame.timelapse <speed>'. Frames are written as
+numbered pngs next to exported image, make a video eg. with 'ffmpeg -framerate 30 -i %05d.png out.mp4'.
+*/
+internal void export_timelapse(ExportJob * job)
+{
+	PROFILE_SCOPE("export_timelapse");
+
+	constexpr float framesPerSecond = 30;
+	constexpr int32 maxFrameCount 	= 3600;
 
-	v2 previousArcPosition = strokeStart;
-	for (int i = 1; i < precision; ++i)
+	StrokeLog const * log 	= &job->log;
+	float drawingSeconds 	= stroke_log_timelapse_seconds(log);
+
+	float frameSeconds = job->timelapseSpeed / framesPerSecond;
+	if (drawingSeconds / frameSeconds > maxFrameCount)
 	{
-		float t 			= (float)i / (precision - 1);
-		v2 nextArcPosition 	= v2_cubic_bezier_lerp(a,b,c,d, t);
-		float arcLength 	= v2_magnitude(nextArcPosition - previousArcPosition);
+		frameSeconds = drawingSeconds / maxFrameCount;
+		log_info("Time-lapse would be too long, speeding it up");
+	}
 
-		arcLengthMap[i].length 	= arcLengthMap[i - 1].length + arcLength;
-		arcLengthMap[i].t 		= t;
-		
-		previousArcPosition 	= nextArcPosition;
+	char directory [256];
+	snprintf(directory, sizeof(directory), "%.*s_frames", (int)(strlen(job->path) - 4), job->path);
+	if (mkdir(directory, 0700) != 0 && errno != EEXIST)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not create %s, error = %d", directory, errno);
+		return;
 	}
 
-	float totalArcLength = arcLengthMap[precision - 1].length;
+	int32 width 		= log->width;
+	int32 height 		= log->height;
+	size_t pixelsSize 	= (size_t)width * height * 4;
+	uint8 * pixels 		= (uint8*)memory_heap_allocate(pixelsSize, MEMORY_CATEGORY_EXPORT);
+
+	Compositor * compositor = new Compositor();
+	PngEncoder * encoder 	= new PngEncoder();
 
-	float colourSelection = float_clamp(totalArcLength / maxStrokeLength, 0, 1);
+	bool32 ok = pixels != nullptr
+				&& compositor_initialize(	compositor, job->jobs, &job->brush, job->jobs->workerCount,
+											pixels, width, height, log->width, log->height);
 
-	float drawDotArcLengthThreshold = game->strokeWidth / 10;
-	int dotCount = static_cast<int>(totalArcLength / drawDotArcLengthThreshold);
+	int64 startTime = time_now_nanoseconds();
+	int32 frameCount = 0;
 
-	for (int i = 0; i < dotCount; ++i)
+	if (ok)
 	{
-		float t = static_cast<float>(i) / (dotCount - 1);
-		float targetArcLength = t * totalArcLength;
+		compositor_clear(compositor);
 
-		int index = 0;
-		while(arcLengthMap[index].length > targetArcLength)
+		StrokeLogReplay replay;
+		stroke_log_replay_begin(&replay, 0);
+
+		StrokeLogTimelapse timelapse;
+		stroke_log_timelapse_begin(&timelapse, frameSeconds);
+
+		int32 entryIndex;
+		while (ok && (entryIndex = stroke_log_timelapse_next_frame(log, &timelapse)) >= 0)
 		{
-			index += 1;
-		}
+			stroke_log_replay_continue(log, &replay, entryIndex, &compositor->dabs);
+			flush_dabs(&compositor->dabs);
+
+			char framePath [256 + 16];
+			snprintf(framePath, sizeof(framePath), "%s/%05d.png", directory, frameCount);
 
-		auto previousArcPoint 	= arcLengthMap[index];
-		auto nextArcPoint 		= arcLengthMap[index + 1];
+			ok = png_encode(encoder, job->jobs, pixels, width, height) && png_encoder_write(encoder, framePath);
+			png_encoder_free(encoder);
 
-		float tt = (targetArcLength - previousArcPoint.length) / (nextArcPoint.length - previousArcPoint.length);
-		t = float_lerp(previousArcPoint.t, nextArcPoint.t, tt);
+			frameCount += 1;
+		}
 
-		v2 dotPosition = v2_cubic_bezier_lerp(a,b,c,d, t);
+		compositor_finish(compositor);
+	}
 
-		float colorInterpolationTime = float_lerp(game->currentStrokeColourSelection, colourSelection, t);
-		draw_brush(game, dotPosition, game->strokeWidth, colorInterpolationTime);
+	if (ok)
+	{
+		__android_log_print(ANDROID_LOG_INFO, "Game", "Exported time-lapse of %.1f s drawing as %d frames to %s in %.1f ms",
+							drawingSeconds, frameCount, directory, (time_now_nanoseconds() - startTime) / 1'000'000.0);
+	}
+	else
+	{
+		log_error("Time-lapse export failed");
 	}
 
-	game->lastStrokeSectionLength 		= totalArcLength;
-	game->currentStrokeLength 			+= totalArcLength;
-	game->currentStrokeColourSelection 	= float_lerp(game->currentStrokeColourSelection, colourSelection, 0.2);
+	delete encoder;
+	delete compositor;
+	memory_heap_free(pixels, pixelsSize, MEMORY_CATEGORY_EXPORT);
 }
 
-enum
+internal void export_job(void * data)
 {
-	LOOPER_ID_MAIN 	= 1,
-	LOOPER_ID_INPUT = 2,
-	LOOPER_ID_USER 	= 3,
-};
+	PROFILE_SCOPE("export_job");
 
-enum
-{
-	APP_CMD_INPUT_CHANGED,
-	APP_CMD_INIT_WINDOW,
-	APP_CMD_TERM_WINDOW,
-	APP_CMD_WINDOW_RESIZED,
-	APP_CMD_WINDOW_REDRAW_NEEDED,
-	APP_CMD_CONTENT_RECT_CHANGED,
-	APP_CMD_GAINED_FOCUS,
-	APP_CMD_LOST_FOCUS,
-	APP_CMD_CONFIG_CHANGED,
-	APP_CMD_LOW_MEMORY,
-	APP_CMD_START,
-	APP_CMD_RESUME,
-	APP_CMD_SAVE_STATE,
-	APP_CMD_PAUSE,
-	APP_CMD_STOP,
-	APP_CMD_DESTROY,
-};
+	ExportJob * job = (ExportJob*)data;
+	bool32 ok 		= job->pixels != nullptr;
 
-internal void free_saved_state(Game * game)
-{
-	pthread_mutex_lock(&game->mutex);
-	if (game->savedState != NULL) {
-		free(game->savedState);
-		game->savedState = NULL;
-		game->savedStateSize = 0;
+	if (ok && job->pixelsReadBack)
+	{
+		flip_rows(job->pixels, job->width, job->height);
+	}
+	else if (ok)
+	{
+		Compositor * compositor = new Compositor();
+		ok = compositor_initialize(	compositor, job->jobs, &job->brush, job->jobs->workerCount,
+									job->pixels, job->width, job->height, job->log.width, job->log.height);
+		if (ok)
+		{
+			compositor_clear(compositor);
+			replay_stroke_log(&job->log, 0, job->log.count, &compositor->dabs);
+			compositor_finish(compositor);
+		}
+		delete compositor;
 	}
-	pthread_mutex_unlock(&game->mutex);
-}
- 
-/*
-Todo(Leo): Study and understand android_app_read_cmd and android_app_write_cmd functions
-They read and write to same file descriptors (apparently, maybe this is wrong) and that
-way talk to different threads.
 
-Basically android callbacks use write end of pipe, and our main thread uses read end of pipe
-*/
+	int64 encodeStartTime = time_now_nanoseconds();
 
-internal int8_t android_app_read_cmd(Game * game)
-{
-	int8_t cmd;
-	if (read(game->msgread, &cmd, sizeof(cmd)) == sizeof(cmd)) {
-		switch (cmd) {
-			case APP_CMD_SAVE_STATE:
-				free_saved_state(game);
-				break;
-		}
-		return cmd;
-	} else {
-		__android_log_print(ANDROID_LOG_ERROR, "Game", "No data on command pipe!");
+	PngEncoder * encoder = new PngEncoder();
+	ok = ok && png_encode(encoder, job->jobs, job->pixels, job->width, job->height);
+	ok = ok && png_encoder_write(encoder, job->path);
+
+	int64 endTime = time_now_nanoseconds();
+
+	if (ok)
+	{
+		size_t fileSize = png_encoder_file_size(encoder);
+		__android_log_print(ANDROID_LOG_INFO, "Game", "Exported %d x %d to %s, %zu KiB, in %.1f ms, encoding %.1f ms in %d bands",
+							job->width, job->height, job->path, fileSize / 1024,
+							(endTime - job->startTime) / 1'000'000.0, (endTime - encodeStartTime) / 1'000'000.0, encoder->bandCount);
+
+		#ifndef NDEBUG
+		verify_exported_png(job);
+		#endif
+	}
+	else
+	{
+		log_error("Export failed");
+	}
+
+	png_encoder_free(encoder);
+	delete encoder;
+
+	if (ok && job->timelapseSpeed > 0)
+	{
+		export_timelapse(job);
 	}
-	return -1;
+
+	memory_heap_free(job->pixels, job->pixelsSize, MEMORY_CATEGORY_EXPORT);
+	memory_heap_free(job->log.entries, job->logMemorySize, MEMORY_CATEGORY_EXPORT);
+	delete job;
 }
 
-internal void android_app_write_cmd(Game * game, int8_t cmd)
+internal void start_export(Game * game)
 {
-	if (write(game->msgwrite, &cmd, sizeof(cmd)) != sizeof(cmd)) {
-		__android_log_print(ANDROID_LOG_ERROR, "Game", "Failure writing android_app cmd: %s\n", strerror(errno));
+	if (game->exportCounter.value.load(std::memory_order_acquire) > 0 || game->exportReadbackJob != nullptr)
+	{
+		log_info("Export is already running");
+		return;
+	}
+
+	StrokeLog const & log 	= game->strokeLog;
+	int32 cursor 			= game->undoHistory.cursor;
+	int32 drawingStart 		= stroke_log_drawing_start(&log, cursor);
+	bool32 canReplay 		= log.full == false && (game->canvasFromEarlierProcess == false || drawingStart > 0);
+
+	ExportJob * job 	= new ExportJob();
+	job->jobs 			= &game->jobs;
+	job->startTime 		= time_now_nanoseconds();
+
+	if (game->timelapseSpeed > 0)
+	{
+		job->timelapseSpeed = canReplay ? game->timelapseSpeed : 0;
+		if (canReplay == false)
+		{
+			log_error("Time-lapse needs whole drawing in stroke log, not exporting it");
+		}
+	}
+
+	if (canReplay)
+	{
+		// Brush is made again when window is created, so job has its own copy
+		job->brush 			= game->compositorBrush;
+		job->width 			= game->context.width * game->exportScale;
+		job->height 		= game->context.height * game->exportScale;
+
+		job->log 			= log;
+		job->log.count 		= cursor - drawingStart;
+		job->logMemorySize 	= (size_t)job->log.count * sizeof(StrokeLogEntry);
+		job->log.entries 	= (StrokeLogEntry*)memory_heap_allocate(job->logMemorySize, MEMORY_CATEGORY_EXPORT);
+		if (job->log.entries != nullptr)
+		{
+			memcpy(job->log.entries, log.entries + drawingStart, job->logMemorySize);
+		}
+	}
+	else
+	{
+		log_info("Stroke log does not have whole drawing, exporting canvas at its own size");
+
+		finish_canvas_restore(game);
+		flush_dabs(&game->dabs);
+
+		job->width 			= game->context.width;
+		job->height 		= game->context.height;
+		job->pixelsReadBack = true;
+	}
+
+	job->pixelsSize = (size_t)job->width * job->height * 4;
+	job->pixels 	= (uint8*)memory_heap_allocate(job->pixelsSize, MEMORY_CATEGORY_EXPORT);
+
+	if (job->pixels == nullptr || (canReplay && job->log.entries == nullptr && job->logMemorySize > 0))
+	{
+		log_error("Not enough memory to export");
+		memory_heap_free(job->pixels, job->pixelsSize, MEMORY_CATEGORY_EXPORT);
+		memory_heap_free(job->log.entries, job->logMemorySize, MEMORY_CATEGORY_EXPORT);
+		delete job;
+		return;
+	}
+
+	// App specific external storage can be read over usb
+	char const * directory = game->activity->externalDataPath;
+	if (directory == nullptr || (mkdir(directory, 0700) != 0 && errno != EEXIST))
+	{
+		directory = game->activity->internalDataPath;
+	}
+
+	char fileName [64];
+	time_t now = time(nullptr);
+	tm localTime;
+	localtime_r(&now, &localTime);
+	strftime(fileName, sizeof(fileName), "export_%Y%m%d_%H%M%S.png", &localTime);
+	snprintf(job->path, sizeof(job->path), "%s/%s", directory, fileName);
+
+	if (job->pixelsReadBack)
+	{
+		// Mapped only on a later frame when gpu is done, see continue_export_readback
+		glGenBuffers(1, &game->exportReadbackBuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, game->exportReadbackBuffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, job->pixelsSize, nullptr, GL_STREAM_READ);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, game->canvasFramebuffer);
+		glReadPixels(0, 0, job->width, job->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		game->exportReadbackFence 	= glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		game->exportReadbackJob 	= job;
+		return;
 	}
+
+	job_run_background(&game->jobs, export_job, job, &game->exportCounter);
 }
 
-internal void print_cur_config(Game * game)
+// With 'wait' blocks until readback has finished, for when context goes away
+internal void continue_export_readback(Game * game, bool32 wait)
 {
-	char lang[2], country[2];
-	AConfiguration_getLanguage(game->config, lang);
-	AConfiguration_getCountry(game->config, country);
+	ExportJob * job = game->exportReadbackJob;
+	if (job == nullptr)
+	{
+		return;
+	}
 
-	GLUE_LOGV("Config: mcc=%d mnc=%d lang=%c%c cnt=%c%c orien=%d touch=%d dens=%d "
-			"keys=%d nav=%d keysHid=%d navHid=%d sdk=%d size=%d long=%d "
-			"modetype=%d modenight=%d",
-			AConfiguration_getMcc(game->config),
-			AConfiguration_getMnc(game->config),
-			lang[0], lang[1], country[0], country[1],
-			AConfiguration_getOrientation(game->config),
-			AConfiguration_getTouchscreen(game->config),
-			AConfiguration_getDensity(game->config),
-			AConfiguration_getKeyboard(game->config),
-			AConfiguration_getNavigation(game->config),
-			AConfiguration_getKeysHidden(game->config),
-			AConfiguration_getNavHidden(game->config),
-			AConfiguration_getSdkVersion(game->config),
-			AConfiguration_getScreenSize(game->config),
-			AConfiguration_getScreenLong(game->config),
-			AConfiguration_getUiModeType(game->config),
-			AConfiguration_getUiModeNight(game->config));
+	GLuint64 timeout 	= wait ? UINT64_MAX : 0;
+	GLenum status 		= glClientWaitSync(game->exportReadbackFence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		return;
+	}
+
+	PROFILE_SCOPE("continue_export_readback");
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, game->exportReadbackBuffer);
+	void * pixels = status != GL_WAIT_FAILED ? glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job->pixelsSize, GL_MAP_READ_BIT) : nullptr;
+	if (pixels != nullptr)
+	{
+		memcpy(job->pixels, pixels, job->pixelsSize);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	glDeleteBuffers(1, &game->exportReadbackBuffer);
+	glDeleteSync(game->exportReadbackFence);
+	game->exportReadbackBuffer 	= 0;
+	game->exportReadbackFence 	= nullptr;
+	game->exportReadbackJob 	= nullptr;
+
+	if (pixels == nullptr)
+	{
+		log_error("Could not read canvas back for export");
+		memory_heap_free(job->pixels, job->pixelsSize, MEMORY_CATEGORY_EXPORT);
+		delete job;
+		return;
+	}
+
+	job_run_background(&game->jobs, export_job, job, &game->exportCounter);
 }
 
-// Note(Leo): this is called in game main loop thread, and not in android callback thread
-internal void process_input(Game * game)
+// Input thread, what events mean is decided in process_input
+internal void read_input_events(Game * game)
 {
+	pthread_mutex_lock(&game->inputMutex);
+
 	AInputEvent* event = NULL;
-	while (AInputQueue_getEvent(game->inputQueue, &event) >= 0)
+	while (game->inputQueue != NULL && AInputQueue_getEvent(game->inputQueue, &event) >= 0)
 	{
 		GLUE_LOGV("New input event: type=%d\n", AInputEvent_getType(event));
 		if (AInputQueue_preDispatchEvent(game->inputQueue, event) != 0)
@@ -1229,138 +2722,241 @@ internal void process_input(Game * game)
 			continue;
 		}
 
-		bool32 handled = false;
+		InputSample sample 	= {};
+		sample.receiveTime 	= time_now_nanoseconds();
+
+		bool32 isSample = false;
+		bool32 handled 	= false;
 		switch (AInputEvent_getType(event))
 		{
 			case AINPUT_EVENT_TYPE_MOTION:
 			{
 				// Todo(Leo): Check all of these pointer indices
-				switch (AMotionEvent_getAction(event))
+				switch (AMotionEvent_getAction(event) & AMOTION_EVENT_ACTION_MASK)
+				{
+					case AMOTION_EVENT_ACTION_DOWN: 		sample.type = INPUT_SAMPLE_DOWN; 			isSample = true; break;
+					case AMOTION_EVENT_ACTION_POINTER_DOWN: sample.type = INPUT_SAMPLE_POINTER_DOWN; 	isSample = true; break;
+					case AMOTION_EVENT_ACTION_UP: 			sample.type = INPUT_SAMPLE_UP; 				isSample = true; break;
+					case AMOTION_EVENT_ACTION_MOVE: 		sample.type = INPUT_SAMPLE_MOVE; 			isSample = true; handled = true; break;
+				}
+
+				sample.pointerCount = AMotionEvent_getPointerCount(event);
+				sample.position 	= {AMotionEvent_getX(event, 0), AMotionEvent_getY(event, 0)};
+				sample.eventTime 	= AMotionEvent_getEventTime(event);
+
+				// Size is touch major normalized to device's range, tilt is zero for fingers
+				sample.stylus 				= AMotionEvent_getToolType(event, 0) == AMOTION_EVENT_TOOL_TYPE_STYLUS;
+				sample.dynamics.pressure 	= AMotionEvent_getPressure(event, 0);
+				sample.dynamics.size 		= AMotionEvent_getSize(event, 0);
+				sample.dynamics.tilt 		= AMotionEvent_getAxisValue(event, AMOTION_EVENT_AXIS_TILT, 0);
+			} break;
+
+			case AINPUT_EVENT_TYPE_KEY:
+			{	
+				// Todo(Leo): We get downs repeatedly when key is pressed, so we cannot use that as such. Instead manually
+				// track downs and ups, and only proceed on first down after up
+				if (AKeyEvent_getKeyCode(event) == AKEYCODE_BACK && AKeyEvent_getAction(event) == AKEY_EVENT_ACTION_UP)
+				{
+					sample.type 		= INPUT_SAMPLE_BACK;
+					sample.eventTime 	= AKeyEvent_getEventTime(event);
+					isSample 			= true;
+					handled 			= true;
+				}
+			} break;
+		}
+
+		if (isSample)
+		{
+			input_sample_queue_push(&game->inputSamples, sample);
+		}
+
+		AInputQueue_finishEvent(game->inputQueue, event, handled);
+	}
+
+	pthread_mutex_unlock(&game->inputMutex);
+}
+
+internal void* input_thread_entry(void* param)
+{
+	Game * game = (Game*)param;
+
+	// Acquire, so that looper outlives this thread until input queue is detached from it.
+	// Input queue is polled by ident, which looper refuses unless allowed here.
+	ALooper* looper = ALooper_prepare(ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
+	ALooper_acquire(looper);
+
+	pthread_mutex_lock(&game->mutex);
+	game->inputLooper = looper;
+	pthread_cond_broadcast(&game->cond);
+	pthread_mutex_unlock(&game->mutex);
+
+	while (game->inputThreadRunning.load(std::memory_order_acquire))
+	{
+		if (ALooper_pollAll(-1, nullptr, nullptr, nullptr) == LOOPER_ID_INPUT)
+		{
+			read_input_events(game);
+		}
+	}
+
+	return NULL;
+}
+
+// Note(Leo): this is called in game main loop thread, with samples that input thread has read
+internal void process_input(Game * game)
+{
+	PROFILE_SCOPE("process_input");
+
+	uint32 droppedCount = game->inputSamples.droppedCount.exchange(0, std::memory_order_relaxed);
+	if (droppedCount > 0)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Input sample queue was full, dropped %u samples", droppedCount);
+	}
+
+	InputSample sample;
+	while (input_sample_queue_pop(&game->inputSamples, &sample))
+	{
+		switch (sample.type)
+		{
+			case INPUT_SAMPLE_DOWN:
+			{
+				game->undoGesturePointerCount = 0;
+
+				if (game->state == VIEW_DRAW)
+				{
+					float timeSinceLastTouchDown = time_elapsed_seconds(game->touchDownTime);
+					if (timeSinceLastTouchDown < game->doubleTapTimeThreshold)
+					{
+						game->brushMode = BRUSH_ERASE;
+					}
+
+					begin_draw_stroke(game, sample.position, sample.dynamics, sample.stylus, sample.eventTime, sample.receiveTime);
+				}
+
+				game->touchDownTime 	= time_now();
+			} break;
+
+			case INPUT_SAMPLE_POINTER_DOWN:
+			{
+				if (game->state != VIEW_DRAW)
+					break;
+
+				// More fingers before stroke has moved means this is a gesture instead
+				if (game->strokeActive && game->stroke.strokeMoved == false)
+				{
+					cancel_draw_stroke(game);
+					game->undoGesturePointerCount = 1;
+				}
+
+				if (game->undoGesturePointerCount > 0 && sample.pointerCount > game->undoGesturePointerCount)
+				{
+					game->undoGesturePointerCount = sample.pointerCount;
+				}
+			} break;
+
+			case INPUT_SAMPLE_UP:
+			{
+				// Note(Leo): set this regardless of view mode, we might have changed mode here
+				game->brushMode = BRUSH_DRAW;
+
+				if (game->strokeActive)
+				{
+					end_draw_stroke(game, sample.eventTime);
+				}
+
+				if (game->state == VIEW_MENU)
 				{
-					case AMOTION_EVENT_ACTION_DOWN:
+					v2 touchPosition = sample.position;
+
+					auto test_button_rect = [touchPosition](v2 position, v2 size) -> bool32
 					{
-						if (game->state == VIEW_DRAW)
-						{
-							float timeSinceLastTouchDown = time_elapsed_seconds(game->touchDownTime);
-							if (timeSinceLastTouchDown < game->doubleTapTimeThreshold)
-							{
-								game->brushMode = BRUSH_ERASE;
-							}
+						v2 min = position;
+						v2 max = position + size;
+
+						bool32 inside = touchPosition.x > min.x
+										&& touchPosition.x < max.x
+										&& touchPosition.y > min.y
+										&& touchPosition.y < max.y;
 
-							v2 touchPosition = {AMotionEvent_getX(event, 0), AMotionEvent_getY(event, 0)};
+						return inside;
+					};
+
+					if (test_button_rect(game->clearCanvasPosition, game->clearCanvasSize))
+					{
+						log_info("Clear canvas");	
 
-							queue_draw_position(game, touchPosition);
+						// Clearing swaps canvases, restore must finish on the one it started on
+						finish_canvas_restore(game);
 
-							game->strokeMoved 				= false;
-							game->lastStrokeSectionLength 	= 0;
-						}
+						game->brushGradientTextureIndex += 1;
+						game->brushGradientTextureIndex %= 2;
 
-						game->touchDownTime 	= time_now();
-					} break;
+						undo_history_truncate(&game->undoHistory, &game->strokeLog);
+						stroke_log_record_clear(&game->strokeLog, game->brushGradientTextureIndex, sample.eventTime);
+						clear_canvas_animated(game);
+						commit_undo_step(game);
+					}
+				}
+				else if (game->state == VIEW_DRAW)
+				{
+					// Replayed strokes would not match rows still to come
+					if (game->undoGesturePointerCount == 2 || game->undoGesturePointerCount == 3)
+					{
+						finish_canvas_restore(game);
+					}
 
-					case AMOTION_EVENT_ACTION_UP:
+					if (game->undoGesturePointerCount == 2)
+					{
+						undo(game);
+					}
+					else if (game->undoGesturePointerCount == 3)
 					{
-						// Note(Leo): set this regardless of view mode, we might have changed mode here
-						game->brushMode = BRUSH_DRAW;
-
-						if (game->state == VIEW_MENU)
-						{
-							v2 touchPosition = {AMotionEvent_getX(event, 0), AMotionEvent_getY(event, 0)};
-
-							auto test_button_rect = [touchPosition](v2 position, v2 size) -> bool32
-							{
-								v2 min = position;
-								v2 max = position + size;
-
-								bool32 inside = touchPosition.x > min.x
-												&& touchPosition.x < max.x
-												&& touchPosition.y > min.y
-												&& touchPosition.y < max.y;
-
-								return inside;
-							};
-
-							if (test_button_rect(game->clearCanvasPosition, game->clearCanvasSize))
-							{
-								log_info("Clear canvas");	
-
-								game->brushGradientTextureIndex += 1;
-								game->brushGradientTextureIndex %= 2;
-
-								if (game->brushGradientTextureIndex == 0)
-								{
-									game->brushGradientTexture = game->brushGradientTexture0;
-								}
-								else if (game->brushGradientTextureIndex == 1)
-								{
-									game->brushGradientTexture = game->brushGradientTexture1;
-								}
-								
-								clear_canvas(game);
-							}
-						}
-						else if(game->state == VIEW_DRAW)
-						{
-							if (game->strokeMoved == false)
-							{
-								float timeSinceTouchDownMS 	= time_elapsed_milliseconds(game->touchDownTime);
-								float interpolatonTime 		= float_clamp(timeSinceTouchDownMS / game->maxBrushSizeTimeMS, 0, 1);
-								float strokeWidth 			= float_lerp(game->minBrushSize, game->maxBrushSize, interpolatonTime);
-
-								draw_brush(game, game->drawPositionQueue[0], strokeWidth, 0);
-								game->drawPositionQueueCount = 0;
-							}
-						}
-					} break;
-
-					case AMOTION_EVENT_ACTION_MOVE:
+						redo(game);
+					}
+					else if (game->undoGesturePointerCount == 4)
 					{
-						if (game->state != VIEW_DRAW)
-							break;
+						memory_expect_heap_begin();
+						start_export(game);
+						memory_expect_heap_end();
+					}
+				}
+
+				game->undoGesturePointerCount = 0;
+			} break;
 
-						v2 touchPosition = {AMotionEvent_getX(event, 0), AMotionEvent_getY(event, 0)};
-						queue_draw_position(game, touchPosition);
+			case INPUT_SAMPLE_MOVE:
+			{
+				if (game->state != VIEW_DRAW || game->undoGesturePointerCount > 0)
+					break;
 
-						handled = true;
-					} break;
+				// Finger may have gone down before we entered draw view
+				if (game->strokeActive)
+				{
+					queue_draw_position(game, sample.position, sample.dynamics, sample.eventTime, sample.receiveTime);
+				}
+				else
+				{
+					begin_draw_stroke(game, sample.position, sample.dynamics, sample.stylus, sample.eventTime, sample.receiveTime);
 				}
 			} break;
 
-			case AINPUT_EVENT_TYPE_KEY:
-			{	
-				switch(AKeyEvent_getKeyCode(event))
+			case INPUT_SAMPLE_BACK:
+			{
+				if (game->state == VIEW_MENU)
 				{
-					case AKEYCODE_BACK:
-					{
-						// Todo(Leo): We get downs repeatedly when key is pressed, so we cannot use that as such. Instead manually
-						// track downs and ups, and only proceed on first down after up
-						if (AKeyEvent_getAction(event) != AKEY_EVENT_ACTION_UP)
-						{
-							break;
-						}
-
-						if (game->state == VIEW_MENU)
-						{
-							game->state = VIEW_TRANSITION_TO_DRAW;
-						}
-						else if (game->state == VIEW_DRAW)
-						{
-							game->state = VIEW_TRANSITION_TO_MENU;
-						}
-
-						handled = true;
-					} break;
+					game->state = VIEW_TRANSITION_TO_DRAW;
+				}
+				else if (game->state == VIEW_DRAW)
+				{
+					game->state = VIEW_TRANSITION_TO_MENU;
 				}
 			} break;
 		}
-
-		AInputQueue_finishEvent(game->inputQueue, event, handled);
 	}
 }
 
-internal void process_cmd(Game * game)
+internal void process_app_command(Game * game, AppCommand command)
 {
-	int8_t cmd = android_app_read_cmd(game);
+	int32 cmd = command.type;
 
 	//// PRE-PROCESS SOME COMMANDS
 	switch (cmd)
@@ -1368,15 +2964,17 @@ internal void process_cmd(Game * game)
 		case APP_CMD_INPUT_CHANGED:
 			GLUE_LOGV("APP_CMD_INPUT_CHANGED\n");
 			pthread_mutex_lock(&game->mutex);
+			pthread_mutex_lock(&game->inputMutex);
 			if (game->inputQueue != NULL) {
 				AInputQueue_detachLooper(game->inputQueue);
 			}
-			game->inputQueue = game->pendingInputQueue;
+			game->inputQueue = command.inputQueue;
 			if (game->inputQueue != NULL)
 			{
-				GLUE_LOGV("Attaching input queue to looper");
-				AInputQueue_attachLooper(game->inputQueue, game->looper, LOOPER_ID_INPUT, NULL, (void*)process_input);
+				GLUE_LOGV("Attaching input queue to input thread looper");
+				AInputQueue_attachLooper(game->inputQueue, game->inputLooper, LOOPER_ID_INPUT, NULL, NULL);
 			}
+			pthread_mutex_unlock(&game->inputMutex);
 			pthread_cond_broadcast(&game->cond);
 			pthread_mutex_unlock(&game->mutex);
 			break;
@@ -1384,7 +2982,7 @@ internal void process_cmd(Game * game)
 		case APP_CMD_INIT_WINDOW:
 			GLUE_LOGV("APP_CMD_INIT_WINDOW\n");
 			pthread_mutex_lock(&game->mutex);
-			game->window = game->pendingWindow;
+			game->window = command.window;
 			pthread_cond_broadcast(&game->cond);
 			pthread_mutex_unlock(&game->mutex);
 			break;
@@ -1394,6 +2992,10 @@ internal void process_cmd(Game * game)
 			pthread_cond_broadcast(&game->cond);
 			break;
 
+		case APP_CMD_SAVE_STATE:
+			free_saved_state(game);
+			break;
+
 		case APP_CMD_RESUME:
 		case APP_CMD_START:
 		case APP_CMD_PAUSE:
@@ -1452,47 +3054,68 @@ internal void process_cmd(Game * game)
 					game->initialized = true;
 					game->context = initialize_opengl(game->window);
 					initialize_shaders (game);
+					initialize_undo_checkpoints(game);
+					initialize_canvas_thumbnails(game);
+
+					if (game->strokeLog.count == 0)
+					{
+						game->strokeLog.width 	= game->context.width;
+						game->strokeLog.height 	= game->context.height;
+					}
+				}
+
+				// Document is there also on cold start, if android killed us in background
+				bool32 canvasRestored = begin_canvas_restore(game);
+				if (canvasRestored && game->canvasStoredToFile == false && game->strokeLog.count == 0)
+				{
+					game->canvasFromEarlierProcess = true;
 				}
 
-				if (game->canvasStoredToFile)
+				if (canvasRestored == false && game->canvasStoredToFile)
 				{
-					unsigned char pixel [4];
+					log_error("Canvas document does not match canvas, rebuilding canvas from stroke log");
+					rasterize_stroke_log(game, game->canvasFramebuffer, game->context.width, game->context.height);
+					game->canvasThumbnailDirty = true;
+				}
 
-					int pixelDataSize 		= game->context.width * game->context.height * 4;
-					int8_t * texturePixels 	= new int8_t[pixelDataSize];
+				// Canvas is what it was at undo cursor, so start checkpoints from there
+				if (game->undoHistory.checkpointCapacity > 0 && game->undoHistory.checkpointCount == 0)
+				{
+					int32 slot = undo_history_push_checkpoint(&game->undoHistory);
+					copy_undo_checkpoint(game, slot, false);
 
-					lseek(game->canvasFile, 0, SEEK_SET);
-					// Todo(Leo): Check result and do something
-					read(game->canvasFile, texturePixels, pixelDataSize);
+					if (game->canvasRestorePending)
+					{
+						game->canvasRestoreCheckpointSlot = slot;
+					}
+				}
 
-					glBindTexture(GL_TEXTURE_2D, game->canvasTextureId);
-					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, game->context.width, game->context.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texturePixels);
+				damage_history_reset(&game->damageHistory);
+				game->fullRedrawCount = 1;
 
-					delete [] texturePixels;
+				if (game->compositorBenchmark)
+				{
+					benchmark_cpu_compositor(game);
 				}
 			} break;
 
 			case APP_CMD_TERM_WINDOW:
 			{
-				int pixelDataSize = game->context.width * game->context.height * 4;
-
-				uint8 * texturePixels = new uint8[pixelDataSize];
-
-				glBindFramebuffer(GL_FRAMEBUFFER, game->canvasFramebuffer);
-				glReadPixels(0, 0, game->context.width, game->context.height, GL_RGBA, GL_UNSIGNED_BYTE, texturePixels);
+				flush_dabs(&game->dabs);
 
-				lseek(game->canvasFile, 0, SEEK_SET);
-				int written = write(game->canvasFile, texturePixels, pixelDataSize);
+				// Canvas has only part of document
+				finish_canvas_restore(game);
+				continue_export_readback(game, true);
 
-				delete[] texturePixels;
-
-				if (written == pixelDataSize)
+				// If this fails, canvas is rebuilt from stroke log when window comes back
+				if (save_canvas_document(game))
 				{
-					log_info("Canvas file saved fully.");
+					log_info("Canvas document saved fully.");
 				}
 				else
 				{
-					__android_log_print(ANDROID_LOG_INFO, "Game", "file not saved = %d, %d", written, errno);
+					log_error("Canvas document not saved");
+					canvas_document_delete(game->activity->internalDataPath);
 				}
 
 				game->canvasStoredToFile = true;
@@ -1504,6 +3127,18 @@ internal void process_cmd(Game * game)
 				// This is called when we go background
 			} break;
 
+			case APP_CMD_LOW_MEMORY:
+			{
+				handle_low_memory(game);
+			} break;
+
+			case APP_CMD_STOP:
+			{
+				profiler_write_chrome_trace(game->activity->internalDataPath);
+				latency_report(&game->latency);
+				memory_report("on stop");
+			} break;
+
 			case APP_CMD_DESTROY:
 			{
 				// This is called when app closes for good
@@ -1536,20 +3171,68 @@ internal void process_cmd(Game * game)
 	}
 }
 
+internal void process_cmd(Game * game)
+{
+	app_command_queue_acknowledge(&game->commands);
+
+	AppCommand command;
+	while (app_command_queue_pop(&game->commands, &command))
+	{
+		process_app_command(game, command);
+	}
+}
+
+internal EventPumpResult poll_game_events(void * data, int timeout)
+{
+	// Todo(Leo): Check if we would see message type here, and not use user pointer paradigm here
+	using ProcessFunc = void(Game*);
+	static_assert(std::is_same<decltype(process_cmd), ProcessFunc>::value, "");
+
+	ProcessFunc * processFunc = nullptr;
+	int pollResult = ALooper_pollAll(timeout, nullptr, nullptr, (void**)&processFunc);
+
+	if (pollResult >= 0 && processFunc != nullptr)
+	{
+		processFunc((Game*)data);
+	}
+
+	switch (pollResult)
+	{
+		case ALOOPER_POLL_TIMEOUT: 	return EVENT_PUMP_EMPTY;
+		case ALOOPER_POLL_ERROR: 	return EVENT_PUMP_ERROR;
+		default: 					return EVENT_PUMP_HANDLED;
+	}
+}
+
+internal int pacer_frame_timeout(void * data)
+{
+	return frame_pacer_poll_timeout(&((Game*)data)->framePacer);
+}
+
 internal void* game_thread_entry(void* param)
 {
 	Game * game = (Game*)param;
 
+	stbiArena = &game->frameArena;
+
 	game->config = AConfiguration_new();
 	AConfiguration_fromAssetManager(game->config, game->activity->assetManager);
 
 	print_cur_config(game);
 
 	ALooper* looper = ALooper_prepare(ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
-	ALooper_addFd(looper, game->msgread, LOOPER_ID_MAIN, ALOOPER_EVENT_INPUT, NULL, (void*)process_cmd);
+	ALooper_addFd(looper, game->commands.eventFd, LOOPER_ID_MAIN, ALOOPER_EVENT_INPUT, NULL, (void*)process_cmd);
 	game->looper = looper;
 
+	job_system_initialize(&game->jobs);
+
+	game->inputThreadRunning = true;
+	pthread_create(&game->inputThread, NULL, input_thread_entry, game);
+
 	pthread_mutex_lock(&game->mutex);
+	while (game->inputLooper == nullptr) {
+		pthread_cond_wait(&game->cond, &game->mutex);
+	}
 	game->running = true;
 	pthread_cond_broadcast(&game->cond);
 	pthread_mutex_unlock(&game->mutex);
@@ -1557,6 +3240,26 @@ internal void* game_thread_entry(void* param)
 	// MAIN LOOP
 	{
 		log_info("Start main");
+		profiler_measure_overhead();
+		latency_initialize(&game->latency);
+		frame_pacer_initialize(&game->framePacer);
+
+		{
+			char value [PROP_VALUE_MAX] = {};
+			__system_property_get("debug.idiotgame.frontbuffer", value);
+			game->lowLatencyDrawing = value[0] == '1';
+
+			__system_property_get("debug.idiotgame.compositor", value);
+			game->compositorBenchmark = value[0] == '1';
+
+			__system_property_get("debug.idiotgame.exportscale", value);
+			game->exportScale = value[0] >= '1' && value[0] <= '4' ? value[0] - '0' : 2;
+
+			__system_property_get("debug.idiotgame.timelapse", value);
+			game->timelapseSpeed = atoi(value);
+		}
+
+		EventPump eventPump = {poll_game_events, pacer_frame_timeout, game};
 
 		// Todo(Leo): We assume that thread will not stop like it should, when we are not drawing
 		timespec 	frameFlipTime = time_now();
@@ -1565,53 +3268,62 @@ internal void* game_thread_entry(void* param)
 		while(game->running)
 		{
 
+			arena_reset(&game->frameArena);
+
+			[[maybe_unused]] int64 heapAllocationCountBeforeFrame = heapUnexpectedAllocationCount;
+
 			/// PROCESS ANDROID INPUT AND COMMAND EVENTS
 			{
-				// Todo(Leo): Check if we would see message type here, and not use user pointer paradigm here
-				using ProcessFunc = void(Game*);
-				static_assert(std::is_same<decltype(process_input), ProcessFunc>::value, "");
-				static_assert(std::is_same<decltype(process_cmd), ProcessFunc>::value, "");
+				// Commands may allocate
+				memory_expect_heap_begin();
+				[[maybe_unused]] int32 pumpedEventCount = event_pump_run(&eventPump, &game->running);
+				memory_expect_heap_end();
+				PROFILER_SET(PROFILER_COUNTER_PUMPED_EVENTS, pumpedEventCount);
 
-				ProcessFunc * processFunc;
+				frame_pacer_begin_frame(&game->framePacer);
 
-				if (ALooper_pollAll(0, nullptr, nullptr, (void**)&processFunc) >= 0)
-				{
-					if (processFunc != nullptr)
-					{
-						processFunc(game);
-					}
-				}
+				// Input thread has kept reading while we waited
+				process_input(game);
 			}
 
-			auto process_draw_queue = [&]
+			if (game->canvasRestorePending && game->canvasPreviewShown)
 			{
-				update_stroke(	game,
-								game->lastDequedDrawPosition,
-								game->drawPositionQueue[0],
-								game->drawPositionQueue[1],
-								game->drawPositionQueue[2]);
+				continue_canvas_restore(game, game->canvasRestoreBytesPerFrame);
+			}
 
-				game->drawPositionQueueCount -= 1;
-				game->lastDequedDrawPosition = game->drawPositionQueue[0];
+			continue_export_readback(game, false);
 
-				for (int i = 0; i < game->drawPositionQueueCount; ++i)
+			// Released on low memory, and menu is opening now
+			if (game->initialized && game->state != VIEW_DRAW)
+			{
+				memory_expect_heap_begin();
+				if (game->creditsTexture == 0)
+				{
+					DecodedImage creditsImage = {"credits.png", game->activity->assetManager};
+					decode_image(&creditsImage);
+					load_credits_texture(game, &creditsImage);
+				}
+				if (game->canvasThumbnailTextureId == 0)
 				{
-					game->drawPositionQueue[i] = game->drawPositionQueue[i + 1];
+					initialize_canvas_thumbnails(game);
 				}
-			};
+				memory_expect_heap_end();
+			}
 
-			int drawPositionQueueDequeuCount = 3;
-			while(game->drawPositionQueueCount > drawPositionQueueDequeuCount)
+			if (game->latency.syntheticInput && game->state == VIEW_DRAW && game->window != nullptr)
 			{
-				process_draw_queue();
+				feed_synthetic_input(game);
 			}
 
-			if (game->drawPositionQueueRefreshed == false && game->drawPositionQueueCount > 0)
+			// Positions beyond lookahead are already dequeued when they are queued
+			if (game->stroke.drawPositionQueueRefreshed == false && game->stroke.drawPositionQueueCount > 0)
 			{
-				process_draw_queue();
+				flush_draw_position_queue(game);
 			}
 
-			game->drawPositionQueueRefreshed = false;
+			game->stroke.drawPositionQueueRefreshed = false;
+
+			flush_dabs_to_canvas_with_budget(game, frame_pacer_stroke_budget(&game->framePacer));
 
 			/// UPDATE TRANSITIONS
 			{
@@ -1636,27 +3348,103 @@ internal void* game_thread_entry(void* param)
 						game->state = VIEW_DRAW;
 					}
 				}
+
+				if (game->canvasClearProgress < 1)
+				{
+					game->canvasClearProgress += elapsedTime / game->canvasClearDuration;
+					if (game->canvasClearProgress > 1)
+					{
+						game->canvasClearProgress = 1;
+					}
+				}
+			}
+
+			// Thumbnail is only seen in menu, and canvas does not change much there
+			if (game->canvasThumbnailDirty && (game->state == VIEW_TRANSITION_TO_MENU || game->state == VIEW_MENU))
+			{
+				update_canvas_thumbnail(game);
+			}
+
+			update_low_latency_drawing(game);
+			rect frameDamage = draw_frame(game);
+
+			{
+				PROFILE_SCOPE("eglSwapBuffers");
+
+				int64 swapStartTime = time_now_nanoseconds();
+				present_frame(&game->context, frameDamage);
+				latency_frame_presented(&game->latency, swapStartTime, time_now_nanoseconds());
+			}
+
+			// Time to visible drawing on cold start
+			if (game->startupReported == false && game->initialized)
+			{
+				if (game->canvasRestorePending == false)
+				{
+					report_startup_time(game, "drawing visible");
+					game->startupReported = true;
+				}
+				else if (game->canvasPreviewShown == false)
+				{
+					report_startup_time(game, "preview visible");
+				}
 			}
+			game->canvasPreviewShown = game->canvasRestorePending;
 
-			draw_canvas(game);
-			eglSwapBuffers(game->context.display, game->context.surface);
+			// Driver may accept single buffer request, and still give us back buffer
+			if (game->context.singleBuffered && game->fullRedrawCount == 1)
+			{
+				EGLint renderBuffer;
+				eglQueryContext(game->context.display, game->context.eglContext, EGL_RENDER_BUFFER, &renderBuffer);
+				if (renderBuffer != EGL_SINGLE_BUFFER)
+				{
+					log_error("Single buffered rendering did not take effect, disabling it");
+					set_single_buffered(&game->context, false);
+					game->context.supportsSingleBuffer 	= false;
+					game->lowLatencyDrawing 			= false;
+					game->fullRedrawCount 				= 2;
+				}
+			}
 
 			// Todo(Leo): there is small distortion here, since time_elapsed_seconds gets its
 			// own 'time_now()' slighlty before new frameFlipTime's 'time_now()'
 			elapsedTime 	= time_elapsed_seconds(frameFlipTime);
 			frameFlipTime 	= time_now();
+
+			frame_pacer_end_frame(&game->framePacer, (int64)(elapsedTime * 1'000'000'000));
+
+			PROFILER_SET(PROFILER_COUNTER_FRAME_TIME_US, elapsedTime * 1'000'000);
+			PROFILER_SET(PROFILER_COUNTER_DRAW_QUEUE_DEPTH, game->stroke.drawPositionQueueCount);
+			PROFILER_SET(PROFILER_COUNTER_HEAP_ALLOCATIONS, heapAllocationCount);
+			PROFILER_SET(PROFILER_COUNTER_FRAME_ARENA_BYTES, game->frameArena.highWaterMark);
+
+			assert(heapUnexpectedAllocationCount == heapAllocationCountBeforeFrame && "Frame allocated from heap");
+			profiler_end_frame();
 		}
 
 		log_info("Finish main");
 	}
 
+	job_wait(&game->jobs, &game->exportCounter);
+	job_system_destroy(&game->jobs);
+
 	// Todo(Leo): Think through if this is right place to destroy this app, because we don't actually create game in this scope
 	GLUE_LOGV("android_app_destroy!");
 	free_saved_state(game);
+
+	game->inputThreadRunning = false;
+	ALooper_wake(game->inputLooper);
+	pthread_join(game->inputThread, NULL);
+
+	canvas_document_close(&game->canvasRestoreDocument);
+
+	stbiArena = nullptr;
+
 	pthread_mutex_lock(&game->mutex);
 	if (game->inputQueue != NULL) {
 		AInputQueue_detachLooper(game->inputQueue);
 	}
+	ALooper_release(game->inputLooper);
 	AConfiguration_delete(game->config);
 	game->destroyed = 1;
 	pthread_cond_broadcast(&game->cond);
@@ -1665,26 +3453,52 @@ internal void* game_thread_entry(void* param)
 
 	log_info("Exit game thread!");
 
-	close(game->canvasFile);
-
 	return NULL;
 }
 
 
 internal void android_app_set_window(Game * game, ANativeWindow* window)
 {
+	/*
+	Window must not be used after callback returns, so wait until game thread has switched. Push
+	does not hold mutex, since it may wait for game thread, which takes mutex handling commands.
+	*/
 	pthread_mutex_lock(&game->mutex);
-	if (game->pendingWindow != NULL)
+	bool32 hasWindow = game->window != NULL;
+	pthread_mutex_unlock(&game->mutex);
+
+	if (hasWindow)
 	{
 		android_app_write_cmd(game, APP_CMD_TERM_WINDOW);
 	}
 	
-	game->pendingWindow = window;
 	if (window != NULL)
 	{
-		android_app_write_cmd(game, APP_CMD_INIT_WINDOW);
+		AppCommand command 	= {};
+		command.type 		= APP_CMD_INIT_WINDOW;
+		command.window 		= window;
+		app_command_queue_push(&game->commands, command);
+	}
+
+	pthread_mutex_lock(&game->mutex);
+	while (game->window != window) {
+		pthread_cond_wait(&game->cond, &game->mutex);
 	}
-	while (game->window != game->pendingWindow) {
+	pthread_mutex_unlock(&game->mutex);
+}
+
+internal void android_app_set_input_queue(Game * game, AInputQueue * queue)
+{
+	AppCommand command 	= {};
+	command.type 		= APP_CMD_INPUT_CHANGED;
+	command.inputQueue 	= queue;
+
+	// Push before taking mutex, see android_app_set_window
+	app_command_queue_push(&game->commands, command);
+
+	pthread_mutex_lock(&game->mutex);
+	while (game->inputQueue != queue)
+	{
 		pthread_cond_wait(&game->cond, &game->mutex);
 	}
 	pthread_mutex_unlock(&game->mutex);
@@ -1700,17 +3514,22 @@ internal void android_callback_onDestroy(ANativeActivity* activity)
 
 	Game * game = (Game*)activity->instance;
 
-	pthread_mutex_lock(&game->mutex);
 	android_app_write_cmd(game, APP_CMD_DESTROY);
+
+	pthread_mutex_lock(&game->mutex);
 	while (!game->destroyed) {
 		pthread_cond_wait(&game->cond, &game->mutex);
 	}
 	pthread_mutex_unlock(&game->mutex);
 
-	close(game->msgread);
-	close(game->msgwrite);
+	app_command_queue_destroy(&game->commands);
 	pthread_cond_destroy(&game->cond);
 	pthread_mutex_destroy(&game->mutex);
+	pthread_mutex_destroy(&game->inputMutex);
+
+	delete [] game->strokeLog.entries;
+
+	memory_heap_free(game->frameArena.memory, game->frameArena.capacity, MEMORY_CATEGORY_FRAME_ARENA);
 
 	delete game;
 }
@@ -1733,7 +3552,11 @@ internal void * android_callback_onSaveInstanceState(ANativeActivity* activity,
 	GLUE_LOGV("SaveInstanceState: %p\n", activity);
 	pthread_mutex_lock(&game->mutex);
 	game->stateSaved = 0;
+	pthread_mutex_unlock(&game->mutex);
+
 	android_app_write_cmd(game, APP_CMD_SAVE_STATE);
+
+	pthread_mutex_lock(&game->mutex);
 	while (!game->stateSaved) {
 		pthread_cond_wait(&game->cond, &game->mutex);
 	}
@@ -1801,29 +3624,14 @@ internal void android_callback_onInputQueueCreated(ANativeActivity* activity, AI
 	// Note(Leo): This seems that we block here until we have processed message elsewhere
 	// Same on below
 
-	pthread_mutex_lock(&game->mutex);
-	game->pendingInputQueue = queue;
-	android_app_write_cmd(game, APP_CMD_INPUT_CHANGED);
-	while (game->inputQueue != game->pendingInputQueue)
-	{
-		pthread_cond_wait(&game->cond, &game->mutex);
-	}
-	pthread_mutex_unlock(&game->mutex);
-
+	android_app_set_input_queue(game, queue);
 }
 
 internal void android_callback_onInputQueueDestroyed(ANativeActivity* activity, AInputQueue*)
 {
 	Game * game = (Game*)activity->instance;
 
-	pthread_mutex_lock(&game->mutex);
-	game->pendingInputQueue = nullptr;
-	android_app_write_cmd(game, APP_CMD_INPUT_CHANGED);
-	while (game->inputQueue != game->pendingInputQueue)
-	{
-		pthread_cond_wait(&game->cond, &game->mutex);
-	}
-	pthread_mutex_unlock(&game->mutex);
+	android_app_set_input_queue(game, nullptr);
 }
 
 
@@ -1858,6 +3666,14 @@ void ANativeActivity_onCreate(	ANativeActivity* activity,
 
 		pthread_mutex_init(&game->mutex, NULL);
 		pthread_cond_init(&game->cond, NULL);
+		pthread_mutex_init(&game->inputMutex, NULL);
+
+		// Reserve these once, so drawing does not allocate
+		arena_initialize(&game->frameArena, game->frameArenaCapacity);
+		stroke_log_initialize(&game->strokeLog, new StrokeLogEntry[game->strokeLogCapacity], game->strokeLogCapacity);
+		memory_track(MEMORY_CATEGORY_STROKE_LOG, (int64)game->strokeLogCapacity * sizeof(StrokeLogEntry));
+		game->dabs = {game->dabMemory, 0, game->dabCapacity, flush_dabs_to_canvas, game};
+		game->wetDabs = {game->wetDabMemory, 0, game->wetDabCapacity, flush_dabs_to_screen, game};
 
 		if (savedState != NULL) {
 			game->savedState = malloc(savedStateSize);
@@ -1865,35 +3681,17 @@ void ANativeActivity_onCreate(	ANativeActivity* activity,
 			memcpy(game->savedState, savedState, savedStateSize);
 		}
 
-		{
-			void * pixels;
-			int pixelsSize = 720 * 1280 * 4;
-
-			int file = open(activity->internalDataPath, O_RDWR | O_TMPFILE);
-
-			if (file == -1)
-			{
-				__android_log_print(ANDROID_LOG_INFO, "Game", "NOT opened canvas file, error = %d", errno);
-			}
-			else
-			{
-				game->canvasFile = file;
-				__android_log_print(ANDROID_LOG_INFO, "Game", "opened canvas file = %d", file);
-			}
-		}
+		game->startTime 				= time_now_nanoseconds();
+		game->canvasRestoreDocument.file = -1;
 
-		int msgpipe[2];
-		if (pipe(msgpipe)) {
-			__android_log_print(ANDROID_LOG_ERROR, "Game", "could not create pipe: %s", strerror(errno));
+		if (app_command_queue_initialize(&game->commands) == false) {
+			__android_log_print(ANDROID_LOG_ERROR, "Game", "could not create command eventfd: %s", strerror(errno));
 			activity->instance = nullptr;
 
 			// Todo(Leo): also do something else???
 		}
 		else
 		{
-			game->msgread = msgpipe[0];
-			game->msgwrite = msgpipe[1];
-
 			pthread_attr_t attr; 
 			pthread_attr_init(&attr);
 			pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
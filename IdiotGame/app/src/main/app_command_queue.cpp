@@ -0,0 +1,123 @@
+/// ----------------------------------------------------------------------------
+/// APP COMMAND QUEUE
+
+/*
+Android callbacks send commands with their payloads to game thread through this. Any thread
+may push, only game thread pops. Slot sequence numbers tell whether slot is free for a
+producer or ready for consumer, so neither side locks. Eventfd wakes game thread's looper.
+*/
+
+#include <sys/eventfd.h>
+#include <atomic>
+
+struct AppCommand
+{
+	int32 type;
+	union
+	{
+		ANativeWindow * window;
+		AInputQueue * 	inputQueue;
+	};
+};
+
+struct AppCommandQueue
+{
+	// Power of two, so indices can wrap freely
+	static constexpr uint32 capacity = 64;
+
+	struct Slot
+	{
+		std::atomic<uint32> sequence;
+		AppCommand 			command;
+	};
+
+	Slot slots [capacity];
+
+	alignas(64) std::atomic<uint32> writeIndex;
+	alignas(64) uint32 				readIndex;
+
+	int eventFd;
+};
+
+internal bool32 app_command_queue_initialize(AppCommandQueue * queue)
+{
+	for (uint32 i = 0; i < queue->capacity; ++i)
+	{
+		queue->slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	queue->writeIndex.store(0, std::memory_order_relaxed);
+	queue->readIndex = 0;
+
+	queue->eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	return queue->eventFd != -1;
+}
+
+internal void app_command_queue_destroy(AppCommandQueue * queue)
+{
+	close(queue->eventFd);
+	queue->eventFd = -1;
+}
+
+// Commands must not be lost, so if ring is full this yields until there is room
+internal void app_command_queue_push(AppCommandQueue * queue, AppCommand command)
+{
+	uint32 writeIndex = queue->writeIndex.load(std::memory_order_relaxed);
+	AppCommandQueue::Slot * slot;
+
+	while(true)
+	{
+		slot = &queue->slots[writeIndex % queue->capacity];
+
+		uint32 sequence = slot->sequence.load(std::memory_order_acquire);
+		int32 difference = (int32)(sequence - writeIndex);
+
+		if (difference == 0)
+		{
+			if (queue->writeIndex.compare_exchange_weak(writeIndex, writeIndex + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (difference < 0)
+		{
+			sched_yield();
+			writeIndex = queue->writeIndex.load(std::memory_order_relaxed);
+		}
+		else
+		{
+			writeIndex = queue->writeIndex.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->command = command;
+	slot->sequence.store(writeIndex + 1, std::memory_order_release);
+
+	uint64_t one = 1;
+	if (write(queue->eventFd, &one, sizeof(one)) != sizeof(one))
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Failure signaling app command: %s\n", strerror(errno));
+	}
+}
+
+internal bool32 app_command_queue_pop(AppCommandQueue * queue, AppCommand * outCommand)
+{
+	AppCommandQueue::Slot * slot = &queue->slots[queue->readIndex % queue->capacity];
+
+	uint32 sequence = slot->sequence.load(std::memory_order_acquire);
+	if ((int32)(sequence - (queue->readIndex + 1)) < 0)
+	{
+		return false;
+	}
+
+	*outCommand = slot->command;
+	slot->sequence.store(queue->readIndex + queue->capacity, std::memory_order_release);
+	queue->readIndex += 1;
+	return true;
+}
+
+// Call before popping, so that a command pushed meanwhile signals eventfd again and is not missed
+internal void app_command_queue_acknowledge(AppCommandQueue * queue)
+{
+	uint64_t count;
+	read(queue->eventFd, &count, sizeof(count));
+}
@@ -0,0 +1,256 @@
+/// ----------------------------------------------------------------------------
+/// CANVAS DOCUMENT
+
+/*
+Drawing kept in internalDataPath, so it survives when android kills us in background. Header,
+quarter size preview and full canvas, rows bottom up like glReadPixels gives them. Preview is
+first so cold start can show it on first frame. Written to a temporary file, synced and renamed
+over old one, so after a crash there is always a whole document.
+*/
+
+constexpr uint32 canvasDocumentMagic 	= 'I' | 'D' << 8 | 'C' << 16 | 'V' << 24;
+constexpr uint32 canvasDocumentVersion 	= 1;
+
+constexpr char const * canvasDocumentFileName 			= "canvas.idiot";
+constexpr char const * canvasDocumentTemporaryFileName 	= "canvas.idiot.tmp";
+
+struct CanvasDocumentHeader
+{
+	uint32 magic;
+	uint32 version;
+
+	int32 width;
+	int32 height;
+	int32 previewWidth;
+	int32 previewHeight;
+
+	uint32 previewOffset;
+	uint32 pixelsOffset;
+};
+
+struct CanvasDocument
+{
+	int 	file;
+	uint8 * mapping;
+	size_t 	size;
+
+	CanvasDocumentHeader * header;
+	uint8 * 			preview;
+	uint8 * 			pixels;
+};
+
+internal void canvas_document_path(char * buffer, size_t bufferSize, char const * directory, char const * fileName)
+{
+	snprintf(buffer, bufferSize, "%s/%s", directory, fileName);
+}
+
+internal void canvas_document_close(CanvasDocument * document)
+{
+	if (document->mapping != nullptr)
+	{
+		munmap(document->mapping, document->size);
+	}
+	if (document->file >= 0)
+	{
+		close(document->file);
+	}
+
+	*document 		= {};
+	document->file 	= -1;
+}
+
+// Returns false if there is no document, or it is not valid
+internal bool32 canvas_document_open(CanvasDocument * document, char const * directory)
+{
+	*document 		= {};
+	document->file 	= -1;
+
+	char path [256];
+	canvas_document_path(path, sizeof(path), directory, canvasDocumentFileName);
+
+	document->file = open(path, O_RDONLY | O_CLOEXEC);
+	if (document->file < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(document->file, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(CanvasDocumentHeader))
+	{
+		canvas_document_close(document);
+		return false;
+	}
+
+	void * mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, document->file, 0);
+	if (mapping == MAP_FAILED)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not map canvas document, error = %d", errno);
+		canvas_document_close(document);
+		return false;
+	}
+
+	document->mapping 	= (uint8*)mapping;
+	document->size 		= fileStat.st_size;
+	document->header 	= (CanvasDocumentHeader*)mapping;
+
+	CanvasDocumentHeader const & header = *document->header;
+
+	size_t previewSize 	= (size_t)header.previewWidth * header.previewHeight * 4;
+	size_t pixelsSize 	= (size_t)header.width * header.height * 4;
+
+	bool32 valid = header.magic == canvasDocumentMagic
+				&& header.version == canvasDocumentVersion
+				&& header.width > 0 && header.height > 0
+				&& header.previewWidth > 0 && header.previewHeight > 0
+				&& header.previewOffset >= sizeof(CanvasDocumentHeader)
+				&& header.previewOffset + previewSize <= header.pixelsOffset
+				&& header.pixelsOffset + pixelsSize <= document->size;
+
+	if (valid == false)
+	{
+		log_error("Canvas document is not valid, ignoring it");
+		canvas_document_close(document);
+		return false;
+	}
+
+	document->preview 	= document->mapping + header.previewOffset;
+	document->pixels 	= document->mapping + header.pixelsOffset;
+
+	madvise(document->mapping, document->size, MADV_SEQUENTIAL);
+	return true;
+}
+
+// Mapping is private and read only, so dropped pages are read again from file if touched
+internal bool32 canvas_document_drop_pages(CanvasDocument * document, size_t end)
+{
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t length 	= (end < document->size ? end : document->size) & ~(pageSize - 1);
+
+	if (document->mapping == nullptr || length == 0)
+	{
+		return true;
+	}
+
+	if (madvise(document->mapping, length, MADV_DONTNEED) != 0)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not drop canvas document pages, error = %d", errno);
+		return false;
+	}
+	return true;
+}
+
+internal bool32 canvas_document_begin_write(CanvasDocument * document, char const * directory,
+											int32 width, int32 height, int32 previewWidth, int32 previewHeight)
+{
+	*document 		= {};
+	document->file 	= -1;
+
+	uint32 previewOffset 	= sizeof(CanvasDocumentHeader);
+	uint32 pixelsOffset 	= previewOffset + previewWidth * previewHeight * 4;
+	size_t size 			= pixelsOffset + (size_t)width * height * 4;
+
+	char path [256];
+	canvas_document_path(path, sizeof(path), directory, canvasDocumentTemporaryFileName);
+
+	document->file = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (document->file < 0)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not create canvas document, error = %d", errno);
+		return false;
+	}
+
+	if (ftruncate(document->file, size) != 0)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not resize canvas document, error = %d", errno);
+		canvas_document_close(document);
+		unlink(path);
+		return false;
+	}
+
+	void * mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, document->file, 0);
+	if (mapping == MAP_FAILED)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not map canvas document, error = %d", errno);
+		canvas_document_close(document);
+		unlink(path);
+		return false;
+	}
+
+	document->mapping 	= (uint8*)mapping;
+	document->size 		= size;
+	document->header 	= (CanvasDocumentHeader*)mapping;
+	document->preview 	= document->mapping + previewOffset;
+	document->pixels 	= document->mapping + pixelsOffset;
+
+	madvise(document->mapping, document->size, MADV_SEQUENTIAL);
+
+	// Magic stays zero until commit, so an unfinished document is not valid
+	CanvasDocumentHeader & header = *document->header;
+	header 					= {};
+	header.version 			= canvasDocumentVersion;
+	header.width 			= width;
+	header.height 			= height;
+	header.previewWidth 	= previewWidth;
+	header.previewHeight 	= previewHeight;
+	header.previewOffset 	= previewOffset;
+	header.pixelsOffset 	= pixelsOffset;
+
+	return true;
+}
+
+internal void canvas_document_abort(CanvasDocument * document, char const * directory)
+{
+	canvas_document_close(document);
+
+	char path [256];
+	canvas_document_path(path, sizeof(path), directory, canvasDocumentTemporaryFileName);
+	unlink(path);
+}
+
+// After a failed save, so that an older document is not restored in place of current canvas
+internal void canvas_document_delete(char const * directory)
+{
+	char path [256];
+	canvas_document_path(path, sizeof(path), directory, canvasDocumentFileName);
+	if (unlink(path) != 0 && errno != ENOENT)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not delete canvas document, error = %d", errno);
+	}
+}
+
+internal bool32 canvas_document_commit(CanvasDocument * document, char const * directory)
+{
+	document->header->magic = canvasDocumentMagic;
+
+	bool32 synced = msync(document->mapping, document->size, MS_SYNC) == 0 && fsync(document->file) == 0;
+	if (synced == false)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not sync canvas document, error = %d", errno);
+		canvas_document_abort(document, directory);
+		return false;
+	}
+
+	canvas_document_close(document);
+
+	char temporaryPath [256];
+	char path [256];
+	canvas_document_path(temporaryPath, sizeof(temporaryPath), directory, canvasDocumentTemporaryFileName);
+	canvas_document_path(path, sizeof(path), directory, canvasDocumentFileName);
+
+	if (rename(temporaryPath, path) != 0)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not commit canvas document, error = %d", errno);
+		unlink(temporaryPath);
+		return false;
+	}
+
+	// Rename is durable only after directory is synced
+	int directoryFile = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (directoryFile >= 0)
+	{
+		fsync(directoryFile);
+		close(directoryFile);
+	}
+
+	return true;
+}
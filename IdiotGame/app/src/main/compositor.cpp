@@ -0,0 +1,474 @@
+/// ----------------------------------------------------------------------------
+/// CPU COMPOSITOR
+
+/*
+Draws dabs on cpu at other sizes than canvas, for export. Does what brush shader and GL
+blending do, rounding to 8 bits after every dab, so result matches canvas closely. Dabs are
+binned to tiles in their original order and tiles are drawn in parallel. Unlike GL, rows
+here go from top to bottom.
+*/
+
+typedef float float4 __attribute__((vector_size(16)));
+typedef uint8 uint8x4 __attribute__((vector_size(4)));
+
+// Cpu copies of brush mask and gradient textures
+struct CompositorBrush
+{
+	static constexpr int maskSize 			= 128;
+	static constexpr int maskLevelCount 	= 8;
+	static constexpr int maskTexelCount 	= 21845;	// 128^2 + 64^2 + ... + 1^2
+	static constexpr int gradientPixelCount = 128;
+
+	bool32 	valid;
+	int32 	maskLevelOffsets [maskLevelCount];
+	float 	maskTexels [maskTexelCount];
+	float4 	gradients [2][gradientPixelCount];
+};
+
+// Smaller levels are averaged like glGenerateMipmap does
+internal void compositor_brush_initialize(	CompositorBrush * brush, uint8 const * maskPixels, int32 maskWidth, int32 maskHeight,
+											uint8 const * gradientPixels0, uint8 const * gradientPixels1)
+{
+	brush->valid = maskPixels != nullptr && maskWidth == brush->maskSize && maskHeight == brush->maskSize;
+
+	if (brush->valid == false)
+	{
+		log_error("Brush mask is not 128 x 128, cpu compositor is not available");
+		return;
+	}
+
+	for (int32 i = 0; i < brush->maskSize * brush->maskSize; ++i)
+	{
+		brush->maskTexels[i] = maskPixels[i * 4] / 255.0f;
+	}
+	brush->maskLevelOffsets[0] = 0;
+
+	for (int32 level = 1; level < brush->maskLevelCount; ++level)
+	{
+		int32 size 			= brush->maskSize >> level;
+		int32 previousSize 	= size * 2;
+
+		float const * previous 	= brush->maskTexels + brush->maskLevelOffsets[level - 1];
+		int32 offset 			= brush->maskLevelOffsets[level - 1] + previousSize * previousSize;
+		float * texels 			= brush->maskTexels + offset;
+
+		for (int32 y = 0; y < size; ++y)
+		{
+			for (int32 x = 0; x < size; ++x)
+			{
+				float const * block = previous + (y * 2) * previousSize + x * 2;
+				texels[y * size + x] = (block[0] + block[1] + block[previousSize] + block[previousSize + 1]) * 0.25f;
+			}
+		}
+
+		brush->maskLevelOffsets[level] = offset;
+	}
+
+	uint8 const * gradientPixels [] = {gradientPixels0, gradientPixels1};
+	for (int32 gradient = 0; gradient < 2; ++gradient)
+	{
+		for (int32 i = 0; i < brush->gradientPixelCount; ++i)
+		{
+			uint8 const * pixel = gradientPixels[gradient] + i * 4;
+			brush->gradients[gradient][i] = float4{(float)pixel[0], (float)pixel[1], (float)pixel[2], (float)pixel[3]} / 255.0f;
+		}
+	}
+}
+
+/*
+GL_LINEAR with GL_CLAMP_TO_EDGE, split so that what depends only on v is done once per row.
+Coordinates are never below -1 here, so truncating after adding one is floor.
+*/
+struct CompositorMaskRow
+{
+	float const * 	row0;
+	float const * 	row1;
+	float 			fy;
+	int32 			size;
+};
+
+internal CompositorMaskRow compositor_mask_row(CompositorBrush const * brush, int32 level, float v)
+{
+	int32 size 				= brush->maskSize >> level;
+	float const * texels 	= brush->maskTexels + brush->maskLevelOffsets[level];
+
+	float y 	= v * size - 0.5f;
+	int32 y0 	= (int32)(y + 1.0f) - 1;
+	float fy 	= y - y0;
+	int32 y1 	= y0 + 1;
+
+	y0 = y0 < 0 ? 0 : (y0 >= size ? size - 1 : y0);
+	y1 = y1 < 0 ? 0 : (y1 >= size ? size - 1 : y1);
+
+	return {texels + y0 * size, texels + y1 * size, fy, size};
+}
+
+internal float compositor_sample_mask_row(CompositorMaskRow const & row, float u)
+{
+	float x 	= u * row.size - 0.5f;
+	int32 x0 	= (int32)(x + 1.0f) - 1;
+	float fx 	= x - x0;
+	int32 x1 	= x0 + 1;
+
+	x0 = x0 < 0 ? 0 : (x0 >= row.size ? row.size - 1 : x0);
+	x1 = x1 < 0 ? 0 : (x1 >= row.size ? row.size - 1 : x1);
+
+	float top 		= row.row0[x0] + (row.row0[x1] - row.row0[x0]) * fx;
+	float bottom 	= row.row1[x0] + (row.row1[x1] - row.row1[x0]) * fx;
+	return top + (bottom - top) * row.fy;
+}
+
+internal float4 compositor_sample_gradient(CompositorBrush const * brush, int32 gradientIndex, float position)
+{
+	float4 const * pixels = brush->gradients[gradientIndex == 0 ? 0 : 1];
+
+	float x 	= position * brush->gradientPixelCount - 0.5f;
+	float x0f 	= floorf(x);
+	float fx 	= x - x0f;
+
+	int32 last 	= brush->gradientPixelCount - 1;
+	int32 x0 	= (int32)x0f;
+	int32 x1 	= x0 + 1;
+	x0 = x0 < 0 ? 0 : (x0 > last ? last : x0);
+	x1 = x1 < 0 ? 0 : (x1 > last ? last : x1);
+
+	return pixels[x0] + (pixels[x1] - pixels[x0]) * fx;
+}
+
+struct Compositor
+{
+	JobSystem * 			jobs;
+	CompositorBrush const * brush;
+	int32 					jobCount;
+
+	uint8 * pixels;
+	int32 	width;
+	int32 	height;
+
+	// From stroke log's coordinate space to pixels, like in draw_dabs
+	float 	scaleX;
+	float 	scaleY;
+	float 	sizeScale;
+
+	static constexpr int tileSize = 64;
+	int32 	tileCountX;
+	int32 	tileCountY;
+
+	// Bins for current batch
+	static constexpr int tileDabIndexCapacity = 1024 * 1024;
+	int32 * tileDabCounts;
+	int32 * tileDabStarts;
+	int32 * tileDabIndices;
+	int32 * activeTiles;
+	int32 	activeTileCount;
+
+	Dab const * 		batchDabs;
+	std::atomic<int32> 	nextActiveTile;
+
+	static constexpr int dabCapacity = 4096;
+	Dab 		dabMemory [dabCapacity];
+	DabBuffer 	dabs;
+
+	int64 		dabCount;
+};
+
+internal size_t compositor_bin_memory_size(int32 tileCount)
+{
+	return (size_t)(tileCount * 3 + Compositor::tileDabIndexCapacity) * sizeof(int32);
+}
+
+internal void compositor_flush(void * data, DabBuffer * buffer);
+
+// 'jobCount' includes caller. Push dabs to 'compositor->dabs' and call compositor_finish when done.
+internal bool32 compositor_initialize(	Compositor * compositor, JobSystem * jobs, CompositorBrush const * brush, int32 jobCount,
+										uint8 * pixels, int32 width, int32 height, int32 logWidth, int32 logHeight)
+{
+	if (brush->valid == false)
+	{
+		return false;
+	}
+
+	compositor->jobs 		= jobs;
+	compositor->brush 		= brush;
+	compositor->jobCount 	= jobCount > 0 ? jobCount : 1;
+
+	compositor->pixels 		= pixels;
+	compositor->width 		= width;
+	compositor->height 		= height;
+	compositor->scaleX 		= (float)width / logWidth;
+	compositor->scaleY 		= (float)height / logHeight;
+	compositor->sizeScale 	= compositor->scaleX < compositor->scaleY ? compositor->scaleX : compositor->scaleY;
+
+	compositor->tileCountX 	= (width + compositor->tileSize - 1) / compositor->tileSize;
+	compositor->tileCountY 	= (height + compositor->tileSize - 1) / compositor->tileSize;
+	int32 tileCount 		= compositor->tileCountX * compositor->tileCountY;
+
+	int32 * binMemory = (int32*)memory_heap_allocate(compositor_bin_memory_size(tileCount), MEMORY_CATEGORY_COMPOSITOR);
+	if (binMemory == nullptr)
+	{
+		log_error("Could not allocate compositor bins");
+		return false;
+	}
+
+	compositor->tileDabCounts 	= binMemory;
+	compositor->tileDabStarts 	= binMemory + tileCount;
+	compositor->activeTiles 	= binMemory + tileCount * 2;
+	compositor->tileDabIndices 	= binMemory + tileCount * 3;
+
+	compositor->dabs 		= {compositor->dabMemory, 0, compositor->dabCapacity, compositor_flush, compositor};
+	compositor->dabCount 	= 0;
+
+	return true;
+}
+
+internal void compositor_clear(Compositor * compositor)
+{
+	memset(compositor->pixels, 0xff, (size_t)compositor->width * compositor->height * 4);
+}
+
+struct CompositorDabBounds
+{
+	int32 x0, y0, x1, y1;
+};
+
+// Pixels whose centers are inside dab's quad, end exclusive and not clipped
+internal CompositorDabBounds compositor_dab_bounds(Compositor const * compositor, Dab const & dab)
+{
+	float size 		= dab.size * compositor->sizeScale;
+	float centerX 	= dab.position.x * compositor->scaleX;
+	float centerY 	= dab.position.y * compositor->scaleY;
+
+	CompositorDabBounds bounds;
+	bounds.x0 = (int32)ceilf(centerX - size / 2 - 0.5f);
+	bounds.y0 = (int32)ceilf(centerY - size / 2 - 0.5f);
+	bounds.x1 = (int32)ceilf(centerX + size / 2 - 0.5f);
+	bounds.y1 = (int32)ceilf(centerY + size / 2 - 0.5f);
+	return bounds;
+}
+
+internal CompositorDabBounds compositor_dab_tiles(Compositor const * compositor, Dab const & dab)
+{
+	CompositorDabBounds bounds = compositor_dab_bounds(compositor, dab);
+
+	bounds.x0 = bounds.x0 < 0 ? 0 : bounds.x0;
+	bounds.y0 = bounds.y0 < 0 ? 0 : bounds.y0;
+	bounds.x1 = bounds.x1 > compositor->width ? compositor->width : bounds.x1;
+	bounds.y1 = bounds.y1 > compositor->height ? compositor->height : bounds.y1;
+
+	if (bounds.x0 >= bounds.x1 || bounds.y0 >= bounds.y1)
+	{
+		return {};
+	}
+
+	int32 tileSize = compositor->tileSize;
+	return {bounds.x0 / tileSize, bounds.y0 / tileSize, (bounds.x1 - 1) / tileSize + 1, (bounds.y1 - 1) / tileSize + 1};
+}
+
+internal void compositor_draw_dab(Compositor * compositor, Dab const & dab, CompositorDabBounds clip)
+{
+	CompositorBrush const * brush = compositor->brush;
+
+	float size = dab.size * compositor->sizeScale;
+	if (size <= 0)
+	{
+		return;
+	}
+
+	CompositorDabBounds bounds = compositor_dab_bounds(compositor, dab);
+	int32 x0 = bounds.x0 > clip.x0 ? bounds.x0 : clip.x0;
+	int32 y0 = bounds.y0 > clip.y0 ? bounds.y0 : clip.y0;
+	int32 x1 = bounds.x1 < clip.x1 ? bounds.x1 : clip.x1;
+	int32 y1 = bounds.y1 < clip.y1 ? bounds.y1 : clip.y1;
+
+	float centerX 		= dab.position.x * compositor->scaleX;
+	float centerY 		= dab.position.y * compositor->scaleY;
+	float inverseSize 	= 1.0f / size;
+
+	float4 color = dab.mode == BRUSH_ERASE
+				? float4{1, 1, 1, 1}
+				: compositor_sample_gradient(brush, dab.gradientIndex, dab.gradientPosition);
+
+	// Quad has same scale everywhere, so mip levels are same for whole dab
+	float lod 			= log2f(brush->maskSize * inverseSize);
+	int32 lastLevel 	= brush->maskLevelCount - 1;
+	int32 level0 		= lod <= 0 ? 0 : (int32)lod;
+	level0 				= level0 > lastLevel ? lastLevel : level0;
+	int32 level1 		= level0 < lastLevel ? level0 + 1 : lastLevel;
+	float levelWeight 	= lod <= 0 ? 0 : lod - (int32)lod;
+	levelWeight 		= level0 == level1 ? 0 : levelWeight;
+
+	for (int32 y = y0; y < y1; ++y)
+	{
+		// Texture v grows upwards in GL
+		float v 		= (centerY - (y + 0.5f)) * inverseSize + 0.5f;
+		uint8x4 * row 	= (uint8x4*)(compositor->pixels + ((size_t)y * compositor->width) * 4);
+
+		CompositorMaskRow maskRow0 = compositor_mask_row(brush, level0, v);
+		CompositorMaskRow maskRow1 = compositor_mask_row(brush, level1, v);
+
+		for (int32 x = x0; x < x1; ++x)
+		{
+			float u = ((x + 0.5f) - centerX) * inverseSize + 0.5f;
+
+			float coverage = compositor_sample_mask_row(maskRow0, u);
+			if (levelWeight > 0)
+			{
+				coverage += (compositor_sample_mask_row(maskRow1, u) - coverage) * levelWeight;
+			}
+			coverage *= dab.opacity;
+
+			if (coverage <= 0)
+			{
+				continue;
+			}
+
+			// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) for all four channels
+			float4 source 		= color;
+			source[3] 			= coverage;
+
+			float4 destination 	= __builtin_convertvector(row[x], float4) * (1.0f / 255.0f);
+			float4 blended 		= destination + (source - destination) * coverage;
+
+			row[x] = __builtin_convertvector(blended * 255.0f + 0.5f, uint8x4);
+		}
+	}
+}
+
+internal void compositor_draw_tile(Compositor * compositor, int32 tile)
+{
+	int32 tileSize 	= compositor->tileSize;
+	int32 tileX 	= tile % compositor->tileCountX;
+	int32 tileY 	= tile / compositor->tileCountX;
+
+	CompositorDabBounds clip = {tileX * tileSize, tileY * tileSize, (tileX + 1) * tileSize, (tileY + 1) * tileSize};
+	clip.x1 = clip.x1 < compositor->width ? clip.x1 : compositor->width;
+	clip.y1 = clip.y1 < compositor->height ? clip.y1 : compositor->height;
+
+	int32 start = compositor->tileDabStarts[tile];
+	int32 end 	= start + compositor->tileDabCounts[tile];
+
+	for (int32 i = start; i < end; ++i)
+	{
+		compositor_draw_dab(compositor, compositor->batchDabs[compositor->tileDabIndices[i]], clip);
+	}
+}
+
+// Each job takes tiles until there are none left, so big and small tiles even out
+internal void compositor_draw_tiles_job(void * data)
+{
+	PROFILE_SCOPE("compositor_draw_tiles_job");
+
+	Compositor * compositor = (Compositor*)data;
+	while (true)
+	{
+		int32 index = compositor->nextActiveTile.fetch_add(1, std::memory_order_relaxed);
+		if (index >= compositor->activeTileCount)
+		{
+			break;
+		}
+		compositor_draw_tile(compositor, compositor->activeTiles[index]);
+	}
+}
+
+// Bins and draws as many dabs as fit to bins, and returns how many
+internal int32 compositor_draw_batch(Compositor * compositor, Dab const * dabs, int32 dabCount)
+{
+	PROFILE_SCOPE("compositor_draw_batch");
+
+	int32 tileCount = compositor->tileCountX * compositor->tileCountY;
+	memset(compositor->tileDabCounts, 0, tileCount * sizeof(int32));
+
+	int32 binnedCount 	= 0;
+	int32 indexCount 	= 0;
+
+	for (; binnedCount < dabCount; ++binnedCount)
+	{
+		CompositorDabBounds tiles 	= compositor_dab_tiles(compositor, dabs[binnedCount]);
+		int32 dabTileCount 			= (tiles.x1 - tiles.x0) * (tiles.y1 - tiles.y0);
+
+		if (indexCount + dabTileCount > compositor->tileDabIndexCapacity && binnedCount > 0)
+		{
+			break;
+		}
+		indexCount += dabTileCount;
+
+		for (int32 tileY = tiles.y0; tileY < tiles.y1; ++tileY)
+		{
+			for (int32 tileX = tiles.x0; tileX < tiles.x1; ++tileX)
+			{
+				compositor->tileDabCounts[tileY * compositor->tileCountX + tileX] += 1;
+			}
+		}
+	}
+
+	int32 start = 0;
+	compositor->activeTileCount = 0;
+	for (int32 tile = 0; tile < tileCount; ++tile)
+	{
+		compositor->tileDabStarts[tile] = start;
+		start += compositor->tileDabCounts[tile];
+
+		if (compositor->tileDabCounts[tile] > 0)
+		{
+			compositor->activeTiles[compositor->activeTileCount] = tile;
+			compositor->activeTileCount += 1;
+		}
+
+		// Used as fill cursor below, and set back to count after
+		compositor->tileDabCounts[tile] = 0;
+	}
+
+	for (int32 dabIndex = 0; dabIndex < binnedCount; ++dabIndex)
+	{
+		CompositorDabBounds tiles = compositor_dab_tiles(compositor, dabs[dabIndex]);
+		for (int32 tileY = tiles.y0; tileY < tiles.y1; ++tileY)
+		{
+			for (int32 tileX = tiles.x0; tileX < tiles.x1; ++tileX)
+			{
+				int32 tile = tileY * compositor->tileCountX + tileX;
+				compositor->tileDabIndices[compositor->tileDabStarts[tile] + compositor->tileDabCounts[tile]] = dabIndex;
+				compositor->tileDabCounts[tile] += 1;
+			}
+		}
+	}
+
+	compositor->batchDabs = dabs;
+	compositor->nextActiveTile.store(0, std::memory_order_relaxed);
+
+	int32 jobCount = compositor->jobCount < compositor->activeTileCount ? compositor->jobCount : compositor->activeTileCount;
+
+	JobCounter counter = {};
+	for (int32 i = 0; i < jobCount; ++i)
+	{
+		job_run(compositor->jobs, compositor_draw_tiles_job, compositor, &counter);
+	}
+	job_wait(compositor->jobs, &counter);
+
+	compositor->dabCount += binnedCount;
+	return binnedCount;
+}
+
+internal void compositor_flush(void * data, DabBuffer * buffer)
+{
+	Compositor * compositor = (Compositor*)data;
+
+	int32 drawnCount = 0;
+	while (drawnCount < buffer->count)
+	{
+		drawnCount += compositor_draw_batch(compositor, buffer->dabs + drawnCount, buffer->count - drawnCount);
+	}
+	buffer->count = 0;
+}
+
+internal void compositor_finish(Compositor * compositor)
+{
+	flush_dabs(&compositor->dabs);
+
+	int32 tileCount = compositor->tileCountX * compositor->tileCountY;
+	memory_heap_free(compositor->tileDabCounts, compositor_bin_memory_size(tileCount), MEMORY_CATEGORY_COMPOSITOR);
+
+	compositor->tileDabCounts 	= nullptr;
+	compositor->tileDabStarts 	= nullptr;
+	compositor->tileDabIndices 	= nullptr;
+	compositor->activeTiles 	= nullptr;
+}
@@ -0,0 +1,51 @@
+/// ----------------------------------------------------------------------------
+/// DAMAGE HISTORY
+
+// What changed on screen in last few frames, so that with EGL_EXT_buffer_age we only redraw that
+
+struct DamageHistory
+{
+	static constexpr int capacity = 4;
+
+	// Newest first
+	rect 	frames [capacity];
+	int32 	count;
+};
+
+internal void damage_history_reset(DamageHistory * history)
+{
+	history->count = 0;
+}
+
+internal void damage_history_push(DamageHistory * history, rect damage)
+{
+	for (int32 i = history->capacity - 1; i > 0; --i)
+	{
+		history->frames[i] = history->frames[i - 1];
+	}
+
+	history->frames[0] = damage;
+	if (history->count < history->capacity)
+	{
+		history->count += 1;
+	}
+}
+
+// Returns false if we do not know what changed since buffer was drawn, and all of it must be redrawn
+internal bool32 damage_history_get(DamageHistory const * history, int32 bufferAge, rect * outDamage)
+{
+	// Age 0 means contents are undefined
+	if (bufferAge <= 0 || bufferAge - 1 > history->count)
+	{
+		return false;
+	}
+
+	rect damage = rect_empty();
+	for (int32 i = 0; i < bufferAge - 1; ++i)
+	{
+		damage = rect_union(damage, history->frames[i]);
+	}
+
+	*outDamage = damage;
+	return true;
+}
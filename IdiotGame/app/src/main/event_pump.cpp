@@ -0,0 +1,58 @@
+/// ----------------------------------------------------------------------------
+/// EVENT PUMP
+
+/*
+Wait until frame may begin, then drain what is already pending, so that a command and touches
+that came together are handled on same frame. Draining is capped so that a source that never
+runs dry cannot starve rendering.
+*/
+
+enum EventPumpResult
+{
+	EVENT_PUMP_HANDLED,	// An event was serviced, there may be more
+	EVENT_PUMP_EMPTY,	// Timeout passed with nothing to do
+	EVENT_PUMP_ERROR,
+};
+
+struct EventPump
+{
+	// -1 waits forever
+	EventPumpResult (*poll)(void * data, int timeout);
+
+	// 0 when frame may begin now
+	int (*frame_timeout)(void * data);
+
+	void * data;
+
+	static constexpr int32 maxDrainedEventCount = 64;
+};
+
+// Returns number of events drained after wait
+internal int32 event_pump_run(EventPump const * pump, bool32 const * running)
+{
+	while (*running)
+	{
+		int timeout = pump->frame_timeout(pump->data);
+		if (timeout == 0)
+		{
+			break;
+		}
+
+		if (pump->poll(pump->data, timeout) == EVENT_PUMP_ERROR)
+		{
+			return 0;
+		}
+	}
+
+	int32 drainedCount = 0;
+	while (*running && drainedCount < pump->maxDrainedEventCount)
+	{
+		if (pump->poll(pump->data, 0) != EVENT_PUMP_HANDLED)
+		{
+			break;
+		}
+		drainedCount += 1;
+	}
+
+	return drainedCount;
+}
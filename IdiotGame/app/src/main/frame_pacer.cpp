@@ -0,0 +1,173 @@
+/// ----------------------------------------------------------------------------
+/// FRAME PACER
+
+/*
+Frames start at vsync, so input is read as late as possible and work does not pile up behind
+eglSwapBuffers. AChoreographer is loaded at runtime since our min sdk is older than it,
+without it we fake vsync with a 60 Hz timer.
+*/
+
+#include <dlfcn.h>
+
+struct AChoreographer;
+
+using ChoreographerFrameCallback 	= void (*)(long frameTimeNanos, void * data);
+using ChoreographerFrameCallback64 	= void (*)(int64 frameTimeNanos, void * data);
+
+struct FramePacer
+{
+	AChoreographer * choreographer;
+	void (*postFrameCallback)(AChoreographer *, ChoreographerFrameCallback, void *);
+	void (*postFrameCallback64)(AChoreographer *, ChoreographerFrameCallback64, void *);
+
+	bool32 	callbackPending;
+	bool32 	vsyncArrived;
+	int64 	vsyncTime;
+	int64 	vsyncPeriod;
+
+	// Share of frame that stroke rasterization may use, rest is carried over
+	static constexpr float strokeBudgetFraction = 0.25f;
+
+	// Last bucket has all frames that are longer
+	static constexpr int histogramBucketCount 		= 17;
+	static constexpr int64 histogramBucketWidth 	= 2'000'000;
+	static constexpr int histogramReportInterval 	= 600;
+	int32 	histogram [histogramBucketCount];
+	int32 	histogramFrameCount;
+};
+
+// Call from thread that runs the frames, choreographer uses its looper
+internal void frame_pacer_initialize(FramePacer * pacer)
+{
+	*pacer = {};
+	pacer->vsyncPeriod 	= 1'000'000'000 / 60;
+	pacer->vsyncTime 	= time_now_nanoseconds();
+
+	void * library = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+	if (library != nullptr)
+	{
+		using GetInstanceFunc = AChoreographer * ();
+		GetInstanceFunc * getInstance = (GetInstanceFunc*)dlsym(library, "AChoreographer_getInstance");
+
+		pacer->postFrameCallback 	= (decltype(pacer->postFrameCallback))dlsym(library, "AChoreographer_postFrameCallback");
+		pacer->postFrameCallback64 	= (decltype(pacer->postFrameCallback64))dlsym(library, "AChoreographer_postFrameCallback64");
+
+		if (getInstance != nullptr && (pacer->postFrameCallback != nullptr || pacer->postFrameCallback64 != nullptr))
+		{
+			pacer->choreographer = getInstance();
+		}
+	}
+
+	log_info(pacer->choreographer != nullptr
+			? "Frame pacing follows choreographer vsync"
+			: "Choreographer not available, frame pacing uses a timer");
+}
+
+internal void frame_pacer_vsync(FramePacer * pacer, int64 vsyncTime)
+{
+	// Follow refresh rate, skipping deltas from missed frames
+	int64 delta = vsyncTime - pacer->vsyncTime;
+	if (delta > 0 && delta < pacer->vsyncPeriod * 3 / 2)
+	{
+		pacer->vsyncPeriod = (pacer->vsyncPeriod * 7 + delta) / 8;
+	}
+
+	pacer->vsyncTime 		= vsyncTime;
+	pacer->vsyncArrived 	= true;
+	pacer->callbackPending 	= false;
+}
+
+internal void frame_pacer_on_vsync64(int64 frameTimeNanos, void * data)
+{
+	frame_pacer_vsync((FramePacer*)data, frameTimeNanos);
+}
+
+internal void frame_pacer_on_vsync(long frameTimeNanos, void * data)
+{
+	// 'long' is 32 bits on older arm devices, and frame time wraps there
+	int64 vsyncTime = sizeof(long) >= sizeof(int64) ? frameTimeNanos : time_now_nanoseconds();
+	frame_pacer_vsync((FramePacer*)data, vsyncTime);
+}
+
+internal int frame_pacer_poll_timeout(FramePacer * pacer)
+{
+	if (pacer->vsyncArrived)
+	{
+		return 0;
+	}
+
+	if (pacer->choreographer != nullptr)
+	{
+		if (pacer->callbackPending == false)
+		{
+			if (pacer->postFrameCallback64 != nullptr)
+			{
+				pacer->postFrameCallback64(pacer->choreographer, frame_pacer_on_vsync64, pacer);
+			}
+			else
+			{
+				pacer->postFrameCallback(pacer->choreographer, frame_pacer_on_vsync, pacer);
+			}
+			pacer->callbackPending = true;
+		}
+		return -1;
+	}
+
+	int64 now 			= time_now_nanoseconds();
+	int64 nextVsyncTime = pacer->vsyncTime + pacer->vsyncPeriod;
+
+	if (now >= nextVsyncTime)
+	{
+		// Do not catch up missed vsyncs
+		pacer->vsyncTime 	= now - nextVsyncTime < pacer->vsyncPeriod ? nextVsyncTime : now;
+		pacer->vsyncArrived = true;
+		return 0;
+	}
+
+	return (int)((nextVsyncTime - now + 999'999) / 1'000'000);
+}
+
+internal void frame_pacer_begin_frame(FramePacer * pacer)
+{
+	pacer->vsyncArrived = false;
+}
+
+internal int64 frame_pacer_stroke_budget(FramePacer const * pacer)
+{
+	return (int64)(pacer->vsyncPeriod * pacer->strokeBudgetFraction);
+}
+
+internal void frame_pacer_end_frame(FramePacer * pacer, int64 frameTime)
+{
+	int32 bucket = (int32)(frameTime / pacer->histogramBucketWidth);
+	if (bucket >= pacer->histogramBucketCount)
+	{
+		bucket = pacer->histogramBucketCount - 1;
+	}
+
+	pacer->histogram[bucket] 	+= 1;
+	pacer->histogramFrameCount 	+= 1;
+
+	if (pacer->histogramFrameCount < pacer->histogramReportInterval)
+	{
+		return;
+	}
+
+#if PROFILER_ENABLED
+	char line [256];
+	int lineLength = 0;
+	for (int32 i = 0; i < pacer->histogramBucketCount; ++i)
+	{
+		lineLength += snprintf(line + lineLength, sizeof(line) - lineLength, " %d", pacer->histogram[i]);
+	}
+
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Frame times in 2 ms buckets, vsync %.2f ms:%s",
+						pacer->vsyncPeriod / 1'000'000.0, line);
+#endif
+
+	for (int32 i = 0; i < pacer->histogramBucketCount; ++i)
+	{
+		pacer->histogram[i] = 0;
+	}
+	pacer->histogramFrameCount = 0;
+}
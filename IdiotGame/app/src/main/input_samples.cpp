@@ -0,0 +1,79 @@
+/// ----------------------------------------------------------------------------
+/// INPUT SAMPLES
+
+/*
+Input thread hands samples to game thread through a single producer single consumer ring.
+Neither side blocks. If game thread falls so far behind that ring is full, new samples are
+dropped and counted.
+*/
+
+#include <atomic>
+
+enum InputSampleType : int32
+{
+	INPUT_SAMPLE_DOWN,
+	INPUT_SAMPLE_POINTER_DOWN,
+	INPUT_SAMPLE_UP,
+	INPUT_SAMPLE_MOVE,
+	INPUT_SAMPLE_BACK,
+};
+
+struct InputSample
+{
+	InputSampleType type;
+	int32 			pointerCount;
+	v2 				position;
+
+	// From AMotionEvent_getEventTime, and when input thread got it
+	int64 			eventTime;
+	int64 			receiveTime;
+
+	StrokeDynamics 	dynamics;
+	bool32 			stylus;
+};
+
+struct InputSampleQueue
+{
+	// Power of two, so indices can wrap freely
+	static constexpr uint32 capacity = 1024;
+
+	InputSample samples [capacity];
+
+	// Written by different threads, so keep them on separate cache lines
+	alignas(64) std::atomic<uint32> writeIndex;
+	alignas(64) std::atomic<uint32> readIndex;
+	std::atomic<uint32> 			droppedCount;
+};
+
+// Input thread only
+internal bool32 input_sample_queue_push(InputSampleQueue * queue, InputSample sample)
+{
+	uint32 writeIndex 	= queue->writeIndex.load(std::memory_order_relaxed);
+	uint32 readIndex 	= queue->readIndex.load(std::memory_order_acquire);
+
+	if (writeIndex - readIndex == queue->capacity)
+	{
+		queue->droppedCount.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	queue->samples[writeIndex % queue->capacity] = sample;
+	queue->writeIndex.store(writeIndex + 1, std::memory_order_release);
+	return true;
+}
+
+// Game thread only
+internal bool32 input_sample_queue_pop(InputSampleQueue * queue, InputSample * outSample)
+{
+	uint32 readIndex 	= queue->readIndex.load(std::memory_order_relaxed);
+	uint32 writeIndex 	= queue->writeIndex.load(std::memory_order_acquire);
+
+	if (readIndex == writeIndex)
+	{
+		return false;
+	}
+
+	*outSample = queue->samples[readIndex % queue->capacity];
+	queue->readIndex.store(readIndex + 1, std::memory_order_release);
+	return true;
+}
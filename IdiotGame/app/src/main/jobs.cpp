@@ -0,0 +1,489 @@
+/// ----------------------------------------------------------------------------
+/// JOBS
+
+/*
+Work stealing thread pool, one worker per big core, game thread being worker 0. Jobs must not
+touch GL. Job slots come from a ring of creating thread and are reused after a full lap, so
+only game thread and workers may create jobs. Game thread never steals, so that it does not
+get stuck in long work, which goes through job_run_background instead.
+*/
+
+#include <atomic>
+
+struct Job;
+struct JobSystem;
+
+using JobFunction = void (void * data);
+
+struct JobCounter
+{
+	std::atomic<int32> value;
+};
+
+struct Job
+{
+	JobFunction * 	function;
+	void * 			data;
+	JobCounter * 	counter;
+
+	// Plus one until job is submitted
+	std::atomic<int32> unfinishedDependencyCount;
+
+	// Guarded by JobSystem::dependencyMutex
+	static constexpr int maxDependentCount = 8;
+	Job * 				dependents [maxDependentCount];
+	int32 				dependentCount;
+	std::atomic<bool32> finished;
+};
+
+// Chase-Lev deque, see "Correct and Efficient Work-Stealing for Weak Memory Models"
+struct JobDeque
+{
+	static constexpr int64 capacity = 256;
+
+	std::atomic<Job*> 			jobs [capacity];
+	alignas(64) std::atomic<int64> top;
+	alignas(64) std::atomic<int64> bottom;
+};
+
+// Owner only
+internal bool32 job_deque_push(JobDeque * deque, Job * job)
+{
+	int64 bottom 	= deque->bottom.load(std::memory_order_relaxed);
+	int64 top 		= deque->top.load(std::memory_order_acquire);
+
+	if (bottom - top >= deque->capacity)
+	{
+		return false;
+	}
+
+	deque->jobs[bottom & (deque->capacity - 1)].store(job, std::memory_order_relaxed);
+	deque->bottom.store(bottom + 1, std::memory_order_release);
+	return true;
+}
+
+// Owner only
+internal Job * job_deque_pop(JobDeque * deque)
+{
+	int64 bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+	deque->bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64 top = deque->top.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job * job = deque->jobs[bottom & (deque->capacity - 1)].load(std::memory_order_relaxed);
+	if (top == bottom)
+	{
+		// Last one, race with thieves for it
+		if (deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed) == false)
+		{
+			job = nullptr;
+		}
+		deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+internal Job * job_deque_steal(JobDeque * deque)
+{
+	int64 top = deque->top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64 bottom = deque->bottom.load(std::memory_order_acquire);
+
+	if (top >= bottom)
+	{
+		return nullptr;
+	}
+
+	Job * job = deque->jobs[top & (deque->capacity - 1)].load(std::memory_order_relaxed);
+	if (deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed) == false)
+	{
+		return nullptr;
+	}
+	return job;
+}
+
+struct JobWorker
+{
+	JobDeque 	deque;
+
+	static constexpr uint32 jobPoolCapacity = 256;
+	Job 		jobPool [jobPoolCapacity];
+	uint32 		jobPoolIndex;
+
+	JobSystem * system;
+	int32 		index;
+	pthread_t 	thread;
+};
+
+struct JobSystem
+{
+	// Worker 0 is game thread
+	static constexpr int maxWorkerCount = 8;
+	JobWorker 	workers [maxWorkerCount];
+	int32 		workerCount;
+	cpu_set_t 	bigCores;
+
+	std::atomic<bool32> running;
+	std::atomic<int32> 	queuedJobCount;
+	std::atomic<int32> 	sleepingWorkerCount;
+	pthread_mutex_t 	sleepMutex;
+	pthread_cond_t 		sleepCondition;
+
+	pthread_mutex_t 	dependencyMutex;
+
+	// Jobs game thread must not run
+	static constexpr int backgroundCapacity = 16;
+	Job * 				backgroundJobs [backgroundCapacity];
+	int32 				backgroundFirst;
+	int32 				backgroundCount;
+	pthread_mutex_t 	backgroundMutex;
+};
+
+internal thread_local JobWorker * jobThreadWorker;
+
+// Big cores are those not in slowest cluster by max frequency, or all if that can not be read
+internal int32 job_system_find_big_cores(cpu_set_t * outCores)
+{
+	constexpr int maxCpuCount = 32;
+	int64 maxFrequencies [maxCpuCount] = {};
+
+	int32 cpuCount = (int32)sysconf(_SC_NPROCESSORS_CONF);
+	if (cpuCount > maxCpuCount)
+	{
+		cpuCount = maxCpuCount;
+	}
+
+	int64 lowestFrequency 	= INT64_MAX;
+	int64 highestFrequency 	= 0;
+
+	for (int32 cpu = 0; cpu < cpuCount; ++cpu)
+	{
+		char path [128];
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+
+		FILE * file = fopen(path, "r");
+		if (file != nullptr)
+		{
+			long long frequency = 0;
+			if (fscanf(file, "%lld", &frequency) == 1)
+			{
+				maxFrequencies[cpu] = frequency;
+			}
+			fclose(file);
+		}
+
+		if (maxFrequencies[cpu] > 0)
+		{
+			lowestFrequency 	= maxFrequencies[cpu] < lowestFrequency ? maxFrequencies[cpu] : lowestFrequency;
+			highestFrequency 	= maxFrequencies[cpu] > highestFrequency ? maxFrequencies[cpu] : highestFrequency;
+		}
+	}
+
+	bool32 allAreBig = highestFrequency == lowestFrequency || highestFrequency == 0;
+
+	CPU_ZERO(outCores);
+	int32 bigCoreCount = 0;
+	for (int32 cpu = 0; cpu < cpuCount; ++cpu)
+	{
+		if (allAreBig || maxFrequencies[cpu] > lowestFrequency)
+		{
+			CPU_SET(cpu, outCores);
+			bigCoreCount += 1;
+		}
+	}
+
+	return bigCoreCount > 0 ? bigCoreCount : 1;
+}
+
+internal Job * job_system_next_job(JobSystem * system, JobWorker * worker)
+{
+	Job * job = job_deque_pop(&worker->deque);
+	if (job != nullptr || worker->index == 0)
+	{
+		return job;
+	}
+
+	for (int32 i = 1; i < system->workerCount; ++i)
+	{
+		JobWorker * victim = &system->workers[(worker->index + i) % system->workerCount];
+		job = job_deque_steal(&victim->deque);
+		if (job != nullptr)
+		{
+			return job;
+		}
+	}
+
+	pthread_mutex_lock(&system->backgroundMutex);
+	if (system->backgroundCount > 0)
+	{
+		job = system->backgroundJobs[system->backgroundFirst];
+		system->backgroundFirst = (system->backgroundFirst + 1) % system->backgroundCapacity;
+		system->backgroundCount -= 1;
+	}
+	pthread_mutex_unlock(&system->backgroundMutex);
+
+	return job;
+}
+
+internal void job_system_push(JobSystem * system, Job * job);
+
+internal void job_execute(JobSystem * system, Job * job)
+{
+	job->function(job->data);
+
+	Job * dependents [Job::maxDependentCount];
+	int32 dependentCount;
+
+	pthread_mutex_lock(&system->dependencyMutex);
+	job->finished 	= true;
+	dependentCount 	= job->dependentCount;
+	for (int32 i = 0; i < dependentCount; ++i)
+	{
+		dependents[i] = job->dependents[i];
+	}
+	pthread_mutex_unlock(&system->dependencyMutex);
+
+	for (int32 i = 0; i < dependentCount; ++i)
+	{
+		if (dependents[i]->unfinishedDependencyCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			job_system_push(system, dependents[i]);
+		}
+	}
+
+	// Last, so that dependents are already queued when waiter sees this
+	if (job->counter != nullptr)
+	{
+		job->counter->value.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+internal bool32 job_system_run_one(JobSystem * system, JobWorker * worker)
+{
+	Job * job = job_system_next_job(system, worker);
+	if (job == nullptr)
+	{
+		return false;
+	}
+
+	system->queuedJobCount.fetch_sub(1, std::memory_order_relaxed);
+	job_execute(system, job);
+	return true;
+}
+
+internal void job_system_wake_one(JobSystem * system)
+{
+	system->queuedJobCount.fetch_add(1, std::memory_order_seq_cst);
+	if (system->sleepingWorkerCount.load(std::memory_order_seq_cst) > 0)
+	{
+		pthread_mutex_lock(&system->sleepMutex);
+		pthread_cond_signal(&system->sleepCondition);
+		pthread_mutex_unlock(&system->sleepMutex);
+	}
+}
+
+internal void job_system_push(JobSystem * system, Job * job)
+{
+	JobWorker * worker = jobThreadWorker;
+	assert(worker != nullptr && "Jobs can be submitted only from game thread or workers");
+
+	// Deque is full, so there is plenty of work for others, just do this one now
+	if (job_deque_push(&worker->deque, job) == false)
+	{
+		job_execute(system, job);
+		return;
+	}
+
+	job_system_wake_one(system);
+}
+
+internal void * job_worker_entry(void * data)
+{
+	JobWorker * worker 	= (JobWorker*)data;
+	JobSystem * system 	= worker->system;
+	jobThreadWorker 	= worker;
+
+	// This may be refused, then we run wherever scheduler puts us
+	sched_setaffinity(0, sizeof(system->bigCores), &system->bigCores);
+
+	while (system->running.load(std::memory_order_acquire))
+	{
+		if (job_system_run_one(system, worker))
+		{
+			continue;
+		}
+
+		pthread_mutex_lock(&system->sleepMutex);
+		system->sleepingWorkerCount.fetch_add(1, std::memory_order_seq_cst);
+		while (system->queuedJobCount.load(std::memory_order_seq_cst) == 0 && system->running.load(std::memory_order_acquire))
+		{
+			pthread_cond_wait(&system->sleepCondition, &system->sleepMutex);
+		}
+		system->sleepingWorkerCount.fetch_sub(1, std::memory_order_relaxed);
+		pthread_mutex_unlock(&system->sleepMutex);
+	}
+
+	return nullptr;
+}
+
+// Call from game thread, it becomes worker 0
+internal void job_system_initialize(JobSystem * system)
+{
+	system->running 			= true;
+	system->queuedJobCount 		= 0;
+	system->sleepingWorkerCount = 0;
+	pthread_mutex_init(&system->sleepMutex, nullptr);
+	pthread_cond_init(&system->sleepCondition, nullptr);
+	pthread_mutex_init(&system->dependencyMutex, nullptr);
+	pthread_mutex_init(&system->backgroundMutex, nullptr);
+
+	int32 bigCoreCount = job_system_find_big_cores(&system->bigCores);
+	system->workerCount = bigCoreCount < system->maxWorkerCount ? bigCoreCount : system->maxWorkerCount;
+
+	// At least one worker besides game thread, so that background jobs can run
+	if (system->workerCount < 2)
+	{
+		system->workerCount = 2;
+	}
+
+	for (int32 i = 0; i < system->workerCount; ++i)
+	{
+		system->workers[i].system 	= system;
+		system->workers[i].index 	= i;
+	}
+
+	jobThreadWorker = &system->workers[0];
+
+	for (int32 i = 1; i < system->workerCount; ++i)
+	{
+		pthread_create(&system->workers[i].thread, nullptr, job_worker_entry, &system->workers[i]);
+	}
+
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Job system started with %d workers on %d big cores", system->workerCount, bigCoreCount);
+}
+
+internal void job_system_destroy(JobSystem * system)
+{
+	pthread_mutex_lock(&system->sleepMutex);
+	system->running.store(false, std::memory_order_release);
+	pthread_cond_broadcast(&system->sleepCondition);
+	pthread_mutex_unlock(&system->sleepMutex);
+
+	for (int32 i = 1; i < system->workerCount; ++i)
+	{
+		pthread_join(system->workers[i].thread, nullptr);
+	}
+
+	jobThreadWorker = nullptr;
+
+	pthread_cond_destroy(&system->sleepCondition);
+	pthread_mutex_destroy(&system->sleepMutex);
+	pthread_mutex_destroy(&system->dependencyMutex);
+	pthread_mutex_destroy(&system->backgroundMutex);
+}
+
+// Add dependencies before job_submit. 'counter' may be nullptr, and shared by many jobs.
+internal Job * job_create(JobFunction * function, void * data, JobCounter * counter)
+{
+	JobWorker * worker = jobThreadWorker;
+	assert(worker != nullptr && "Jobs can be created only from game thread or workers");
+
+	Job * job = &worker->jobPool[worker->jobPoolIndex % worker->jobPoolCapacity];
+	assert((worker->jobPoolIndex < worker->jobPoolCapacity || job->finished) && "Job pool lapped an unfinished job");
+	worker->jobPoolIndex += 1;
+
+	job->function 		= function;
+	job->data 			= data;
+	job->counter 		= counter;
+	job->dependentCount = 0;
+	job->finished 		= false;
+	job->unfinishedDependencyCount.store(1, std::memory_order_relaxed);
+
+	if (counter != nullptr)
+	{
+		counter->value.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+// 'dependency' may already be running or finished
+internal void job_depends_on(JobSystem * system, Job * job, Job * dependency)
+{
+	pthread_mutex_lock(&system->dependencyMutex);
+	if (dependency->finished == false)
+	{
+		assert(dependency->dependentCount < Job::maxDependentCount && "Too many jobs depend on one job");
+
+		dependency->dependents[dependency->dependentCount] = job;
+		dependency->dependentCount += 1;
+		job->unfinishedDependencyCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&system->dependencyMutex);
+}
+
+internal void job_submit(JobSystem * system, Job * job)
+{
+	if (job->unfinishedDependencyCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		job_system_push(system, job);
+	}
+}
+
+internal Job * job_run(JobSystem * system, JobFunction * function, void * data, JobCounter * counter)
+{
+	Job * job = job_create(function, data, counter);
+	job_submit(system, job);
+	return job;
+}
+
+// Run by some worker other than game thread. Background jobs can not have dependencies.
+internal Job * job_run_background(JobSystem * system, JobFunction * function, void * data, JobCounter * counter)
+{
+	Job * job = job_create(function, data, counter);
+	job->unfinishedDependencyCount.store(0, std::memory_order_relaxed);
+
+	pthread_mutex_lock(&system->backgroundMutex);
+	bool32 queued = system->backgroundCount < system->backgroundCapacity;
+	if (queued)
+	{
+		int32 index = (system->backgroundFirst + system->backgroundCount) % system->backgroundCapacity;
+		system->backgroundJobs[index] = job;
+		system->backgroundCount += 1;
+	}
+	pthread_mutex_unlock(&system->backgroundMutex);
+
+	// Queue is full, so there is plenty of background work already, just do this one now
+	if (queued == false)
+	{
+		log_error("Background job queue is full");
+		job_execute(system, job);
+		return job;
+	}
+
+	job_system_wake_one(system);
+	return job;
+}
+
+// Runs other jobs while waiting, so calling thread can not deadlock
+internal void job_wait(JobSystem * system, JobCounter * counter)
+{
+	PROFILE_SCOPE("job_wait");
+
+	JobWorker * worker = jobThreadWorker;
+	assert(worker != nullptr && "Jobs can be waited only from game thread or workers");
+
+	while (counter->value.load(std::memory_order_acquire) > 0)
+	{
+		if (job_system_run_one(system, worker) == false)
+		{
+			sched_yield();
+		}
+	}
+}
@@ -0,0 +1,322 @@
+/// ----------------------------------------------------------------------------
+/// LATENCY MEASUREMENT
+
+/*
+How far ink lags behind finger, from sample event time until segment ending at it has been
+swapped. Enable with 'adb shell setprop debug.idiotgame.latency 1', value 2 draws synthetic
+circles at 120 Hz instead. Compositor and display add a frame or two on top of 'total'.
+*/
+
+#include <sys/system_properties.h>
+#include <algorithm>
+
+enum LatencyStage
+{
+	LATENCY_STAGE_DISPATCH,	// Event time to input thread reading it
+	LATENCY_STAGE_QUEUE,	// Waiting for game thread and in draw queue until its segment is dequeued
+	LATENCY_STAGE_RENDER,	// Dequeued to eglSwapBuffers called
+	LATENCY_STAGE_SWAP,		// eglSwapBuffers
+	LATENCY_STAGE_TOTAL,	// Event time to eglSwapBuffers returned
+	LATENCY_STAGE_VISIBLE,	// Event time to first swap where it was shown, in wet tail or committed
+
+	LATENCY_STAGE_COUNT
+};
+
+char const * latencyStageNames [LATENCY_STAGE_COUNT] =
+{
+	"dispatch",
+	"queue",
+	"render",
+	"swap",
+	"total",
+	"visible",
+};
+
+struct LatencySample
+{
+	int64 	eventTime;
+	int64 	receiveTime;
+	int64 	drawTime;
+	int64 	visibleTime;
+	bool32 	drawn;
+	bool32 	wetShown;
+};
+
+enum SyntheticInputAction
+{
+	SYNTHETIC_INPUT_NONE,
+	SYNTHETIC_INPUT_BEGIN,
+	SYNTHETIC_INPUT_MOVE,
+	SYNTHETIC_INPUT_END,
+};
+
+struct LatencyTracker
+{
+	bool32 enabled;
+	bool32 syntheticInput;
+
+	// Mirrors StrokeState::drawPositionQueue
+	LatencySample 	queue [StrokeState::drawPositionQueueCapacity];
+	int32 			queueCount;
+
+	// Drawn, but not yet swapped
+	static constexpr int maxPendingCount = 256;
+	LatencySample 	pending [maxPendingCount];
+	int32 			pendingCount;
+
+	static constexpr int resultCapacity 	= 2048;
+	static constexpr int reportInterval 	= 1000;
+	int64 			results [LATENCY_STAGE_COUNT][resultCapacity];
+	int32 			resultCount;
+	int32 			resultsSinceReport;
+	int64 			sortMemory [resultCapacity];
+
+	static constexpr int64 syntheticSampleInterval 	= 1'000'000'000 / 120;
+	static constexpr int syntheticStrokeSampleCount = 120;
+	static constexpr int syntheticPauseSampleCount 	= 30;
+	int64 			syntheticNextEventTime;
+	int32 			syntheticSampleIndex;
+};
+
+internal void latency_initialize(LatencyTracker * tracker)
+{
+	char value [PROP_VALUE_MAX] = {};
+	__system_property_get("debug.idiotgame.latency", value);
+
+	tracker->enabled 				= value[0] == '1' || value[0] == '2';
+	tracker->syntheticInput 		= value[0] == '2';
+	tracker->syntheticNextEventTime = time_now_nanoseconds();
+
+	if (tracker->enabled)
+	{
+		log_info(tracker->syntheticInput
+				? "Latency measurement enabled with synthetic input"
+				: "Latency measurement enabled");
+	}
+}
+
+internal void latency_begin(LatencyTracker * tracker, int64 eventTime, int64 receiveTime)
+{
+	if (tracker->enabled == false)
+	{
+		return;
+	}
+
+	tracker->queue[0] 	= {eventTime, receiveTime};
+	tracker->queueCount = 1;
+}
+
+internal void latency_queue(LatencyTracker * tracker, int64 eventTime, int64 receiveTime)
+{
+	if (tracker->enabled == false)
+	{
+		return;
+	}
+
+	if (tracker->queueCount < StrokeState::drawPositionQueueCapacity)
+	{
+		tracker->queue[tracker->queueCount] = {eventTime, receiveTime};
+		tracker->queueCount += 1;
+	}
+}
+
+internal void latency_mark_drawn(LatencyTracker * tracker, LatencySample * sample)
+{
+	if (sample->drawn || tracker->pendingCount == tracker->maxPendingCount)
+	{
+		return;
+	}
+
+	sample->drawn 		= true;
+	sample->drawTime 	= time_now_nanoseconds();
+
+	tracker->pending[tracker->pendingCount] = *sample;
+	tracker->pendingCount += 1;
+}
+
+// Call after stroke engine has dequeued. 'inked' is false while stroke has not moved yet.
+internal void latency_dequeue(LatencyTracker * tracker, bool32 inked)
+{
+	if (tracker->enabled == false || tracker->queueCount == 0)
+	{
+		return;
+	}
+
+	if (inked)
+	{
+		int32 last = tracker->queueCount - 1;
+		latency_mark_drawn(tracker, &tracker->queue[last < 1 ? last : 1]);
+	}
+
+	tracker->queueCount -= 1;
+	for (int i = 0; i < tracker->queueCount; ++i)
+	{
+		tracker->queue[i] = tracker->queue[i + 1];
+	}
+}
+
+// 'strokeMoved' is what it was before stroke_end
+internal void latency_end(LatencyTracker * tracker, bool32 strokeMoved)
+{
+	if (tracker->enabled == false)
+	{
+		return;
+	}
+
+	if (strokeMoved == false)
+	{
+		if (tracker->queueCount > 0)
+		{
+			latency_mark_drawn(tracker, &tracker->queue[0]);
+		}
+		tracker->queueCount = 0;
+	}
+
+	while (tracker->queueCount > 0)
+	{
+		latency_dequeue(tracker, true);
+	}
+}
+
+internal void latency_mark_wet(LatencyTracker * tracker)
+{
+	if (tracker->enabled == false)
+	{
+		return;
+	}
+
+	for (int i = 0; i < tracker->queueCount; ++i)
+	{
+		tracker->queue[i].wetShown = true;
+	}
+}
+
+internal void latency_cancel(LatencyTracker * tracker)
+{
+	if (tracker->enabled == false)
+	{
+		return;
+	}
+
+	tracker->queueCount = 0;
+}
+
+internal void latency_report(LatencyTracker * tracker)
+{
+	if (tracker->enabled == false)
+	{
+		return;
+	}
+
+	int32 count = tracker->resultCount < tracker->resultCapacity ? tracker->resultCount : tracker->resultCapacity;
+	if (count == 0)
+	{
+		return;
+	}
+
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Input latency over last %d samples, in ms:", count);
+
+	for (int stage = 0; stage < LATENCY_STAGE_COUNT; ++stage)
+	{
+		int64 * sorted = tracker->sortMemory;
+		memcpy(sorted, tracker->results[stage], count * sizeof(int64));
+		std::sort(sorted, sorted + count);
+
+		auto percentile = [sorted, count](int32 p) -> double
+		{
+			return sorted[(count - 1) * p / 100] / 1'000'000.0;
+		};
+
+		__android_log_print(ANDROID_LOG_INFO, "Game", "  %-8s p50 %6.2f  p95 %6.2f  p99 %6.2f",
+							latencyStageNames[stage], percentile(50), percentile(95), percentile(99));
+	}
+
+	tracker->resultsSinceReport = 0;
+}
+
+internal void latency_frame_presented(LatencyTracker * tracker, int64 swapStartTime, int64 swapEndTime)
+{
+	if (tracker->enabled == false)
+	{
+		return;
+	}
+
+	for (int i = 0; i < tracker->queueCount; ++i)
+	{
+		LatencySample & sample = tracker->queue[i];
+		if (sample.wetShown && sample.visibleTime == 0)
+		{
+			sample.visibleTime = swapEndTime;
+		}
+	}
+
+	for (int i = 0; i < tracker->pendingCount; ++i)
+	{
+		LatencySample sample 	= tracker->pending[i];
+		int32 resultIndex 		= tracker->resultCount % tracker->resultCapacity;
+		int64 visibleTime 		= sample.visibleTime != 0 ? sample.visibleTime : swapEndTime;
+
+		auto & results = tracker->results;
+		results[LATENCY_STAGE_DISPATCH][resultIndex] 	= sample.receiveTime - sample.eventTime;
+		results[LATENCY_STAGE_QUEUE][resultIndex] 		= sample.drawTime - sample.receiveTime;
+		results[LATENCY_STAGE_RENDER][resultIndex] 		= swapStartTime - sample.drawTime;
+		results[LATENCY_STAGE_SWAP][resultIndex] 		= swapEndTime - swapStartTime;
+		results[LATENCY_STAGE_TOTAL][resultIndex] 		= swapEndTime - sample.eventTime;
+		results[LATENCY_STAGE_VISIBLE][resultIndex] 	= visibleTime - sample.eventTime;
+
+		tracker->resultCount 		+= 1;
+		tracker->resultsSinceReport += 1;
+	}
+	tracker->pendingCount = 0;
+
+	if (tracker->resultsSinceReport >= tracker->reportInterval)
+	{
+		latency_report(tracker);
+	}
+}
+
+// Call repeatedly until this returns SYNTHETIC_INPUT_NONE. Event times are when samples would have been taken.
+internal SyntheticInputAction latency_next_synthetic_input(LatencyTracker * tracker, v2 center, float radius,
+															v2 * outPosition, int64 * outEventTime)
+{
+	int64 now = time_now_nanoseconds();
+
+	// Do not try to catch up after app has been paused
+	constexpr int64 maxLag = 100'000'000;
+	if (tracker->syntheticNextEventTime < now - maxLag)
+	{
+		tracker->syntheticNextEventTime = now;
+	}
+
+	int32 cycleLength = tracker->syntheticStrokeSampleCount + tracker->syntheticPauseSampleCount;
+
+	while (tracker->syntheticNextEventTime <= now)
+	{
+		int32 index 	= tracker->syntheticSampleIndex;
+		*outEventTime 	= tracker->syntheticNextEventTime;
+
+		tracker->syntheticNextEventTime += tracker->syntheticSampleInterval;
+		tracker->syntheticSampleIndex 	= (index + 1) % cycleLength;
+
+		if (index > tracker->syntheticStrokeSampleCount)
+		{
+			continue;
+		}
+
+		constexpr float tau = 6.28318530718f;
+		float angle 	= tau * index / tracker->syntheticStrokeSampleCount;
+		*outPosition 	= {center.x + radius * cosf(angle), center.y + radius * sinf(angle)};
+
+		if (index == 0)
+		{
+			return SYNTHETIC_INPUT_BEGIN;
+		}
+		if (index == tracker->syntheticStrokeSampleCount)
+		{
+			return SYNTHETIC_INPUT_END;
+		}
+		return SYNTHETIC_INPUT_MOVE;
+	}
+
+	return SYNTHETIC_INPUT_NONE;
+}
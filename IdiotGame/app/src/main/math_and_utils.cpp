@@ -31,6 +31,13 @@ internal float time_elapsed_seconds(timespec start)
 	return result;
 }
 
+// Same clock as input event times, see AMotionEvent_getEventTime
+internal int64 time_now_nanoseconds()
+{
+	timespec now = time_now();
+	return (int64)now.tv_sec * 1'000'000'000 + now.tv_nsec;
+}
+
 internal void log_info(char const * message)
 {
 	__android_log_write(ANDROID_LOG_INFO, "Game", message);
@@ -138,6 +145,36 @@ internal v2 v2_cubic_bezier_lerp(v2 a, v2 b, v2 c, v2 d, float t)
 	return abcd;
 }
 
+// Axis aligned, min > max means empty
+struct rect
+{
+	v2 min;
+	v2 max;
+};
+
+internal rect rect_empty()
+{
+	return {{1, 1}, {0, 0}};
+}
+
+internal bool32 rect_is_empty(rect r)
+{
+	return r.min.x > r.max.x || r.min.y > r.max.y;
+}
+
+internal rect rect_union(rect a, rect b)
+{
+	if (rect_is_empty(a)) { return b; }
+	if (rect_is_empty(b)) { return a; }
+
+	rect result =
+	{
+		{a.min.x < b.min.x ? a.min.x : b.min.x, a.min.y < b.min.y ? a.min.y : b.min.y},
+		{a.max.x > b.max.x ? a.max.x : b.max.x, a.max.y > b.max.y ? a.max.y : b.max.y},
+	};
+	return result;
+}
+
 struct v3
 {
 	float r, g, b;
@@ -0,0 +1,309 @@
+/// ----------------------------------------------------------------------------
+/// MEMORY
+
+/*
+Temporary memory comes from frame arena, which is reset every frame. Heap allocations are
+counted so that we can see steady state does not allocate. Resident bytes are tracked per
+category, GL sizes being what we asked for, driver may use more.
+*/
+
+#include <atomic>
+
+enum MemoryCategory
+{
+	MEMORY_CATEGORY_CANVAS,
+	MEMORY_CATEGORY_UNDO_CHECKPOINTS,
+	MEMORY_CATEGORY_THUMBNAILS,
+	MEMORY_CATEGORY_BRUSH_TEXTURES,
+	MEMORY_CATEGORY_MENU_TEXTURES,
+	MEMORY_CATEGORY_STROKE_LOG,
+	MEMORY_CATEGORY_FRAME_ARENA,
+	MEMORY_CATEGORY_IMAGE_DECODE,
+	MEMORY_CATEGORY_COMPOSITOR,
+	MEMORY_CATEGORY_EXPORT,
+
+	MEMORY_CATEGORY_COUNT
+};
+
+struct MemoryCategoryInfo
+{
+	char const * 	name;
+	bool32 			onGpu;
+};
+
+MemoryCategoryInfo memoryCategoryInfos [MEMORY_CATEGORY_COUNT] =
+{
+	{"canvas", 				true},
+	{"undo checkpoints", 	true},
+	{"thumbnails", 			true},
+	{"brush textures", 		true},
+	{"menu textures", 		true},
+	{"stroke log", 			false},
+	{"frame arena", 		false},
+	{"image decode", 		false},
+	{"compositor", 			false},
+	{"export", 				false},
+};
+
+struct MemoryStats
+{
+	std::atomic<int64> residentBytes [MEMORY_CATEGORY_COUNT];
+};
+
+internal MemoryStats memoryStats;
+
+// Per thread, so that game thread sees its own frames do not allocate while jobs do
+internal thread_local int64 heapAllocationCount;
+
+// Rare things that allocate by design, like starting export, go between memory_expect_heap_begin and _end
+internal thread_local int32 heapExpectedDepth;
+internal thread_local int64 heapUnexpectedAllocationCount;
+
+internal void memory_track(MemoryCategory category, int64 bytes)
+{
+	memoryStats.residentBytes[category].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+internal void memory_track_gpu_released()
+{
+	for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i)
+	{
+		if (memoryCategoryInfos[i].onGpu)
+		{
+			memoryStats.residentBytes[i].store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+internal void memory_report(char const * when)
+{
+	int64 gpuTotal = 0;
+	int64 cpuTotal = 0;
+
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Resident memory %s, in KiB:", when);
+	for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i)
+	{
+		int64 bytes = memoryStats.residentBytes[i].load(std::memory_order_relaxed);
+		(memoryCategoryInfos[i].onGpu ? gpuTotal : cpuTotal) += bytes;
+
+		__android_log_print(ANDROID_LOG_INFO, "Game", "  %-18s %s %8lld", memoryCategoryInfos[i].name,
+							memoryCategoryInfos[i].onGpu ? "gpu" : "cpu", (long long)(bytes / 1024));
+	}
+	__android_log_print(ANDROID_LOG_INFO, "Game", "  total gpu %lld, cpu %lld", (long long)(gpuTotal / 1024), (long long)(cpuTotal / 1024));
+}
+
+internal void * memory_heap_allocate(size_t size, MemoryCategory category)
+{
+	void * memory = malloc(size);
+	if (memory != nullptr)
+	{
+		heapAllocationCount += 1;
+		heapUnexpectedAllocationCount += heapExpectedDepth == 0 ? 1 : 0;
+		memory_track(category, size);
+	}
+	return memory;
+}
+
+internal void memory_heap_free(void * memory, size_t size, MemoryCategory category)
+{
+	if (memory != nullptr)
+	{
+		memory_track(category, -(int64)size);
+		free(memory);
+	}
+}
+
+internal void memory_expect_heap_begin()
+{
+	heapExpectedDepth += 1;
+}
+
+internal void memory_expect_heap_end()
+{
+	assert(heapExpectedDepth > 0);
+	heapExpectedDepth -= 1;
+}
+
+#ifndef NDEBUG
+// Debug builds count operator new too. Array, nothrow and sized forms of standard library end up in these.
+void * operator new(size_t size)
+{
+	void * memory = malloc(size > 0 ? size : 1);
+
+	// Exceptions are off in our build, so there is nothing to throw
+	if (memory == nullptr)
+	{
+		abort();
+	}
+
+	heapAllocationCount += 1;
+	heapUnexpectedAllocationCount += heapExpectedDepth == 0 ? 1 : 0;
+	return memory;
+}
+
+void operator delete(void * memory) noexcept
+{
+	free(memory);
+}
+#endif
+
+struct MemoryArena
+{
+	uint8 * memory;
+	size_t 	capacity;
+	size_t 	used;
+	size_t 	highWaterMark;
+};
+
+internal void arena_initialize(MemoryArena * arena, size_t capacity)
+{
+	*arena 			= {};
+	arena->memory 	= (uint8*)memory_heap_allocate(capacity, MEMORY_CATEGORY_FRAME_ARENA);
+	arena->capacity = arena->memory != nullptr ? capacity : 0;
+}
+
+internal void * arena_push(MemoryArena * arena, size_t size, size_t alignment = 16)
+{
+	size_t start = (arena->used + alignment - 1) & ~(alignment - 1);
+	if (start + size > arena->capacity)
+	{
+		return nullptr;
+	}
+
+	arena->used = start + size;
+	if (arena->used > arena->highWaterMark)
+	{
+		arena->highWaterMark = arena->used;
+	}
+
+	return arena->memory + start;
+}
+
+template<typename T>
+internal T * arena_push_array(MemoryArena * arena, size_t count)
+{
+	return (T*)arena_push(arena, count * sizeof(T), alignof(T));
+}
+
+internal void arena_reset(MemoryArena * arena)
+{
+	arena->used = 0;
+}
+
+// Pages come back zeroed when touched again. Arena is still counted at full capacity, next frame takes them right back.
+internal size_t arena_decommit(MemoryArena * arena)
+{
+	uintptr_t pageSize 	= (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t start 	= ((uintptr_t)arena->memory + arena->used + pageSize - 1) & ~(pageSize - 1);
+	uintptr_t end 		= ((uintptr_t)arena->memory + arena->capacity) & ~(pageSize - 1);
+
+	if (arena->memory == nullptr || end <= start)
+	{
+		return 0;
+	}
+
+	if (madvise((void*)start, end - start, MADV_DONTNEED) != 0)
+	{
+		log_error("Failed to decommit arena");
+		return 0;
+	}
+
+	return end - start;
+}
+
+/// ----------------------------------------------------------------------------
+/// STB IMAGE ALLOCATIONS
+
+// Game thread sets this to its frame arena, other threads decode to heap
+internal thread_local MemoryArena * stbiArena;
+
+// stb_image only gives back pointer, so size and origin are kept in front of it
+struct alignas(16) StbiAllocationHeader
+{
+	size_t 	size;
+	bool32 	onHeap;
+};
+
+internal void * memory_stbi_malloc(size_t size)
+{
+	StbiAllocationHeader * header = nullptr;
+
+	if (stbiArena != nullptr)
+	{
+		header = (StbiAllocationHeader*)arena_push(stbiArena, sizeof(StbiAllocationHeader) + size);
+		if (header != nullptr)
+		{
+			header->onHeap = false;
+		}
+	}
+
+	if (header == nullptr)
+	{
+		header = (StbiAllocationHeader*)memory_heap_allocate(sizeof(StbiAllocationHeader) + size, MEMORY_CATEGORY_IMAGE_DECODE);
+		if (header == nullptr)
+		{
+			return nullptr;
+		}
+		header->onHeap = true;
+	}
+
+	header->size = size;
+	return header + 1;
+}
+
+internal bool32 memory_stbi_is_last_in_arena(StbiAllocationHeader * header)
+{
+	return header->onHeap == false
+		&& (uint8*)(header + 1) + header->size == stbiArena->memory + stbiArena->used;
+}
+
+internal void memory_stbi_free(void * memory)
+{
+	if (memory == nullptr)
+	{
+		return;
+	}
+
+	StbiAllocationHeader * header = (StbiAllocationHeader*)memory - 1;
+	if (header->onHeap)
+	{
+		memory_heap_free(header, sizeof(StbiAllocationHeader) + header->size, MEMORY_CATEGORY_IMAGE_DECODE);
+	}
+	else if (memory_stbi_is_last_in_arena(header))
+	{
+		stbiArena->used = (uint8*)header - stbiArena->memory;
+	}
+}
+
+internal void * memory_stbi_realloc(void * memory, size_t size)
+{
+	if (memory == nullptr)
+	{
+		return memory_stbi_malloc(size);
+	}
+
+	// stb_image grows its decode buffer a lot, and usually it is last allocation
+	StbiAllocationHeader * header = (StbiAllocationHeader*)memory - 1;
+	if (memory_stbi_is_last_in_arena(header))
+	{
+		size_t end = ((uint8*)memory - stbiArena->memory) + size;
+		if (end <= stbiArena->capacity)
+		{
+			stbiArena->used = end;
+			if (end > stbiArena->highWaterMark)
+			{
+				stbiArena->highWaterMark = end;
+			}
+			header->size = size;
+			return memory;
+		}
+	}
+
+	void * newMemory = memory_stbi_malloc(size);
+	if (newMemory != nullptr)
+	{
+		memcpy(newMemory, memory, header->size < size ? header->size : size);
+		memory_stbi_free(memory);
+	}
+	return newMemory;
+}
@@ -0,0 +1,502 @@
+/// ----------------------------------------------------------------------------
+/// PNG WRITER
+
+/*
+Rows are split to bands that are filtered and deflated in their own jobs, like pigz does.
+Each band is its own IDAT, primed with 32 KiB of filtered data before it as dictionary.
+Adler-32 is combined from bands and written last in its own small IDAT.
+*/
+
+#include <zlib.h>
+
+constexpr int32 pngBytesPerPixel 		= 3;
+constexpr int32 pngCompressionLevel 	= 6;
+constexpr int32 pngDeflateWindowSize 	= 32 * 1024;
+
+enum PngFilter : uint8
+{
+	PNG_FILTER_NONE,
+	PNG_FILTER_SUB,
+	PNG_FILTER_UP,
+	PNG_FILTER_AVERAGE,
+	PNG_FILTER_PAETH,
+
+	PNG_FILTER_COUNT
+};
+
+// Blocks of 8 bytes, so that 16 bit lanes fill exactly one 128 bit register
+typedef uint8 uint8x8 __attribute__((vector_size(8)));
+typedef int8_t int8x8 __attribute__((vector_size(8)));
+typedef int16_t int16x8 __attribute__((vector_size(16)));
+typedef uint16 uint16x8 __attribute__((vector_size(16)));
+
+// 'a' is left of 'x', 'b' above and 'c' above left
+internal uint8 png_filter_byte(int32 filter, int32 x, int32 a, int32 b, int32 c)
+{
+	switch(filter)
+	{
+		case PNG_FILTER_SUB: 		return (uint8)(x - a);
+		case PNG_FILTER_UP: 		return (uint8)(x - b);
+		case PNG_FILTER_AVERAGE: 	return (uint8)(x - ((a + b) >> 1));
+		case PNG_FILTER_PAETH:
+		{
+			int32 pa = abs(b - c);
+			int32 pb = abs(a - c);
+			int32 pc = abs(a + b - 2 * c);
+			int32 predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+			return (uint8)(x - predictor);
+		}
+		default: 					return (uint8)x;
+	}
+}
+
+internal int16x8 png_abs(int16x8 value)
+{
+	int16x8 sign = value >> 15;
+	return (value ^ sign) - sign;
+}
+
+internal uint8x8 png_filter_block(int32 filter, int16x8 x, int16x8 a, int16x8 b, int16x8 c)
+{
+	int16x8 predictor;
+	switch(filter)
+	{
+		case PNG_FILTER_SUB: 		predictor = a; break;
+		case PNG_FILTER_UP: 		predictor = b; break;
+		case PNG_FILTER_AVERAGE: 	predictor = (a + b) >> 1; break;
+		case PNG_FILTER_PAETH:
+		{
+			int16x8 pa = png_abs(b - c);
+			int16x8 pb = png_abs(a - c);
+			int16x8 pc = png_abs(a + b - c - c);
+
+			int16x8 useA = (pa <= pb) & (pa <= pc);
+			int16x8 useB = ~useA & (pb <= pc);
+			int16x8 useC = ~(useA | useB);
+			predictor = (a & useA) | (b & useB) | (c & useC);
+		} break;
+		default: 					predictor = int16x8{}; break;
+	}
+	return __builtin_convertvector(x - predictor, uint8x8);
+}
+
+internal int16x8 png_load_block(uint8 const * bytes)
+{
+	uint8x8 block;
+	memcpy(&block, bytes, sizeof(block));
+	return __builtin_convertvector(block, int16x8);
+}
+
+internal void png_filter_row(uint8 const * row, uint8 const * previousRow, int32 rowSize, uint8 * out, uint8 const * zeroRow)
+{
+	constexpr int32 bpp 	= pngBytesPerPixel;
+	constexpr int32 block 	= 8;
+
+	if (previousRow == nullptr)
+	{
+		previousRow = zeroRow;
+	}
+
+	// Whole blocks that have a full pixel on their left, rest is done one byte at a time
+	int32 blockEnd = bpp + (rowSize - bpp) / block * block;
+
+	// Sum of absolute values of filtered bytes as signed, smallest wins, like libpng
+	uint32 sums [PNG_FILTER_COUNT] = {};
+
+	for (int32 i = 0; i < rowSize; ++i)
+	{
+		if (i >= bpp && i < blockEnd)
+		{
+			i = blockEnd - 1;
+			continue;
+		}
+
+		int32 a = i >= bpp ? row[i - bpp] : 0;
+		int32 c = i >= bpp ? previousRow[i - bpp] : 0;
+		for (int32 filter = 0; filter < PNG_FILTER_COUNT; ++filter)
+		{
+			sums[filter] += abs((int8_t)png_filter_byte(filter, row[i], a, previousRow[i], c));
+		}
+	}
+
+	// 16 bit lanes can take 256 blocks of 128 before they overflow
+	uint16x8 blockSums [PNG_FILTER_COUNT] = {};
+	int32 blocksSinceReduce = 0;
+
+	auto reduce_block_sums = [&sums, &blockSums]()
+	{
+		for (int32 filter = 0; filter < PNG_FILTER_COUNT; ++filter)
+		{
+			for (int32 lane = 0; lane < block; ++lane)
+			{
+				sums[filter] += blockSums[filter][lane];
+			}
+			blockSums[filter] = uint16x8{};
+		}
+	};
+
+	for (int32 i = bpp; i < blockEnd; i += block)
+	{
+		int16x8 x = png_load_block(row + i);
+		int16x8 a = png_load_block(row + i - bpp);
+		int16x8 b = png_load_block(previousRow + i);
+		int16x8 c = png_load_block(previousRow + i - bpp);
+
+		for (int32 filter = 0; filter < PNG_FILTER_COUNT; ++filter)
+		{
+			int8x8 filtered = (int8x8)png_filter_block(filter, x, a, b, c);
+			blockSums[filter] += (uint16x8)png_abs(__builtin_convertvector(filtered, int16x8));
+		}
+
+		blocksSinceReduce += 1;
+		if (blocksSinceReduce == 256)
+		{
+			reduce_block_sums();
+			blocksSinceReduce = 0;
+		}
+	}
+	reduce_block_sums();
+
+	int32 bestFilter = PNG_FILTER_NONE;
+	for (int32 filter = 1; filter < PNG_FILTER_COUNT; ++filter)
+	{
+		if (sums[filter] < sums[bestFilter])
+		{
+			bestFilter = filter;
+		}
+	}
+
+	out[0] = (uint8)bestFilter;
+	uint8 * outBytes = out + 1;
+
+	for (int32 i = 0; i < rowSize; ++i)
+	{
+		if (i >= bpp && i < blockEnd)
+		{
+			int16x8 x = png_load_block(row + i);
+			int16x8 a = png_load_block(row + i - bpp);
+			int16x8 b = png_load_block(previousRow + i);
+			int16x8 c = png_load_block(previousRow + i - bpp);
+
+			uint8x8 filtered = png_filter_block(bestFilter, x, a, b, c);
+			memcpy(outBytes + i, &filtered, block);
+
+			i += block - 1;
+			continue;
+		}
+
+		int32 a = i >= bpp ? row[i - bpp] : 0;
+		int32 c = i >= bpp ? previousRow[i - bpp] : 0;
+		outBytes[i] = png_filter_byte(bestFilter, row[i], a, previousRow[i], c);
+	}
+}
+
+internal void png_pack_rgb_row(uint8 const * rgbaRow, int32 width, uint8 * rgbRow)
+{
+	for (int32 x = 0; x < width; ++x)
+	{
+		rgbRow[x * 3 + 0] = rgbaRow[x * 4 + 0];
+		rgbRow[x * 3 + 1] = rgbaRow[x * 4 + 1];
+		rgbRow[x * 3 + 2] = rgbaRow[x * 4 + 2];
+	}
+}
+
+internal void png_write_uint32(uint8 * bytes, uint32 value)
+{
+	bytes[0] = (uint8)(value >> 24);
+	bytes[1] = (uint8)(value >> 16);
+	bytes[2] = (uint8)(value >> 8);
+	bytes[3] = (uint8)value;
+}
+
+struct PngEncoder;
+
+struct PngBand
+{
+	PngEncoder * encoder;
+	int32 		firstRow;
+	int32 		rowCount;
+	bool32 		last;
+
+	// Whole IDAT chunk, with length, type and crc
+	uint8 * 	chunk;
+	size_t 		chunkCapacity;
+	size_t 		chunkSize;
+
+	uLong 		adler;
+	size_t 		filteredSize;
+	bool32 		failed;
+};
+
+struct PngEncoder
+{
+	uint8 const * 	pixels;
+	int32 			width;
+	int32 			height;
+	int32 			rowSize;
+
+	static constexpr int maxBandCount 		= 128;
+	static constexpr int minBandSize 		= 256 * 1024;
+	PngBand 		bands [maxBandCount];
+	int32 			bandCount;
+};
+
+internal void png_filter_rows(PngEncoder const * encoder, int32 firstRow, int32 endRow, uint8 * out, uint8 * rowMemory)
+{
+	int32 rowSize 			= encoder->rowSize;
+	uint8 * previousRow 	= rowMemory;
+	uint8 * row 			= rowMemory + rowSize;
+	uint8 const * zeroRow 	= rowMemory + rowSize * 2;
+
+	if (firstRow > 0)
+	{
+		png_pack_rgb_row(encoder->pixels + (size_t)(firstRow - 1) * encoder->width * 4, encoder->width, previousRow);
+	}
+
+	for (int32 y = firstRow; y < endRow; ++y)
+	{
+		png_pack_rgb_row(encoder->pixels + (size_t)y * encoder->width * 4, encoder->width, row);
+		png_filter_row(row, y > 0 ? previousRow : nullptr, rowSize, out, zeroRow);
+		out += rowSize + 1;
+
+		uint8 * swap 	= previousRow;
+		previousRow 	= row;
+		row 			= swap;
+	}
+}
+
+internal void png_encode_band_job(void * data)
+{
+	PROFILE_SCOPE("png_encode_band_job");
+
+	PngBand * band 				= (PngBand*)data;
+	PngEncoder const * encoder 	= band->encoder;
+
+	int32 filteredRowSize 	= encoder->rowSize + 1;
+	int32 dictionaryRows 	= (pngDeflateWindowSize + filteredRowSize - 1) / filteredRowSize;
+	dictionaryRows 			= dictionaryRows < band->firstRow ? dictionaryRows : band->firstRow;
+
+	size_t dictionarySize 	= (size_t)dictionaryRows * filteredRowSize;
+	band->filteredSize 		= (size_t)band->rowCount * filteredRowSize;
+
+	// Previous, current and a zero row, then filtered dictionary rows and band rows
+	size_t memorySize 	= (size_t)encoder->rowSize * 3 + dictionarySize + band->filteredSize;
+	uint8 * memory 		= (uint8*)memory_heap_allocate(memorySize, MEMORY_CATEGORY_EXPORT);
+	if (memory == nullptr)
+	{
+		band->failed = true;
+		return;
+	}
+
+	uint8 * rowMemory 	= memory;
+	uint8 * filtered 	= memory + (size_t)encoder->rowSize * 3;
+	memset(rowMemory + encoder->rowSize * 2, 0, encoder->rowSize);
+
+	png_filter_rows(encoder, band->firstRow - dictionaryRows, band->firstRow + band->rowCount, filtered, rowMemory);
+
+	uint8 const * dictionary 	= filtered;
+	uint8 const * bandData 		= filtered + dictionarySize;
+	if (dictionarySize > (size_t)pngDeflateWindowSize)
+	{
+		dictionary 		+= dictionarySize - pngDeflateWindowSize;
+		dictionarySize 	= pngDeflateWindowSize;
+	}
+
+	band->adler = adler32(1, bandData, band->filteredSize);
+
+	z_stream stream = {};
+	bool32 ok = deflateInit2(&stream, pngCompressionLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+	if (ok && dictionarySize > 0)
+	{
+		ok = deflateSetDictionary(&stream, dictionary, dictionarySize) == Z_OK;
+	}
+
+	size_t headerSize 	= band->firstRow == 0 ? 2 : 0;
+	band->chunkCapacity = 8 + headerSize + deflateBound(&stream, band->filteredSize) + 16 + 4;
+	band->chunk 		= ok ? (uint8*)memory_heap_allocate(band->chunkCapacity, MEMORY_CATEGORY_EXPORT) : nullptr;
+
+	if (band->chunk != nullptr)
+	{
+		uint8 * data = band->chunk + 8;
+		if (headerSize > 0)
+		{
+			data[0] = 0x78;
+			data[1] = 0x9c;
+		}
+
+		stream.next_in 		= (Bytef*)bandData;
+		stream.avail_in 	= band->filteredSize;
+		stream.next_out 	= data + headerSize;
+		stream.avail_out 	= band->chunkCapacity - 8 - headerSize - 4;
+
+		// Sync flush ends band at byte boundary without ending stream, so next band can follow
+		int result 	= deflate(&stream, band->last ? Z_FINISH : Z_SYNC_FLUSH);
+		ok 			= band->last ? result == Z_STREAM_END : (result == Z_OK && stream.avail_in == 0);
+
+		size_t dataSize = headerSize + stream.total_out;
+		memcpy(band->chunk + 4, "IDAT", 4);
+		png_write_uint32(band->chunk, (uint32)dataSize);
+		png_write_uint32(band->chunk + 8 + dataSize, crc32(0, band->chunk + 4, 4 + dataSize));
+		band->chunkSize = 8 + dataSize + 4;
+	}
+
+	deflateEnd(&stream);
+	memory_heap_free(memory, memorySize, MEMORY_CATEGORY_EXPORT);
+
+	band->failed = ok == false || band->chunk == nullptr;
+}
+
+// 'pixels' are RGBA rows from top to bottom, and must stay until encoder is freed
+internal bool32 png_encode(PngEncoder * encoder, JobSystem * jobs, uint8 const * pixels, int32 width, int32 height)
+{
+	PROFILE_SCOPE("png_encode");
+
+	*encoder 			= {};
+	encoder->pixels 	= pixels;
+	encoder->width 		= width;
+	encoder->height 	= height;
+	encoder->rowSize 	= width * pngBytesPerPixel;
+
+	int32 rowsPerBand = (encoder->minBandSize + encoder->rowSize - 1) / encoder->rowSize;
+	if (rowsPerBand * encoder->maxBandCount < height)
+	{
+		rowsPerBand = (height + encoder->maxBandCount - 1) / encoder->maxBandCount;
+	}
+
+	JobCounter counter = {};
+	for (int32 firstRow = 0; firstRow < height; firstRow += rowsPerBand)
+	{
+		PngBand * band 	= &encoder->bands[encoder->bandCount];
+		encoder->bandCount += 1;
+
+		band->encoder 	= encoder;
+		band->firstRow 	= firstRow;
+		band->rowCount 	= height - firstRow < rowsPerBand ? height - firstRow : rowsPerBand;
+		band->last 		= firstRow + band->rowCount == height;
+
+		job_run(jobs, png_encode_band_job, band, &counter);
+	}
+	job_wait(jobs, &counter);
+
+	for (int32 i = 0; i < encoder->bandCount; ++i)
+	{
+		if (encoder->bands[i].failed)
+		{
+			log_error("Png band could not be encoded");
+			return false;
+		}
+	}
+	return true;
+}
+
+internal void png_encoder_free(PngEncoder * encoder)
+{
+	for (int32 i = 0; i < encoder->bandCount; ++i)
+	{
+		memory_heap_free(encoder->bands[i].chunk, encoder->bands[i].chunkCapacity, MEMORY_CATEGORY_EXPORT);
+		encoder->bands[i].chunk = nullptr;
+	}
+}
+
+internal size_t png_encoder_file_size(PngEncoder const * encoder)
+{
+	size_t size = 8 + (12 + 13) + (12 + 4) + 12;
+	for (int32 i = 0; i < encoder->bandCount; ++i)
+	{
+		size += encoder->bands[i].chunkSize;
+	}
+	return size;
+}
+
+internal bool32 png_write_all(int file, void const * data, size_t size)
+{
+	uint8 const * bytes = (uint8 const *)data;
+	while (size > 0)
+	{
+		ssize_t written = write(file, bytes, size);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		bytes 	+= written;
+		size 	-= written;
+	}
+	return true;
+}
+
+internal bool32 png_write_chunk(int file, char const * type, uint8 const * data, uint32 size)
+{
+	uint8 chunk [8 + 16 + 4];
+	assert(size <= 16);
+
+	png_write_uint32(chunk, size);
+	memcpy(chunk + 4, type, 4);
+	memcpy(chunk + 8, data, size);
+	png_write_uint32(chunk + 8 + size, crc32(0, chunk + 4, 4 + size));
+
+	return png_write_all(file, chunk, 8 + size + 4);
+}
+
+// Written to a temporary file and renamed, so 'path' is never half written
+internal bool32 png_encoder_write(PngEncoder const * encoder, char const * path)
+{
+	PROFILE_SCOPE("png_encoder_write");
+
+	char temporaryPath [256];
+	snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+
+	int file = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (file < 0)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not create %s, error = %d", temporaryPath, errno);
+		return false;
+	}
+
+	uint8 const signature [] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+	// 8 bits, RGB, deflate, adaptive filtering, no interlace
+	uint8 header [13];
+	png_write_uint32(header, encoder->width);
+	png_write_uint32(header + 4, encoder->height);
+	header[8] 	= 8;
+	header[9] 	= 2;
+	header[10] 	= 0;
+	header[11] 	= 0;
+	header[12] 	= 0;
+
+	uLong adler = encoder->bands[0].adler;
+	for (int32 i = 1; i < encoder->bandCount; ++i)
+	{
+		adler = adler32_combine(adler, encoder->bands[i].adler, encoder->bands[i].filteredSize);
+	}
+
+	uint8 adlerBytes [4];
+	png_write_uint32(adlerBytes, (uint32)adler);
+
+	bool32 ok = png_write_all(file, signature, sizeof(signature))
+				&& png_write_chunk(file, "IHDR", header, sizeof(header));
+
+	for (int32 i = 0; ok && i < encoder->bandCount; ++i)
+	{
+		ok = png_write_all(file, encoder->bands[i].chunk, encoder->bands[i].chunkSize);
+	}
+
+	ok = ok && png_write_chunk(file, "IDAT", adlerBytes, sizeof(adlerBytes))
+			&& png_write_chunk(file, "IEND", nullptr, 0)
+			&& fsync(file) == 0;
+
+	close(file);
+
+	if (ok == false || rename(temporaryPath, path) != 0)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not write %s, error = %d", path, errno);
+		unlink(temporaryPath);
+		return false;
+	}
+
+	return true;
+}
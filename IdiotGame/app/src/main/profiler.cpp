@@ -0,0 +1,243 @@
+/// ----------------------------------------------------------------------------
+/// PROFILER
+
+/*
+Scoped timers and per frame counters, written out as Chrome trace json. Each thread has its
+own ring buffer, so there are no locks. Compiles to nothing in release builds.
+*/
+
+#ifndef NDEBUG
+#	define PROFILER_ENABLED 1
+#else
+#	define PROFILER_ENABLED 0
+#endif
+
+enum ProfilerCounter
+{
+	PROFILER_COUNTER_FRAME_TIME_US,
+	PROFILER_COUNTER_DABS,
+	PROFILER_COUNTER_DRAW_CALLS,
+	PROFILER_COUNTER_GPU_BYTES,
+	PROFILER_COUNTER_DRAW_QUEUE_DEPTH,
+	PROFILER_COUNTER_CARRIED_DABS,
+	PROFILER_COUNTER_PREDICTION_ERROR,
+	PROFILER_COUNTER_PUMPED_EVENTS,
+	PROFILER_COUNTER_HEAP_ALLOCATIONS,
+	PROFILER_COUNTER_FRAME_ARENA_BYTES,
+
+	PROFILER_COUNTER_COUNT
+};
+
+#if PROFILER_ENABLED
+
+#include <atomic>
+
+char const * profilerCounterNames [PROFILER_COUNTER_COUNT] =
+{
+	"frame time us",
+	"dabs",
+	"draw calls",
+	"estimated gpu bytes",
+	"draw queue depth",
+	"carried dabs",
+	"prediction error px",
+	"pumped events",
+	"heap allocations",
+	"frame arena peak bytes",
+};
+
+struct ProfilerEvent
+{
+	char const * 	name;
+	int64 			start;
+
+	// Counter events store their value here
+	int64 			duration;
+	bool32 			isCounter;
+};
+
+struct ProfilerThreadBuffer
+{
+	static constexpr int capacity = 8 * 1024;
+
+	ProfilerEvent 		events [capacity];
+	std::atomic<uint32> writeCount;
+	int32 				threadId;
+};
+
+struct Profiler
+{
+	static constexpr int maxThreadCount = 16;
+
+	ProfilerThreadBuffer 	threads [maxThreadCount];
+	std::atomic<int32> 		threadCount;
+
+	// Game thread only
+	int64 					counters [PROFILER_COUNTER_COUNT];
+};
+
+internal Profiler profiler;
+internal thread_local ProfilerThreadBuffer * profilerThreadBuffer;
+
+internal ProfilerThreadBuffer * profiler_get_thread_buffer()
+{
+	if (profilerThreadBuffer == nullptr)
+	{
+		int32 index = profiler.threadCount.fetch_add(1);
+		if (index >= profiler.maxThreadCount)
+		{
+			return nullptr;
+		}
+
+		profilerThreadBuffer 			= &profiler.threads[index];
+		profilerThreadBuffer->threadId 	= gettid();
+	}
+	return profilerThreadBuffer;
+}
+
+internal void profiler_record(char const * name, int64 start, int64 duration, bool32 isCounter)
+{
+	ProfilerThreadBuffer * buffer = profiler_get_thread_buffer();
+	if (buffer == nullptr)
+	{
+		return;
+	}
+
+	uint32 index = buffer->writeCount.load(std::memory_order_relaxed);
+	buffer->events[index % buffer->capacity] = {name, start, duration, isCounter};
+	buffer->writeCount.store(index + 1, std::memory_order_release);
+}
+
+struct ProfilerScope
+{
+	char const * 	name;
+	int64 			start;
+
+	ProfilerScope(char const * name) : name(name), start(time_now_nanoseconds()) {}
+	~ProfilerScope() { profiler_record(name, start, time_now_nanoseconds() - start, false); }
+};
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+
+#define PROFILE_SCOPE(name) ProfilerScope PROFILER_CONCAT(profilerScope, __LINE__) (name)
+#define PROFILER_ADD(counter, value) (profiler.counters[counter] += (value))
+#define PROFILER_SET(counter, value) (profiler.counters[counter] = (value))
+
+internal void profiler_end_frame()
+{
+	int64 now = time_now_nanoseconds();
+	for (int counterIndex = 0; counterIndex < PROFILER_COUNTER_COUNT; ++counterIndex)
+	{
+		profiler_record(profilerCounterNames[counterIndex], now, profiler.counters[counterIndex], true);
+		profiler.counters[counterIndex] = 0;
+	}
+}
+
+internal void profiler_measure_overhead()
+{
+	ProfilerThreadBuffer * buffer = profiler_get_thread_buffer();
+	if (buffer == nullptr)
+	{
+		return;
+	}
+
+	constexpr int iterationCount = 1000;
+
+	uint32 writeCount 	= buffer->writeCount.load(std::memory_order_relaxed);
+	int64 start 		= time_now_nanoseconds();
+	for (int i = 0; i < iterationCount; ++i)
+	{
+		PROFILE_SCOPE("profiler overhead");
+	}
+	int64 duration 		= time_now_nanoseconds() - start;
+	buffer->writeCount.store(writeCount, std::memory_order_release);
+
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Profiler overhead is %.1f ns per scope", (double)duration / iterationCount);
+}
+
+// Other threads may write while we read, so events that wrap meanwhile may come out garbled
+internal void profiler_write_chrome_trace(char const * directory)
+{
+	char path [256];
+	snprintf(path, sizeof(path), "%s/trace.json", directory);
+
+	int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (file == -1)
+	{
+		__android_log_print(ANDROID_LOG_ERROR, "Game", "Could not open trace file %s, error = %d", path, errno);
+		return;
+	}
+
+	constexpr int bufferCapacity = 64 * 1024;
+	char buffer [bufferCapacity];
+	int bufferCount = 0;
+
+	auto flush = [&]()
+	{
+		write(file, buffer, bufferCount);
+		bufferCount = 0;
+	};
+
+	bufferCount += snprintf(buffer, bufferCapacity, "{\"traceEvents\":[\n");
+
+	bool32 first 	= true;
+	int32 threadCount = profiler.threadCount.load();
+	if (threadCount > profiler.maxThreadCount)
+	{
+		threadCount = profiler.maxThreadCount;
+	}
+
+	for (int32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		ProfilerThreadBuffer & thread = profiler.threads[threadIndex];
+
+		uint32 writeCount 	= thread.writeCount.load(std::memory_order_acquire);
+		uint32 readStart 	= writeCount > (uint32)thread.capacity ? writeCount - thread.capacity : 0;
+
+		for (uint32 i = readStart; i < writeCount; ++i)
+		{
+			ProfilerEvent event = thread.events[i % thread.capacity];
+
+			// Leave room for one event
+			if (bufferCount > bufferCapacity - 256)
+			{
+				flush();
+			}
+
+			char const * separator = first ? "" : ",\n";
+			first = false;
+
+			if (event.isCounter)
+			{
+				bufferCount += snprintf(buffer + bufferCount, bufferCapacity - bufferCount,
+										"%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%lld}}",
+										separator, event.name, event.start / 1000.0, thread.threadId, (long long)event.duration);
+			}
+			else
+			{
+				bufferCount += snprintf(buffer + bufferCount, bufferCapacity - bufferCount,
+										"%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+										separator, event.name, event.start / 1000.0, event.duration / 1000.0, thread.threadId);
+			}
+		}
+	}
+
+	bufferCount += snprintf(buffer + bufferCount, bufferCapacity - bufferCount, "\n]}\n");
+	flush();
+	close(file);
+
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Wrote trace to %s", path);
+}
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILER_ADD(counter, value)
+#define PROFILER_SET(counter, value)
+
+internal void profiler_end_frame() {}
+internal void profiler_measure_overhead() {}
+internal void profiler_write_chrome_trace(char const *) {}
+
+#endif
@@ -0,0 +1,456 @@
+/// ----------------------------------------------------------------------------
+/// STROKE ENGINE
+
+/*
+Turns queued touch positions into brush dabs, for both live input and stroke log replay.
+Speed is measured with sample times stored in stroke log, so that it looks same at any input
+rate and replay gets exactly same speeds. Touch screens make up pressure and tilt for fingers,
+so for fingers only contact size is used.
+*/
+
+// Note(Leo): these map directly to values in brush shader, so explicitly define their values
+enum BrushMode : int32
+{
+	BRUSH_DRAW 	= 0,
+	BRUSH_ERASE = 1,
+};
+
+struct Dab
+{
+	v2 			position;
+	float 		size;
+	float 		gradientPosition;
+	BrushMode 	mode;
+	int32 		gradientIndex;
+	float 		opacity;
+};
+
+// Pressure and size are from 0 to 1, tilt is radians from perpendicular to screen
+struct StrokeDynamics
+{
+	float pressure;
+	float size;
+	float tilt;
+};
+
+constexpr StrokeDynamics strokeDynamicsNone = {1, 0, 0};
+
+struct DabBuffer
+{
+	Dab * 	dabs;
+	int32 	count;
+	int32 	capacity;
+
+	// Called when buffer is full, and must empty it
+	void 	(*flush)(void * data, DabBuffer * buffer);
+	void * 	flushData;
+};
+
+internal void push_dab(DabBuffer * buffer, Dab dab)
+{
+	if (buffer->count == buffer->capacity)
+	{
+		buffer->flush(buffer->flushData, buffer);
+	}
+
+	buffer->dabs[buffer->count] = dab;
+	buffer->count += 1;
+}
+
+internal void flush_dabs(DabBuffer * buffer)
+{
+	if (buffer->count > 0)
+	{
+		buffer->flush(buffer->flushData, buffer);
+	}
+}
+
+/*
+One Euro filter, see Casiez et al. 2012. Cutoff rises with how fast value changes, so slow
+changes are smooth and fast ones do not lag behind. Cutoffs are in hertz.
+*/
+struct SpeedFilter
+{
+	float 	value;
+	float 	derivative;
+	bool32 	initialized;
+};
+
+internal float speed_filter_alpha(float cutoff, float timeStep)
+{
+	// Exact exponential decay over 'timeStep', so that same span of time smooths same amount
+	// whatever the sample rate is. Usual dt / (dt + tau) approximation smooths more at high rates.
+	float timeConstant = 1.0f / (2 * 3.14159265f * cutoff);
+	return 1.0f - expf(-timeStep / timeConstant);
+}
+
+internal float speed_filter_update(SpeedFilter * filter, float rawValue, float timeStep)
+{
+	constexpr float minCutoff 				= 1.5f;
+	constexpr float cutoffPerSpeedChange 	= 0.0005f;
+	constexpr float derivativeCutoff 		= 1.0f;
+
+	if (filter->initialized == false)
+	{
+		filter->value 		= rawValue;
+		filter->derivative 	= 0;
+		filter->initialized = true;
+		return rawValue;
+	}
+
+	if (timeStep <= 0)
+	{
+		return filter->value;
+	}
+
+	float rawDerivative = (rawValue - filter->value) / timeStep;
+	filter->derivative 	= float_lerp(filter->derivative, rawDerivative, speed_filter_alpha(derivativeCutoff, timeStep));
+
+	float cutoff 		= minCutoff + cutoffPerSpeedChange * (filter->derivative < 0 ? -filter->derivative : filter->derivative);
+	filter->value 		= float_lerp(filter->value, rawValue, speed_filter_alpha(cutoff, timeStep));
+	return filter->value;
+}
+
+struct StrokeState
+{
+	static constexpr int drawPositionQueueCapacity = 10;
+
+	// Keep this many positions in queue so we can compute tangent from the one after
+	static constexpr int drawPositionQueueDequeueCount = 3;
+
+	v2 		drawPositionQueue [drawPositionQueueCapacity];
+	int 	drawPositionQueueCount;
+	bool32 	drawPositionQueueRefreshed;
+
+	v2 		lastDequedDrawPosition;
+	v2 		beginPosition;
+
+	StrokeDynamics 	drawDynamicsQueue [drawPositionQueueCapacity];
+	StrokeDynamics 	lastDequedDynamics;
+	StrokeDynamics 	beginDynamics;
+	bool32 			stylus;
+
+	// Seconds since stroke began
+	float 	time;
+	float 	drawTimeQueue [drawPositionQueueCapacity];
+	float 	lastDequedDrawTime;
+
+	SpeedFilter speed;
+
+	BrushMode 	brushMode;
+	int32 		gradientIndex;
+
+	bool 	strokeMoved;
+	float 	strokeWidth;
+
+	float 	currentStrokeLength;
+	float 	lastStrokeSectionLength;
+	float 	currentStrokeColourSelection;
+	float 	currentStrokeWidthScale;
+};
+
+// Pixels per second at which gradient reaches its end and stroke is thinnest
+constexpr float strokeMaxSpeed 			= 3000;
+constexpr float strokeMinWidthScale 	= 0.6f;
+
+internal float stroke_width_scale(float speedSelection)
+{
+	return float_lerp(1, strokeMinWidthScale, speedSelection);
+}
+
+// Finger contact is compared to touch down, since its size varies between people
+internal float stroke_dynamics_width_scale(StrokeState const * stroke, StrokeDynamics dynamics)
+{
+	if (stroke->stylus)
+	{
+		float tiltFraction = float_clamp(dynamics.tilt / (0.5f * 3.14159265f), 0, 1);
+		return float_lerp(0.3f, 1.0f, float_clamp(dynamics.pressure, 0, 1)) * (1 + 0.6f * tiltFraction);
+	}
+
+	if (stroke->beginDynamics.size > 0 && dynamics.size > 0)
+	{
+		return float_clamp(dynamics.size / stroke->beginDynamics.size, 0.7f, 1.4f);
+	}
+	return 1;
+}
+
+internal float stroke_dynamics_opacity(StrokeState const * stroke, StrokeDynamics dynamics)
+{
+	return stroke->stylus ? float_lerp(0.4f, 1.0f, float_clamp(dynamics.pressure, 0, 1)) : 1;
+}
+
+// 'startWidth' is used only if stroke starts moving during this call
+internal void update_stroke(StrokeState * stroke, v2 oneBeforeStrokeStart, v2 strokeStart, v2 strokeEnd, v2 oneAfterStrokeEnd,
+							StrokeDynamics startDynamics, StrokeDynamics endDynamics,
+							float timeStep, float startWidth, DabBuffer * dabs)
+{
+	PROFILE_SCOPE("update_stroke");
+
+		// Todo(Leo): Thoroughly evaluate this
+	constexpr float strokeStartMoveThreshold 	= 10;
+
+	float strokeLength = v2_magnitude(strokeEnd - strokeStart);
+
+	// Measured from where stroke began, since sections get shorter the more often we get samples
+	if (stroke->strokeMoved == false)
+	{
+		if (v2_magnitude(strokeEnd - stroke->beginPosition) >= strokeStartMoveThreshold)
+		{
+			stroke->strokeWidth 					= startWidth;
+			stroke->strokeMoved 					= true;
+			stroke->lastStrokeSectionLength 		= strokeLength;
+
+			// First section starts at its own speed, filter starts from it below
+			float speed = timeStep > 0 ? strokeLength / timeStep : 0;
+			stroke->currentStrokeColourSelection 	= float_clamp(speed / strokeMaxSpeed, 0, 1);
+			stroke->currentStrokeWidthScale 		= stroke_width_scale(stroke->currentStrokeColourSelection);
+		}
+		else
+		{
+			return;
+		}
+	}
+
+	/// --------------------------------------------------------
+
+	// Note(Leo): roughly a third, and half to account for averages of in and out tangents
+	float tangentScale = 0.16;
+
+	v2 startInTangent = (strokeStart - oneBeforeStrokeStart);
+	v2 startOutTangent = (strokeEnd - strokeStart);
+	v2 startTangent = (startInTangent + startOutTangent) * tangentScale;
+
+	v2 endInTangent = startOutTangent;
+	v2 endOutTangent = (oneAfterStrokeEnd - strokeEnd);
+	v2 endTangent = (endInTangent + endOutTangent) * tangentScale;
+
+	v2 a = strokeStart;
+	v2 b = strokeStart + startTangent;
+	v2 c = strokeEnd - endTangent;
+	v2 d = strokeEnd;
+
+	struct ArcLengthMapEntry
+	{
+		float length;
+		float t;
+	};
+	constexpr int precision = 10;
+	ArcLengthMapEntry arcLengthMap[precision] = {{0, 0}};
+
+	v2 previousArcPosition = strokeStart;
+	for (int i = 1; i < precision; ++i)
+	{
+		float t 			= (float)i / (precision - 1);
+		v2 nextArcPosition 	= v2_cubic_bezier_lerp(a,b,c,d, t);
+		float arcLength 	= v2_magnitude(nextArcPosition - previousArcPosition);
+
+		arcLengthMap[i].length 	= arcLengthMap[i - 1].length + arcLength;
+		arcLengthMap[i].t 		= t;
+
+		previousArcPosition 	= nextArcPosition;
+	}
+
+	float totalArcLength = arcLengthMap[precision - 1].length;
+
+	// Chord and not arc, so that speed does not depend on tangents
+	float speed 			= timeStep > 0 ? speed_filter_update(&stroke->speed, strokeLength / timeStep, timeStep) : stroke->speed.value;
+	float colourSelection 	= float_clamp(speed / strokeMaxSpeed, 0, 1);
+	float widthScale 		= stroke_width_scale(colourSelection);
+
+	float startDynamicsWidthScale 	= stroke_dynamics_width_scale(stroke, startDynamics);
+	float endDynamicsWidthScale 	= stroke_dynamics_width_scale(stroke, endDynamics);
+	float startOpacity 				= stroke_dynamics_opacity(stroke, startDynamics);
+	float endOpacity 				= stroke_dynamics_opacity(stroke, endDynamics);
+
+	// Spaced by narrowest end, so that thin end does not break into dots
+	float narrowestWidthScale 		= (widthScale < stroke->currentStrokeWidthScale ? widthScale : stroke->currentStrokeWidthScale)
+									* (startDynamicsWidthScale < endDynamicsWidthScale ? startDynamicsWidthScale : endDynamicsWidthScale);
+	float drawDotArcLengthThreshold = stroke->strokeWidth * narrowestWidthScale / 10;
+	int dotCount = static_cast<int>(totalArcLength / drawDotArcLengthThreshold);
+
+	for (int i = 0; i < dotCount; ++i)
+	{
+		// single dot would otherwise divide zero by zero
+		float t = dotCount > 1 ? static_cast<float>(i) / (dotCount - 1) : 0;
+		float targetArcLength = t * totalArcLength;
+
+		int index = 0;
+		while(arcLengthMap[index].length > targetArcLength)
+		{
+			index += 1;
+		}
+
+		auto previousArcPoint 	= arcLengthMap[index];
+		auto nextArcPoint 		= arcLengthMap[index + 1];
+
+		float tt = (targetArcLength - previousArcPoint.length) / (nextArcPoint.length - previousArcPoint.length);
+		t = float_lerp(previousArcPoint.t, nextArcPoint.t, tt);
+
+		v2 dotPosition = v2_cubic_bezier_lerp(a,b,c,d, t);
+
+		float colorInterpolationTime 	= float_lerp(stroke->currentStrokeColourSelection, colourSelection, t);
+		float dotWidth 					= stroke->strokeWidth
+										* float_lerp(stroke->currentStrokeWidthScale, widthScale, t)
+										* float_lerp(startDynamicsWidthScale, endDynamicsWidthScale, t);
+		float dotOpacity 				= float_lerp(startOpacity, endOpacity, t);
+		push_dab(dabs, {dotPosition, dotWidth, colorInterpolationTime, stroke->brushMode, stroke->gradientIndex, dotOpacity});
+	}
+
+	stroke->lastStrokeSectionLength 		= totalArcLength;
+	stroke->currentStrokeLength 			+= totalArcLength;
+	stroke->currentStrokeColourSelection 	= colourSelection;
+	stroke->currentStrokeWidthScale 		= widthScale;
+}
+
+internal void stroke_begin(StrokeState * stroke, v2 position, StrokeDynamics dynamics, bool32 stylus, BrushMode brushMode, int32 gradientIndex)
+{
+	stroke->drawPositionQueue[0] 			= position;
+	stroke->drawPositionQueueCount 			= 1;
+	stroke->drawPositionQueueRefreshed 		= true;
+	stroke->lastDequedDrawPosition 			= position;
+	stroke->beginPosition 					= position;
+
+	stroke->drawDynamicsQueue[0] 			= dynamics;
+	stroke->lastDequedDynamics 				= dynamics;
+	stroke->beginDynamics 					= dynamics;
+	stroke->stylus 							= stylus;
+
+	stroke->time 							= 0;
+	stroke->drawTimeQueue[0] 				= 0;
+	stroke->lastDequedDrawTime 				= 0;
+	stroke->speed 							= {};
+
+	stroke->brushMode 						= brushMode;
+	stroke->gradientIndex 					= gradientIndex;
+
+	stroke->strokeMoved 					= false;
+	stroke->currentStrokeLength 			= 0;
+	stroke->lastStrokeSectionLength 		= 0;
+	stroke->currentStrokeColourSelection 	= 0;
+	stroke->currentStrokeWidthScale 		= 1;
+}
+
+// Call before anything else that happened at that time
+internal void stroke_advance_time(StrokeState * stroke, float seconds)
+{
+	stroke->time += seconds;
+}
+
+// Without enough positions queued for lookahead tangent, last known position is used instead
+internal void stroke_dequeue(StrokeState * stroke, float startWidth, DabBuffer * dabs)
+{
+	v2 * queue 					= stroke->drawPositionQueue;
+	float * times 				= stroke->drawTimeQueue;
+	StrokeDynamics * dynamics 	= stroke->drawDynamicsQueue;
+	int last 					= stroke->drawPositionQueueCount - 1;
+
+	update_stroke(	stroke,
+					stroke->lastDequedDrawPosition,
+					queue[0],
+					queue[last < 1 ? last : 1],
+					queue[last < 2 ? last : 2],
+					dynamics[0],
+					dynamics[last < 1 ? last : 1],
+					times[last < 1 ? last : 1] - times[0],
+					startWidth,
+					dabs);
+
+	stroke->drawPositionQueueCount -= 1;
+	stroke->lastDequedDrawPosition 	= queue[0];
+	stroke->lastDequedDrawTime 		= times[0];
+	stroke->lastDequedDynamics 		= dynamics[0];
+
+	for (int i = 0; i < stroke->drawPositionQueueCount; ++i)
+	{
+		queue[i] 	= queue[i + 1];
+		times[i] 	= times[i + 1];
+		dynamics[i] = dynamics[i + 1];
+	}
+}
+
+internal void stroke_queue_position(StrokeState * stroke, v2 position, StrokeDynamics dynamics, float startWidth, DabBuffer * dabs)
+{
+	stroke->drawPositionQueue[stroke->drawPositionQueueCount] 	= position;
+	stroke->drawTimeQueue[stroke->drawPositionQueueCount] 		= stroke->time;
+	stroke->drawDynamicsQueue[stroke->drawPositionQueueCount] 	= dynamics;
+	stroke->drawPositionQueueCount 								+= 1;
+	stroke->drawPositionQueueRefreshed 							= true;
+
+	while(stroke->drawPositionQueueCount > stroke->drawPositionQueueDequeueCount)
+	{
+		stroke_dequeue(stroke, startWidth, dabs);
+	}
+}
+
+// 'width' is used only for a stroke that never moved, and is thus a single dot
+internal void stroke_end(StrokeState * stroke, float width, DabBuffer * dabs)
+{
+	if (stroke->strokeMoved == false)
+	{
+		bool32 queued 			= stroke->drawPositionQueueCount > 0;
+		v2 position 			= queued ? stroke->drawPositionQueue[0] : stroke->lastDequedDrawPosition;
+		StrokeDynamics dynamics = queued ? stroke->drawDynamicsQueue[0] : stroke->lastDequedDynamics;
+
+		push_dab(dabs, {position, width * stroke_dynamics_width_scale(stroke, dynamics), 0, stroke->brushMode,
+						stroke->gradientIndex, stroke_dynamics_opacity(stroke, dynamics)});
+		stroke->drawPositionQueueCount = 0;
+	}
+	else
+	{
+		while (stroke->drawPositionQueueCount > 0)
+		{
+			stroke_dequeue(stroke, width, dabs);
+		}
+	}
+}
+
+/*
+Constant acceleration from last three positions. Touch samples are noisy and acceleration
+overshoots easily, so guess may not reach further than last step did.
+*/
+internal v2 stroke_predict_next_position(StrokeState const * stroke)
+{
+	v2 const * queue 	= stroke->drawPositionQueue;
+	int count 			= stroke->drawPositionQueueCount;
+
+	v2 p2 = count > 0 ? queue[count - 1] : stroke->lastDequedDrawPosition;
+	v2 p1 = count > 1 ? queue[count - 2] : stroke->lastDequedDrawPosition;
+	v2 p0 = count > 2 ? queue[count - 3] : p1;
+
+	v2 velocity 	= p2 - p1;
+	v2 acceleration = velocity - (p1 - p0);
+	v2 step 		= velocity + acceleration;
+
+	float maxStepLength = v2_magnitude(velocity);
+	float stepLength 	= v2_magnitude(step);
+	if (stepLength > maxStepLength && stepLength > 0)
+	{
+		step = step * (maxStepLength / stepLength);
+	}
+
+	return p2 + step;
+}
+
+/*
+Part of stroke still waiting in queue for lookahead, plus predicted position after it. Drawn
+from a copy, and caller should draw these somewhere transient.
+*/
+internal void stroke_draw_wet_tail(StrokeState const * stroke, v2 predictedPosition, float startWidth, DabBuffer * dabs)
+{
+	StrokeState wet = *stroke;
+
+	// Prediction assumes same step as last one, so also same time
+	int count 				= wet.drawPositionQueueCount;
+	float lastTime 			= count > 0 ? wet.drawTimeQueue[count - 1] : wet.lastDequedDrawTime;
+	float previousTime 		= count > 1 ? wet.drawTimeQueue[count - 2] : wet.lastDequedDrawTime;
+	wet.time 				= lastTime + (lastTime - previousTime);
+
+	StrokeDynamics lastDynamics = count > 0 ? wet.drawDynamicsQueue[count - 1] : wet.lastDequedDynamics;
+	stroke_queue_position(&wet, predictedPosition, lastDynamics, startWidth, dabs);
+
+	// Unmoved stroke would end as a dot, but it is not certain to be one yet
+	if (wet.strokeMoved)
+	{
+		stroke_end(&wet, startWidth, dabs);
+	}
+}
@@ -0,0 +1,433 @@
+/// ----------------------------------------------------------------------------
+/// STROKE LOG
+
+/*
+This is the actual document, canvas texture is only a rasterized cache of it. Every position
+fed to stroke engine is appended here, so drawing can be replayed at any resolution. Memory
+is reserved once, so appending never allocates. Positions are in canvas size log was started
+with, which is also coordinate space of dabs.
+*/
+
+enum StrokeLogEntryType : uint8
+{
+	STROKE_LOG_BEGIN,	// Touch down, has first position
+	STROKE_LOG_SAMPLE,	// Touch moved
+	STROKE_LOG_FLUSH,	// Draw queue was dequeued without fresh input
+	STROKE_LOG_END,		// Touch up
+	STROKE_LOG_CLEAR,	// Canvas was cleared
+};
+
+struct StrokeLogEntry
+{
+	StrokeLogEntryType 	type;
+
+	// BEGIN: brush mode in low 3 bits, stylus in bit 3, gradient index in high 4 bits
+	// CLEAR: gradient index after clear in high 4 bits
+	uint8 				flags;
+
+	union
+	{
+		// BEGIN only. In 1/16ths of a pixel, written when stroke width is resolved
+		uint16 			width;
+
+		// Others. Time since previous entry in 1/10ths of a millisecond, saturated
+		uint16 			time;
+	};
+
+	uint16 				x;
+	uint16 				y;
+
+	// BEGIN and SAMPLE
+	uint8 				pressure;
+	uint8 				size;
+	uint8 				tilt;
+
+	// BEGIN only, since width takes its time. Time since previous entry in 1/100ths of a second, saturated
+	uint8 				beginPause;
+};
+static_assert(sizeof(StrokeLogEntry) == 12, "Keep stroke log entries compact");
+
+struct StrokeLog
+{
+	StrokeLogEntry * 	entries;
+	int32 				count;
+	int32 				capacity;
+
+	int32 				width;
+	int32 				height;
+
+	int32 				strokeBeginIndex;
+	bool32 				full;
+
+	// Nanoseconds, when last entry was recorded, and its time as stored
+	int64 				lastTime;
+	uint16 				lastTimeStep;
+};
+
+constexpr float strokeLogWidthPrecision = 16;
+constexpr float strokeLogPositionRange 	= 65535;
+constexpr int64 strokeLogTimeUnit 		= 100'000;
+constexpr int64 strokeLogPauseUnit 		= 10'000'000;
+constexpr float strokeLogMaxTilt 		= 0.5f * 3.14159265f;
+constexpr uint8 strokeLogStylusFlag 	= 0x8;
+
+internal void stroke_log_initialize(StrokeLog * log, StrokeLogEntry * memory, int32 capacity)
+{
+	*log = {};
+	log->entries 			= memory;
+	log->capacity 			= capacity;
+	log->strokeBeginIndex 	= -1;
+}
+
+internal void stroke_log_append(StrokeLog * log, StrokeLogEntry entry)
+{
+	if (log->count == log->capacity)
+	{
+		if (log->full == false)
+		{
+			log_error("Stroke log is full, drawing can no longer be replayed");
+			log->full = true;
+		}
+		return;
+	}
+
+	log->entries[log->count] = entry;
+	log->count += 1;
+}
+
+internal uint16 stroke_log_quantize(float value, float range)
+{
+	float normalized = float_clamp(value / range, 0, 1);
+	return (uint16)(normalized * strokeLogPositionRange + 0.5f);
+}
+
+internal v2 stroke_log_position(StrokeLog const * log, StrokeLogEntry entry)
+{
+	v2 position =
+	{
+		entry.x / strokeLogPositionRange * log->width,
+		entry.y / strokeLogPositionRange * log->height,
+	};
+	return position;
+}
+
+internal float stroke_log_width(StrokeLogEntry entry)
+{
+	return entry.width / strokeLogWidthPrecision;
+}
+
+internal float stroke_log_time_seconds(uint16 time)
+{
+	return time * strokeLogTimeUnit / 1'000'000'000.0f;
+}
+
+// For BEGIN this is pause between strokes, which must not be given to stroke engine
+internal float stroke_log_entry_seconds(StrokeLogEntry entry)
+{
+	if (entry.type == STROKE_LOG_BEGIN)
+	{
+		return entry.beginPause * strokeLogPauseUnit / 1'000'000'000.0f;
+	}
+	return stroke_log_time_seconds(entry.time);
+}
+
+// Give this to stroke engine in live drawing
+internal float stroke_log_last_time_step(StrokeLog const * log)
+{
+	return stroke_log_time_seconds(log->lastTimeStep);
+}
+
+internal uint16 stroke_log_quantize_time(StrokeLog * log, int64 time)
+{
+	int64 units 		= (time - log->lastTime) / strokeLogTimeUnit;
+	units 				= units < 0 ? 0 : (units > 65535 ? 65535 : units);
+
+	// Advance by stored time only, so that truncated remainder goes to next step instead of
+	// being lost. Otherwise stored times run short by up to a unit per sample, which makes
+	// stroke faster and thinner the higher the sample rate is.
+	if (units == 65535)
+	{
+		log->lastTime = time;
+	}
+	else
+	{
+		log->lastTime += units * strokeLogTimeUnit;
+	}
+	log->lastTimeStep 	= (uint16)units;
+	return (uint16)units;
+}
+
+internal StrokeDynamics stroke_log_entry_dynamics(StrokeLogEntry entry)
+{
+	StrokeDynamics dynamics =
+	{
+		entry.pressure / 255.0f,
+		entry.size / 255.0f,
+		entry.tilt / 255.0f * strokeLogMaxTilt,
+	};
+	return dynamics;
+}
+
+internal void stroke_log_set_dynamics(StrokeLogEntry * entry, StrokeDynamics dynamics)
+{
+	entry->pressure = (uint8)(float_clamp(dynamics.pressure, 0, 1) * 255 + 0.5f);
+	entry->size 	= (uint8)(float_clamp(dynamics.size, 0, 1) * 255 + 0.5f);
+	entry->tilt 	= (uint8)(float_clamp(dynamics.tilt / strokeLogMaxTilt, 0, 1) * 255 + 0.5f);
+}
+
+internal StrokeDynamics stroke_log_quantize_dynamics(StrokeDynamics dynamics)
+{
+	StrokeLogEntry entry = {};
+	stroke_log_set_dynamics(&entry, dynamics);
+	return stroke_log_entry_dynamics(entry);
+}
+
+internal StrokeLogEntry make_stroke_log_entry(StrokeLog const * log, StrokeLogEntryType type, v2 position)
+{
+	StrokeLogEntry entry 	= {};
+	entry.type 				= type;
+	entry.x 				= stroke_log_quantize(position.x, log->width);
+	entry.y 				= stroke_log_quantize(position.y, log->height);
+	return entry;
+}
+
+/*
+Recording functions return values as they are stored, and live drawing must use those so
+that replay produces exactly same dabs. Same goes for dynamics, see stroke_log_quantize_dynamics.
+'time' is nanoseconds on CLOCK_MONOTONIC, like event times.
+*/
+internal v2 stroke_log_record_begin(StrokeLog * log, v2 position, StrokeDynamics dynamics, bool32 stylus,
+									BrushMode brushMode, int32 gradientIndex, int64 time)
+{
+	StrokeLogEntry entry 	= make_stroke_log_entry(log, STROKE_LOG_BEGIN, position);
+	entry.flags 			= (uint8)((brushMode & 0x7) | (stylus ? strokeLogStylusFlag : 0) | ((gradientIndex & 0xf) << 4));
+	stroke_log_set_dynamics(&entry, dynamics);
+
+	if (log->count > 0)
+	{
+		int64 pause 		= (time - log->lastTime) / strokeLogPauseUnit;
+		entry.beginPause 	= (uint8)(pause < 0 ? 0 : (pause > 255 ? 255 : pause));
+	}
+
+	log->strokeBeginIndex 	= log->full ? -1 : log->count;
+	log->lastTime 			= time;
+	log->lastTimeStep 		= 0;
+	stroke_log_append(log, entry);
+
+	return stroke_log_position(log, entry);
+}
+
+internal v2 stroke_log_record_sample(StrokeLog * log, v2 position, StrokeDynamics dynamics, int64 time)
+{
+	StrokeLogEntry entry 	= make_stroke_log_entry(log, STROKE_LOG_SAMPLE, position);
+	entry.time 				= stroke_log_quantize_time(log, time);
+	stroke_log_set_dynamics(&entry, dynamics);
+	stroke_log_append(log, entry);
+
+	return stroke_log_position(log, entry);
+}
+
+internal float stroke_log_quantize_width(float width)
+{
+	return (uint16)(width * strokeLogWidthPrecision + 0.5f) / strokeLogWidthPrecision;
+}
+
+internal void stroke_log_record_width(StrokeLog * log, float width)
+{
+	if (log->strokeBeginIndex >= 0)
+	{
+		log->entries[log->strokeBeginIndex].width = (uint16)(width * strokeLogWidthPrecision + 0.5f);
+	}
+}
+
+internal void stroke_log_record_flush(StrokeLog * log, int64 time)
+{
+	StrokeLogEntry entry 	= {STROKE_LOG_FLUSH};
+	entry.time 				= stroke_log_quantize_time(log, time);
+	stroke_log_append(log, entry);
+}
+
+internal void stroke_log_record_end(StrokeLog * log, int64 time)
+{
+	StrokeLogEntry entry 	= {STROKE_LOG_END};
+	entry.time 				= stroke_log_quantize_time(log, time);
+	stroke_log_append(log, entry);
+	log->strokeBeginIndex = -1;
+}
+
+internal void stroke_log_record_clear(StrokeLog * log, int32 gradientIndex, int64 time)
+{
+	StrokeLogEntry entry 	= {STROKE_LOG_CLEAR};
+	entry.flags 			= (uint8)((gradientIndex & 0xf) << 4);
+	entry.time 				= stroke_log_quantize_time(log, time);
+	stroke_log_append(log, entry);
+}
+
+// Drop a stroke that turned out not to be one, eg. a multi finger gesture
+internal void stroke_log_cancel_stroke(StrokeLog * log)
+{
+	if (log->strokeBeginIndex >= 0)
+	{
+		log->count = log->strokeBeginIndex;
+		log->full = false;
+	}
+	log->strokeBeginIndex = -1;
+}
+
+// First entry after last clear before 'end'
+internal int32 stroke_log_drawing_start(StrokeLog const * log, int32 end)
+{
+	for (int32 i = end; i > 0; --i)
+	{
+		if (log->entries[i - 1].type == STROKE_LOG_CLEAR)
+		{
+			return i;
+		}
+	}
+	return 0;
+}
+
+internal int32 stroke_log_gradient_index(StrokeLog const * log, int32 end)
+{
+	int32 drawingStart = stroke_log_drawing_start(log, end);
+	if (drawingStart > 0)
+	{
+		return log->entries[drawingStart - 1].flags >> 4;
+	}
+	return 0;
+}
+
+// Can be continued from where it stopped, eg. in the middle of a stroke
+struct StrokeLogReplay
+{
+	StrokeState stroke;
+	float 		strokeWidth;
+	int32 		entryIndex;
+};
+
+internal void stroke_log_replay_begin(StrokeLogReplay * replay, int32 firstEntry)
+{
+	*replay 			= {};
+	replay->entryIndex 	= firstEntry;
+}
+
+// Range must not cross CLEAR entries, see stroke_log_drawing_start. Caller flushes remaining dabs.
+internal void stroke_log_replay_continue(StrokeLog const * log, StrokeLogReplay * replay, int32 lastEntry, DabBuffer * dabs)
+{
+	StrokeState & stroke 	= replay->stroke;
+	float & strokeWidth 	= replay->strokeWidth;
+
+	for (; replay->entryIndex < lastEntry; ++replay->entryIndex)
+	{
+		StrokeLogEntry entry = log->entries[replay->entryIndex];
+
+		if (entry.type != STROKE_LOG_BEGIN && entry.type != STROKE_LOG_CLEAR)
+		{
+			stroke_advance_time(&stroke, stroke_log_entry_seconds(entry));
+		}
+
+		switch(entry.type)
+		{
+			case STROKE_LOG_BEGIN:
+			{
+				BrushMode brushMode = (BrushMode)(entry.flags & 0x7);
+				bool32 stylus 		= (entry.flags & strokeLogStylusFlag) != 0;
+				int32 gradientIndex = entry.flags >> 4;
+
+				strokeWidth = stroke_log_width(entry);
+				stroke_begin(&stroke, stroke_log_position(log, entry), stroke_log_entry_dynamics(entry), stylus, brushMode, gradientIndex);
+			} break;
+
+			case STROKE_LOG_SAMPLE:
+				stroke_queue_position(&stroke, stroke_log_position(log, entry), stroke_log_entry_dynamics(entry), strokeWidth, dabs);
+				break;
+
+			case STROKE_LOG_FLUSH:
+				if (stroke.drawPositionQueueCount > 0)
+				{
+					stroke_dequeue(&stroke, strokeWidth, dabs);
+				}
+				break;
+
+			case STROKE_LOG_END:
+				stroke_end(&stroke, strokeWidth, dabs);
+				break;
+
+			case STROKE_LOG_CLEAR:
+				break;
+		}
+	}
+}
+
+// Runs entries [firstEntry, lastEntry)
+internal void replay_stroke_log(StrokeLog const * log, int32 firstEntry, int32 lastEntry, DabBuffer * dabs)
+{
+	StrokeLogReplay replay;
+	stroke_log_replay_begin(&replay, firstEntry);
+	stroke_log_replay_continue(log, &replay, lastEntry, dabs);
+}
+
+/*
+Time-lapse plays log back at the pace it was drawn, with pauses shortened so that breaks do
+not show as still frames. A frame is taken before the entry that goes past its time, and one
+more after the last entry.
+*/
+constexpr float strokeLogTimelapseMaxPauseSeconds = 0.5f;
+
+struct StrokeLogTimelapse
+{
+	float 	frameSeconds;
+	float 	time;
+	float 	nextFrameTime;
+	int32 	entryIndex;
+};
+
+internal float stroke_log_timelapse_entry_seconds(StrokeLogEntry entry)
+{
+	float seconds = stroke_log_entry_seconds(entry);
+	return seconds < strokeLogTimelapseMaxPauseSeconds ? seconds : strokeLogTimelapseMaxPauseSeconds;
+}
+
+internal float stroke_log_timelapse_seconds(StrokeLog const * log)
+{
+	float seconds = 0;
+	for (int32 i = 0; i < log->count; ++i)
+	{
+		seconds += stroke_log_timelapse_entry_seconds(log->entries[i]);
+	}
+	return seconds;
+}
+
+internal void stroke_log_timelapse_begin(StrokeLogTimelapse * timelapse, float frameSeconds)
+{
+	*timelapse 					= {};
+	timelapse->frameSeconds 	= frameSeconds;
+}
+
+// Returns entry that next frame is taken before, replay up to it and take the frame. Returns -1 after last frame.
+internal int32 stroke_log_timelapse_next_frame(StrokeLog const * log, StrokeLogTimelapse * timelapse)
+{
+	while (timelapse->entryIndex <= log->count)
+	{
+		int32 entryIndex 		= timelapse->entryIndex;
+		bool32 last 			= entryIndex == log->count;
+		timelapse->entryIndex 	+= 1;
+
+		if (last == false)
+		{
+			timelapse->time += stroke_log_timelapse_entry_seconds(log->entries[entryIndex]);
+		}
+
+		if (timelapse->time < timelapse->nextFrameTime && last == false)
+		{
+			continue;
+		}
+
+		while (timelapse->nextFrameTime <= timelapse->time)
+		{
+			timelapse->nextFrameTime += timelapse->frameSeconds;
+		}
+		return entryIndex;
+	}
+	return -1;
+}
@@ -0,0 +1,225 @@
+/// ----------------------------------------------------------------------------
+/// UNDO HISTORY
+
+/*
+History is the stroke log itself, entries before 'cursor' are on canvas and entries after it
+can be redone. A step is a whole stroke or a single CLEAR. Canvas is restored from nearest
+checkpoint and rest is replayed. When oldest checkpoint in ring is overwritten, 'floor' moves
+up, so undo never replays more than a few steps. Copying pixels is up to the caller.
+*/
+
+struct UndoHistory
+{
+	int32 cursor;
+	int32 floor;
+
+	static constexpr int maxCheckpointCount 		= 16;
+	static constexpr int stepsBetweenCheckpoints 	= 8;
+
+	int32 checkpointCapacity;
+	int32 checkpointEntryIndices [maxCheckpointCount];
+	int32 firstCheckpoint;
+	int32 checkpointCount;
+
+	int32 stepsSinceCheckpoint;
+};
+
+internal void undo_history_initialize(UndoHistory * history, int32 memoryBudget, int32 checkpointSize)
+{
+	int32 capacity = memoryBudget / checkpointSize;
+	if (capacity > history->maxCheckpointCount)
+	{
+		capacity = history->maxCheckpointCount;
+	}
+
+	history->checkpointCapacity 	= capacity;
+	history->firstCheckpoint 		= 0;
+	history->checkpointCount 		= 0;
+	history->stepsSinceCheckpoint 	= 0;
+
+	// Checkpoints did not survive, so we cannot get back past this point
+	history->floor = history->cursor;
+
+	__android_log_print(ANDROID_LOG_INFO, "Game", "Undo history has %d checkpoints", capacity);
+}
+
+internal int32 undo_history_checkpoint_slot(UndoHistory const * history, int32 index)
+{
+	return (history->firstCheckpoint + index) % history->checkpointCapacity;
+}
+
+internal bool32 is_stroke_log_step_start(StrokeLogEntry entry)
+{
+	return entry.type == STROKE_LOG_BEGIN || entry.type == STROKE_LOG_CLEAR;
+}
+
+/*
+Call when a new step is certain. Stroke being recorded is after redo steps in log, so that a
+gesture that cancels it does not lose them, and it is moved in their place here.
+*/
+internal void undo_history_truncate(UndoHistory * history, StrokeLog * log)
+{
+	int32 redoEnd = log->strokeBeginIndex >= 0 ? log->strokeBeginIndex : log->count;
+	if (history->cursor == redoEnd)
+	{
+		return;
+	}
+
+	int32 strokeEntryCount = log->count - redoEnd;
+	memmove(log->entries + history->cursor, log->entries + redoEnd, strokeEntryCount * sizeof(StrokeLogEntry));
+
+	log->count 	= history->cursor + strokeEntryCount;
+	log->full 	= false;
+
+	if (log->strokeBeginIndex >= 0)
+	{
+		log->strokeBeginIndex = history->cursor;
+	}
+
+	while (history->checkpointCount > 0)
+	{
+		int32 lastSlot = undo_history_checkpoint_slot(history, history->checkpointCount - 1);
+		if (history->checkpointEntryIndices[lastSlot] <= history->cursor)
+		{
+			break;
+		}
+		history->checkpointCount -= 1;
+	}
+}
+
+// Returns slot where caller must copy canvas to
+internal int32 undo_history_push_checkpoint(UndoHistory * history)
+{
+	history->stepsSinceCheckpoint = 0;
+
+	if (history->checkpointCount == history->checkpointCapacity)
+	{
+		history->firstCheckpoint = (history->firstCheckpoint + 1) % history->checkpointCapacity;
+		history->checkpointCount -= 1;
+
+		history->floor = history->checkpointEntryIndices[history->firstCheckpoint];
+	}
+
+	int32 slot = undo_history_checkpoint_slot(history, history->checkpointCount);
+	history->checkpointEntryIndices[slot] 	= history->cursor;
+	history->checkpointCount 				+= 1;
+
+	return slot;
+}
+
+// Returns slot where newest checkpoint was, caller must move its pixels to slot 0, or -1 if there were none
+internal int32 undo_history_keep_newest_checkpoint(UndoHistory * history)
+{
+	int32 newestSlot = -1;
+	if (history->checkpointCount > 0)
+	{
+		newestSlot = undo_history_checkpoint_slot(history, history->checkpointCount - 1);
+
+		history->checkpointEntryIndices[0] 	= history->checkpointEntryIndices[newestSlot];
+		history->floor 						= history->checkpointEntryIndices[0];
+		history->checkpointCount 			= 1;
+	}
+
+	history->firstCheckpoint 	= 0;
+	history->checkpointCapacity = history->checkpointCapacity > 0 ? 1 : 0;
+
+	return newestSlot;
+}
+
+// Returns slot where caller must copy canvas to, or -1 if no checkpoint is needed now
+internal int32 undo_history_commit_step(UndoHistory * history, StrokeLog const * log)
+{
+	history->cursor = log->count;
+
+	bool32 isClear = log->count > 0 && log->entries[log->count - 1].type == STROKE_LOG_CLEAR;
+	if (isClear)
+	{
+		// Clear is as good as a checkpoint
+		history->stepsSinceCheckpoint = 0;
+		return -1;
+	}
+
+	history->stepsSinceCheckpoint += 1;
+	if (history->stepsSinceCheckpoint < history->stepsBetweenCheckpoints || history->checkpointCapacity == 0)
+	{
+		return -1;
+	}
+
+	return undo_history_push_checkpoint(history);
+}
+
+internal int32 undo_history_previous_step(UndoHistory const * history, StrokeLog const * log)
+{
+	for (int32 i = history->cursor - 1; i >= history->floor; --i)
+	{
+		if (is_stroke_log_step_start(log->entries[i]))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+internal int32 undo_history_next_step(UndoHistory const * history, StrokeLog const * log)
+{
+	if (history->cursor == log->count)
+	{
+		return -1;
+	}
+
+	if (log->entries[history->cursor].type == STROKE_LOG_CLEAR)
+	{
+		return history->cursor + 1;
+	}
+
+	for (int32 i = history->cursor + 1; i < log->count; ++i)
+	{
+		if (log->entries[i].type == STROKE_LOG_END)
+		{
+			return i + 1;
+		}
+	}
+
+	// Unfinished stroke, eg. log ran out of space
+	return -1;
+}
+
+// Returns first entry to replay, 'outSlot' is checkpoint to copy before it or -1 to start from white
+internal int32 undo_history_find_base(UndoHistory const * history, StrokeLog const * log, int32 cursor, int32 * outSlot)
+{
+	int32 replayStart 	= stroke_log_drawing_start(log, cursor);
+	*outSlot 			= -1;
+
+	for (int32 i = history->checkpointCount - 1; i >= 0; --i)
+	{
+		int32 slot 			= undo_history_checkpoint_slot(history, i);
+		int32 entryIndex 	= history->checkpointEntryIndices[slot];
+
+		if (entryIndex <= cursor)
+		{
+			if (entryIndex >= replayStart)
+			{
+				replayStart = entryIndex;
+				*outSlot 	= slot;
+			}
+			break;
+		}
+	}
+
+	return replayStart;
+}
+
+internal void undo_history_move_cursor(UndoHistory * history, StrokeLog const * log, int32 cursor, int32 replayStart)
+{
+	int32 steps = 0;
+	for (int32 i = replayStart; i < cursor; ++i)
+	{
+		if (log->entries[i].type == STROKE_LOG_BEGIN)
+		{
+			steps += 1;
+		}
+	}
+
+	history->cursor 				= cursor;
+	history->stepsSinceCheckpoint 	= steps;
+}
@@ -0,0 +1,149 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/memory.cpp"
+#include "../main/profiler.cpp"
+#include "../main/stroke.cpp"
+#include "../main/stroke_log.cpp"
+#include "../main/jobs.cpp"
+#include "../main/compositor.cpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../main/stb_image.h"
+
+#include "host_strokes.h"
+
+/*
+Host version of benchmark_cpu_compositor in IdiotGame.cpp: a drawing on 1080 x 2000 canvas
+is composited at twice that size with 1, 2, 4 and 8 jobs, as many as there are workers.
+Brush mask is brush_0.png from assets, gradients are plain ramps. Tiles keep dabs in order,
+so every job count must give exactly same pixels, and that is checked too.
+*/
+
+constexpr int32 canvasWidth 	= 1080;
+constexpr int32 canvasHeight 	= 2000;
+constexpr int32 strokeCount 	= 300;
+constexpr int32 logCapacity 	= 256 * 1024;
+
+internal int32 benchStrokeIndex;
+
+internal v2 bench_stroke_path(float t)
+{
+	float phase = benchStrokeIndex * 0.9f;
+	v2 start 	= {540 + 400 * cosf(phase), 1000 + 800 * sinf(phase * 1.7f)};
+	return start + v2{300 * t * cosf(phase * 2.3f + 4 * t), 300 * t * sinf(phase * 2.3f + 4 * t)};
+}
+
+internal void dab_discard_flush(void *, DabBuffer * buffer)
+{
+	buffer->count = 0;
+}
+
+internal bool32 load_brush(CompositorBrush * brush)
+{
+	int width, height, channels;
+	uint8 * mask = stbi_load(ASSET_DIRECTORY "/brush_0.png", &width, &height, &channels, 4);
+	if (mask == nullptr)
+	{
+		fprintf(stderr, "Could not load %s\n", ASSET_DIRECTORY "/brush_0.png");
+		return false;
+	}
+
+	uint8 gradients [2][CompositorBrush::gradientPixelCount * 4];
+	for (int32 i = 0; i < CompositorBrush::gradientPixelCount; ++i)
+	{
+		uint8 t = (uint8)(i * 2);
+		uint8 * a = gradients[0] + i * 4;
+		uint8 * b = gradients[1] + i * 4;
+		a[0] = t; 			a[1] = 40; 		a[2] = 255 - t; 	a[3] = 255;
+		b[0] = 255 - t; 	b[1] = t; 		b[2] = 60; 			b[3] = 255;
+	}
+
+	compositor_brush_initialize(brush, mask, width, height, gradients[0], gradients[1]);
+	stbi_image_free(mask);
+	return brush->valid;
+}
+
+internal uint64_t checksum(uint8 const * pixels, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ pixels[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+int main()
+{
+	static JobSystem jobs;
+	job_system_initialize(&jobs);
+
+	static CompositorBrush brush;
+	if (load_brush(&brush) == false)
+	{
+		return 1;
+	}
+
+	static StrokeLogEntry memory [logCapacity];
+	StrokeLog log;
+	stroke_log_initialize(&log, memory, logCapacity);
+	log.width 	= canvasWidth;
+	log.height 	= canvasHeight;
+
+	static Dab dabMemory [256];
+	DabBuffer dabs 		= {dabMemory, 0, 256, dab_discard_flush, nullptr};
+	StrokeState stroke 	= {};
+	int64 time 			= 1'000'000'000;
+	for (benchStrokeIndex = 0; benchStrokeIndex < strokeCount; ++benchStrokeIndex)
+	{
+		HostStroke description 	= {bench_stroke_path, 1.0f, 120, 40, strokeDynamicsNone};
+		time 					= host_draw_stroke(&log, &stroke, &dabs, description, time + 300'000'000);
+	}
+
+	int32 width 	= canvasWidth * 2;
+	int32 height 	= canvasHeight * 2;
+	size_t size 	= (size_t)width * height * 4;
+	uint8 * pixels 	= (uint8*)malloc(size);
+
+	static Compositor compositor;
+	double singleThreadSeconds 	= 0;
+	uint64_t singleThreadChecksum = 0;
+	bool32 identical 			= true;
+
+	for (int32 threadCount = 1; threadCount <= 8 && threadCount <= jobs.workerCount; threadCount *= 2)
+	{
+		if (compositor_initialize(&compositor, &jobs, &brush, threadCount, pixels, width, height, log.width, log.height) == false)
+		{
+			return 1;
+		}
+
+		double start = host_seconds();
+		compositor_clear(&compositor);
+		replay_stroke_log(&log, 0, log.count, &compositor.dabs);
+		compositor_finish(&compositor);
+		double seconds = host_seconds() - start;
+
+		uint64_t hash = checksum(pixels, size);
+		if (threadCount == 1)
+		{
+			singleThreadSeconds 	= seconds;
+			singleThreadChecksum 	= hash;
+		}
+		identical = identical && hash == singleThreadChecksum;
+
+		printf("cpu compositor %d x %d, %d threads: %lld dabs in %.2f ms, %.1f megapixels/s, %.2fx\n",
+				width, height, threadCount, (long long)compositor.dabCount, seconds * 1000,
+				(double)width * height / seconds / 1e6, singleThreadSeconds / seconds);
+	}
+
+	free(pixels);
+	job_system_destroy(&jobs);
+
+	if (identical == false)
+	{
+		fprintf(stderr, "Pixels differ between thread counts\n");
+		return 1;
+	}
+	return 0;
+}
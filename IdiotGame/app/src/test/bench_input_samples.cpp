@@ -0,0 +1,146 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/profiler.cpp"
+#include "../main/stroke.cpp"
+#include "../main/input_samples.cpp"
+
+/*
+Input sample ring between input thread and game thread. First part pushes as fast as it can
+against a consumer that also pops as fast as it can, for throughput. Producer waits for room
+here, which input thread never does, so that this measures moving samples and not dropping
+them. Samples must come out in order. Second part pops only every 16 ms like a frame would, while producer pushes at
+1 kHz, which is faster than any touch panel, to see whether ring ever fills.
+
+Reading AInputQueue on looper thread needs a device, this covers the ring only.
+*/
+
+constexpr int32 burstSampleCount 	= 2'000'000;
+constexpr int64 paceSampleInterval 	= 1'000'000;
+constexpr int32 paceSampleCount 	= 3000;
+
+struct RingBench
+{
+	InputSampleQueue 	queue;
+	int32 				sampleCount;
+	int64 				sampleInterval;
+	std::atomic<bool> 	producerDone;
+};
+
+internal void * ring_producer(void * data)
+{
+	RingBench * bench 	= (RingBench*)data;
+	int64 nextTime 		= time_now_nanoseconds();
+
+	for (int32 i = 0; i < bench->sampleCount; ++i)
+	{
+		if (bench->sampleInterval == 0)
+		{
+			InputSampleQueue const & queue = bench->queue;
+			while (queue.writeIndex.load(std::memory_order_relaxed) - queue.readIndex.load(std::memory_order_acquire) == queue.capacity)
+			{
+				sched_yield();
+			}
+		}
+		else
+		{
+			nextTime += bench->sampleInterval;
+			timespec target = {(time_t)(nextTime / 1'000'000'000), (long)(nextTime % 1'000'000'000)};
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr);
+		}
+
+		InputSample sample 	= {};
+		sample.type 		= INPUT_SAMPLE_MOVE;
+		sample.eventTime 	= i;
+		sample.receiveTime 	= bench->sampleInterval > 0 ? time_now_nanoseconds() : 0;
+		input_sample_queue_push(&bench->queue, sample);
+	}
+
+	bench->producerDone.store(true, std::memory_order_release);
+	return nullptr;
+}
+
+struct ConsumeResult
+{
+	int64 	popped;
+	bool32 	inOrder;
+	int64 	maxHandoff;
+};
+
+internal ConsumeResult run_ring(RingBench * bench, int64 popInterval)
+{
+	pthread_t producer;
+	pthread_create(&producer, nullptr, ring_producer, bench);
+
+	ConsumeResult result 	= {0, true, 0};
+	int64 lastEventTime 	= -1;
+	int64 nextPopTime 		= time_now_nanoseconds();
+
+	while (true)
+	{
+		bool32 done = bench->producerDone.load(std::memory_order_acquire);
+
+		InputSample sample;
+		while (input_sample_queue_pop(&bench->queue, &sample))
+		{
+			result.inOrder 	= result.inOrder && sample.eventTime > lastEventTime;
+			lastEventTime 	= sample.eventTime;
+			result.popped 	+= 1;
+
+			if (sample.receiveTime > 0)
+			{
+				int64 handoff 		= time_now_nanoseconds() - sample.receiveTime;
+				result.maxHandoff 	= handoff > result.maxHandoff ? handoff : result.maxHandoff;
+			}
+		}
+
+		if (done)
+		{
+			break;
+		}
+
+		if (popInterval == 0)
+		{
+			// Let producer run if we share a core
+			sched_yield();
+		}
+		else
+		{
+			nextPopTime += popInterval;
+			timespec target = {(time_t)(nextPopTime / 1'000'000'000), (long)(nextPopTime % 1'000'000'000)};
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr);
+		}
+	}
+
+	pthread_join(producer, nullptr);
+	return result;
+}
+
+int main()
+{
+	static RingBench burst;
+	burst.sampleCount = burstSampleCount;
+
+	double start 			= host_seconds();
+	ConsumeResult result 	= run_ring(&burst, 0);
+	double seconds 			= host_seconds() - start;
+	uint32 dropped 			= burst.queue.droppedCount.load();
+
+	printf("burst: %d samples in %.1f ms, %.1f M samples/s, %u dropped, %s\n", burstSampleCount, seconds * 1000,
+			burstSampleCount / seconds / 1e6, dropped, result.inOrder ? "in order" : "OUT OF ORDER");
+
+	bool32 ok = result.inOrder && dropped == 0 && result.popped == burstSampleCount;
+
+	static RingBench paced;
+	paced.sampleCount 		= paceSampleCount;
+	paced.sampleInterval 	= paceSampleInterval;
+
+	result 	= run_ring(&paced, 1'000'000'000 / 60);
+	dropped = paced.queue.droppedCount.load();
+
+	printf("1 kHz input, 60 Hz frames: %lld popped, %u dropped, longest wait in ring %.2f ms\n",
+			(long long)result.popped, dropped, result.maxHandoff / 1'000'000.0);
+
+	ok = ok && result.inOrder && dropped == 0 && result.popped == paceSampleCount;
+	return ok ? 0 : 1;
+}
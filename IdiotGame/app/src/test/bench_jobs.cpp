@@ -0,0 +1,168 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/profiler.cpp"
+#include "../main/jobs.cpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../main/stb_image.h"
+
+/*
+Job system on host, with as many workers as it picks for this machine. Three things:
+
+- Overhead of a job, from job_run to job_wait returning, with empty jobs in batches.
+- Fixed amount of arithmetic split into 1, 2, 4 ... jobs, to see how far it scales.
+- Startup images decoded one after another, and then in jobs like load happens at startup.
+
+Images are read from assets directory, see ASSET_DIRECTORY in CMakeLists.txt.
+*/
+
+constexpr int32 overheadJobCount 	= 100'000;
+constexpr int32 overheadBatchSize 	= 64;
+constexpr int64 splitWorkTotal 		= 400'000'000;
+constexpr int32 decodeRounds 		= 10;
+
+internal void empty_job(void *)
+{
+}
+
+struct SplitWork
+{
+	int64 	iterations;
+	uint32 	result;
+};
+
+internal void split_work_job(void * data)
+{
+	SplitWork * work = (SplitWork*)data;
+
+	uint32 value = 1;
+	for (int64 i = 0; i < work->iterations; ++i)
+	{
+		value = value * 1664525 + 1013904223;
+	}
+	work->result = value;
+}
+
+struct DecodeJob
+{
+	char const * 	name;
+	uint8 * 		file;
+	int 			fileSize;
+	uint8 * 		pixels;
+};
+
+internal void decode_job(void * data)
+{
+	DecodeJob * job = (DecodeJob*)data;
+	int width, height, channels;
+	job->pixels = stbi_load_from_memory(job->file, job->fileSize, &width, &height, &channels, 4);
+}
+
+internal bool32 read_asset(DecodeJob * job)
+{
+	char path [512];
+	snprintf(path, sizeof(path), "%s/%s", ASSET_DIRECTORY, job->name);
+
+	FILE * file = fopen(path, "rb");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Could not open %s\n", path);
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	job->fileSize 	= (int)ftell(file);
+	job->file 		= (uint8*)malloc(job->fileSize);
+	fseek(file, 0, SEEK_SET);
+	bool32 ok 		= fread(job->file, 1, job->fileSize, file) == (size_t)job->fileSize;
+	fclose(file);
+	return ok;
+}
+
+int main()
+{
+	static JobSystem jobs;
+	job_system_initialize(&jobs);
+	printf("%d workers, game thread included\n", jobs.workerCount);
+
+	{
+		double start = host_seconds();
+		for (int32 i = 0; i < overheadJobCount; i += overheadBatchSize)
+		{
+			JobCounter counter = {};
+			for (int32 j = 0; j < overheadBatchSize; ++j)
+			{
+				job_run(&jobs, empty_job, nullptr, &counter);
+			}
+			job_wait(&jobs, &counter);
+		}
+		double seconds = host_seconds() - start;
+		printf("empty jobs: %.0f ns per job in batches of %d\n", seconds * 1e9 / overheadJobCount, overheadBatchSize);
+	}
+
+	double singleSeconds = 0;
+	for (int32 jobCount = 1; jobCount <= 2 * jobs.workerCount; jobCount *= 2)
+	{
+		SplitWork work [16];
+		JobCounter counter = {};
+
+		double start = host_seconds();
+		for (int32 i = 0; i < jobCount; ++i)
+		{
+			work[i].iterations = splitWorkTotal / jobCount;
+			job_run(&jobs, split_work_job, &work[i], &counter);
+		}
+		job_wait(&jobs, &counter);
+		double seconds = host_seconds() - start;
+
+		singleSeconds = jobCount == 1 ? seconds : singleSeconds;
+		printf("arithmetic in %2d jobs: %7.1f ms, %.2fx\n", jobCount, seconds * 1000, singleSeconds / seconds);
+	}
+
+	DecodeJob images [] = {{"brush_0.png"}, {"clear_link.png"}, {"credits.png"}};
+	for (DecodeJob & image : images)
+	{
+		if (read_asset(&image) == false)
+		{
+			return 1;
+		}
+	}
+
+	double serialSeconds 	= 0;
+	double jobSeconds 		= 0;
+	for (int32 round = 0; round < decodeRounds; ++round)
+	{
+		double start = host_seconds();
+		for (DecodeJob & image : images)
+		{
+			decode_job(&image);
+			stbi_image_free(image.pixels);
+		}
+		serialSeconds += host_seconds() - start;
+
+		start = host_seconds();
+		JobCounter counter = {};
+		for (DecodeJob & image : images)
+		{
+			job_run(&jobs, decode_job, &image, &counter);
+		}
+		job_wait(&jobs, &counter);
+		jobSeconds += host_seconds() - start;
+
+		for (DecodeJob & image : images)
+		{
+			stbi_image_free(image.pixels);
+		}
+	}
+
+	printf("startup images: %.2f ms one by one, %.2f ms in jobs, %.2fx\n", serialSeconds * 1000 / decodeRounds,
+			jobSeconds * 1000 / decodeRounds, serialSeconds / jobSeconds);
+
+	for (DecodeJob & image : images)
+	{
+		free(image.file);
+	}
+	job_system_destroy(&jobs);
+	return 0;
+}
@@ -0,0 +1,226 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/profiler.cpp"
+#include "../main/stroke.cpp"
+#include "../main/stroke_log.cpp"
+#include "../main/latency.cpp"
+
+/*
+Runs latency measurement with its synthetic input, like 'debug.idiotgame.latency 2' does,
+through stroke log and engine with the same hooks as IdiotGame.cpp. Frames start at 60 Hz
+vsync times. There is no GPU, so 'render' and 'swap' are near zero, and 'queue' is what the
+draw queue lookahead costs on its own. Dispatch here is waiting for next frame, on device
+input thread and looper add to it.
+
+Second run draws wet stroke tail every frame like draw_wet_stroke_tail does, so queued
+samples count as visible when tail shows them. It also reports how far predicted position
+was from next real one, and how long drawing tail took on cpu.
+*/
+
+constexpr int64 frameInterval 	= 1'000'000'000 / 60;
+constexpr int32 frameCount 		= 8 * 60;
+constexpr float strokeWidth 	= 40;
+
+struct LatencyBench
+{
+	LatencyTracker 	latency;
+	StrokeLog 		log;
+	StrokeLogEntry 	logMemory [64 * 1024];
+	StrokeState 	stroke;
+	bool32 			strokeActive;
+	Dab 			dabMemory [1024];
+	DabBuffer 		dabs;
+
+	Dab 			wetDabMemory [1024];
+	DabBuffer 		wetDabs;
+	v2 				predictedPosition;
+	bool32 			hasPredictedPosition;
+
+	double 			predictionErrorSum;
+	float 			predictionErrorMax;
+	int32 			predictionCount;
+	double 			wetTailSeconds;
+	int32 			wetTailCount;
+};
+
+internal void dab_discard_flush(void *, DabBuffer * buffer)
+{
+	buffer->count = 0;
+}
+
+// Same as begin_draw_stroke, queue_draw_position and end_draw_stroke in IdiotGame.cpp
+internal void bench_begin(LatencyBench * bench, v2 position, int64 eventTime, int64 receiveTime)
+{
+	position = stroke_log_record_begin(&bench->log, position, strokeDynamicsNone, false, BRUSH_DRAW, 0, eventTime);
+	stroke_begin(&bench->stroke, position, strokeDynamicsNone, false, BRUSH_DRAW, 0);
+	bench->strokeActive 		= true;
+	bench->hasPredictedPosition = false;
+
+	latency_begin(&bench->latency, eventTime, receiveTime);
+}
+
+internal void bench_queue(LatencyBench * bench, v2 position, int64 eventTime, int64 receiveTime)
+{
+	int32 queueCount = bench->stroke.drawPositionQueueCount;
+
+	position = stroke_log_record_sample(&bench->log, position, strokeDynamicsNone, eventTime);
+	stroke_advance_time(&bench->stroke, stroke_log_last_time_step(&bench->log));
+
+	if (bench->hasPredictedPosition)
+	{
+		float error 					= v2_magnitude(position - bench->predictedPosition);
+		bench->predictionErrorSum 		+= error;
+		bench->predictionErrorMax 		= error > bench->predictionErrorMax ? error : bench->predictionErrorMax;
+		bench->predictionCount 			+= 1;
+		bench->hasPredictedPosition 	= false;
+	}
+	stroke_queue_position(&bench->stroke, position, strokeDynamicsNone, strokeWidth, &bench->dabs);
+	if (bench->stroke.strokeMoved)
+	{
+		stroke_log_record_width(&bench->log, bench->stroke.strokeWidth);
+	}
+
+	latency_queue(&bench->latency, eventTime, receiveTime);
+	for (int32 i = bench->stroke.drawPositionQueueCount; i < queueCount + 1; ++i)
+	{
+		latency_dequeue(&bench->latency, bench->stroke.strokeMoved);
+	}
+}
+
+internal void bench_end(LatencyBench * bench, int64 eventTime)
+{
+	if (bench->stroke.strokeMoved == false)
+	{
+		stroke_log_record_width(&bench->log, strokeWidth);
+	}
+
+	stroke_log_record_end(&bench->log, eventTime);
+	stroke_advance_time(&bench->stroke, stroke_log_last_time_step(&bench->log));
+	latency_end(&bench->latency, bench->stroke.strokeMoved);
+	stroke_end(&bench->stroke, strokeWidth, &bench->dabs);
+	bench->strokeActive = false;
+}
+
+internal void bench_feed_synthetic_input(LatencyBench * bench)
+{
+	v2 position;
+	int64 eventTime;
+
+	SyntheticInputAction action;
+	while((action = latency_next_synthetic_input(&bench->latency, {540, 1000}, 300, &position, &eventTime)) != SYNTHETIC_INPUT_NONE)
+	{
+		int64 receiveTime = time_now_nanoseconds();
+		switch(action)
+		{
+			case SYNTHETIC_INPUT_BEGIN:
+				if (bench->strokeActive)
+				{
+					bench_end(bench, eventTime);
+				}
+				bench_begin(bench, position, eventTime, receiveTime);
+				break;
+
+			case SYNTHETIC_INPUT_MOVE:
+				if (bench->strokeActive)
+				{
+					bench_queue(bench, position, eventTime, receiveTime);
+				}
+				break;
+
+			case SYNTHETIC_INPUT_END:
+				if (bench->strokeActive)
+				{
+					bench_queue(bench, position, eventTime, receiveTime);
+					bench_end(bench, eventTime);
+				}
+				break;
+
+			case SYNTHETIC_INPUT_NONE:
+				break;
+		}
+	}
+}
+
+internal void bench_draw_wet_tail(LatencyBench * bench)
+{
+	if (bench->strokeActive == false)
+	{
+		return;
+	}
+
+	double start = host_seconds();
+
+	bench->predictedPosition 	= stroke_predict_next_position(&bench->stroke);
+	bench->hasPredictedPosition = true;
+	stroke_draw_wet_tail(&bench->stroke, bench->predictedPosition, strokeWidth, &bench->wetDabs);
+	flush_dabs(&bench->wetDabs);
+
+	bench->wetTailSeconds 	+= host_seconds() - start;
+	bench->wetTailCount 	+= 1;
+
+	latency_mark_wet(&bench->latency);
+}
+
+internal void sleep_until(int64 time)
+{
+	timespec target = {(time_t)(time / 1'000'000'000), (long)(time % 1'000'000'000)};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr) == EINTR)
+	{
+	}
+}
+
+internal void run(bool32 wetTail)
+{
+	static LatencyBench bench;
+	bench = {};
+
+	stroke_log_initialize(&bench.log, bench.logMemory, 64 * 1024);
+	bench.log.width 	= 1080;
+	bench.log.height 	= 2000;
+	bench.dabs 			= {bench.dabMemory, 0, 1024, dab_discard_flush, nullptr};
+	bench.wetDabs 		= {bench.wetDabMemory, 0, 1024, dab_discard_flush, nullptr};
+
+	latency_initialize(&bench.latency);
+	bench.latency.enabled 			= true;
+	bench.latency.syntheticInput 	= true;
+
+	int64 vsyncTime = time_now_nanoseconds();
+	for (int32 frame = 0; frame < frameCount; ++frame)
+	{
+		vsyncTime += frameInterval;
+		sleep_until(vsyncTime);
+
+		bench_feed_synthetic_input(&bench);
+		flush_dabs(&bench.dabs);
+
+		if (wetTail)
+		{
+			bench_draw_wet_tail(&bench);
+		}
+
+		int64 swapStartTime = time_now_nanoseconds();
+		latency_frame_presented(&bench.latency, swapStartTime, time_now_nanoseconds());
+	}
+
+	printf("%s:\n", wetTail ? "With wet tail" : "Without wet tail");
+	fflush(stdout);
+	latency_report(&bench.latency);
+
+	if (wetTail && bench.predictionCount > 0 && bench.wetTailCount > 0)
+	{
+		printf("  prediction error mean %.1f px, max %.1f px, wet tail %.1f us per frame\n",
+				bench.predictionErrorSum / bench.predictionCount, bench.predictionErrorMax,
+				bench.wetTailSeconds / bench.wetTailCount * 1'000'000);
+	}
+}
+
+int main()
+{
+	// Tracker reports through android log, which is otherwise quiet in host builds
+	setenv("HOST_LOG", "1", 1);
+
+	run(false);
+	run(true);
+	return 0;
+}
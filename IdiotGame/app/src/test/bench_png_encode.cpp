@@ -0,0 +1,147 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/memory.cpp"
+#include "../main/profiler.cpp"
+#include "../main/jobs.cpp"
+#include "../main/png_writer.cpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../main/stb_image.h"
+
+/*
+Encodes a 3840 x 2160 image like export does, and writes it to a temporary file. Image is
+white with soft coloured discs, which compresses about like a drawing does. Written file is
+decoded back with stb_image and compared to source. Size is also compared against deflating
+whole unfiltered image as one stream, to see what bands and filters cost or save.
+*/
+
+constexpr int32 width 			= 3840;
+constexpr int32 height 			= 2160;
+constexpr int32 discCount 		= 400;
+constexpr int32 encodeRounds 	= 3;
+
+internal void draw_image(uint8 * pixels)
+{
+	memset(pixels, 0xff, (size_t)width * height * 4);
+
+	uint32 random = 12345;
+	auto next = [&random](int32 range) -> int32
+	{
+		random = random * 1664525 + 1013904223;
+		return (int32)((random >> 8) % (uint32)range);
+	};
+
+	for (int32 disc = 0; disc < discCount; ++disc)
+	{
+		int32 centerX 	= next(width);
+		int32 centerY 	= next(height);
+		int32 radius 	= 20 + next(150);
+		uint8 colour [] = {(uint8)next(256), (uint8)next(256), (uint8)next(256)};
+
+		for (int32 y = centerY - radius; y <= centerY + radius; ++y)
+		{
+			for (int32 x = centerX - radius; x <= centerX + radius; ++x)
+			{
+				if (x < 0 || y < 0 || x >= width || y >= height)
+				{
+					continue;
+				}
+
+				float distance = sqrtf((float)((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY))) / radius;
+				if (distance >= 1)
+				{
+					continue;
+				}
+
+				float alpha 	= 1 - distance * distance;
+				uint8 * pixel 	= pixels + ((size_t)y * width + x) * 4;
+				for (int32 channel = 0; channel < 3; ++channel)
+				{
+					pixel[channel] = (uint8)(pixel[channel] + (colour[channel] - pixel[channel]) * alpha);
+				}
+			}
+		}
+	}
+}
+
+int main()
+{
+	static JobSystem jobs;
+	job_system_initialize(&jobs);
+
+	size_t pixelsSize 	= (size_t)width * height * 4;
+	uint8 * pixels 		= (uint8*)malloc(pixelsSize);
+	draw_image(pixels);
+
+	static PngEncoder encoder;
+	double bestSeconds = 0;
+	for (int32 round = 0; round < encodeRounds; ++round)
+	{
+		double start 	= host_seconds();
+		bool32 ok 		= png_encode(&encoder, &jobs, pixels, width, height);
+		double seconds 	= host_seconds() - start;
+
+		if (ok == false)
+		{
+			fprintf(stderr, "Could not encode\n");
+			return 1;
+		}
+
+		bestSeconds = (round == 0 || seconds < bestSeconds) ? seconds : bestSeconds;
+		if (round < encodeRounds - 1)
+		{
+			png_encoder_free(&encoder);
+		}
+	}
+
+	size_t fileSize 	= png_encoder_file_size(&encoder);
+	size_t rgbSize 		= (size_t)width * height * pngBytesPerPixel;
+	printf("png %d x %d, %d workers, %d bands: best of %d %.1f ms, %.1f megapixels/s, %.2f MiB, %.1f%% of rgb\n",
+			width, height, jobs.workerCount, encoder.bandCount, encodeRounds, bestSeconds * 1000,
+			(double)width * height / bestSeconds / 1e6, fileSize / 1048576.0, 100.0 * fileSize / rgbSize);
+
+	char path [] = "/tmp/bench_png_encode_XXXXXX.png";
+	int file = mkstemps(path, 4);
+	close(file);
+
+	bool32 written = png_encoder_write(&encoder, path);
+	png_encoder_free(&encoder);
+
+	int decodedWidth, decodedHeight, channels;
+	uint8 * decoded = written ? stbi_load(path, &decodedWidth, &decodedHeight, &channels, 4) : nullptr;
+	unlink(path);
+
+	bool32 matches = decoded != nullptr && decodedWidth == width && decodedHeight == height;
+	for (size_t i = 0; matches && i < pixelsSize; i += 4)
+	{
+		matches = decoded[i] == pixels[i] && decoded[i + 1] == pixels[i + 1] && decoded[i + 2] == pixels[i + 2];
+	}
+	stbi_image_free(decoded);
+	printf("decoded file %s source\n", matches ? "matches" : "DOES NOT MATCH");
+
+	// Unfiltered rows with their filter byte, as one stream at same level
+	uint8 * raw = (uint8*)malloc(rgbSize + height);
+	for (int32 y = 0; y < height; ++y)
+	{
+		uint8 * row = raw + (size_t)y * (width * pngBytesPerPixel + 1);
+		row[0] 		= PNG_FILTER_NONE;
+		png_pack_rgb_row(pixels + (size_t)y * width * 4, width, row + 1);
+	}
+
+	uLongf compressedSize 	= compressBound(rgbSize + height);
+	uint8 * compressed 		= (uint8*)malloc(compressedSize);
+
+	double start = host_seconds();
+	compress2(compressed, &compressedSize, raw, rgbSize + height, pngCompressionLevel);
+	double seconds = host_seconds() - start;
+
+	printf("one unfiltered stream: %.1f ms, %.2f MiB\n", seconds * 1000, compressedSize / 1048576.0);
+
+	free(compressed);
+	free(raw);
+	free(pixels);
+	job_system_destroy(&jobs);
+
+	return matches ? 0 : 1;
+}
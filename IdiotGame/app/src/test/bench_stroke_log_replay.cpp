@@ -0,0 +1,97 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/profiler.cpp"
+#include "../main/stroke.cpp"
+#include "../main/stroke_log.cpp"
+
+#include "host_strokes.h"
+
+/*
+How long it takes to record strokes and to replay a full stroke log, which is what undo,
+canvas restore and export all pay for. Log is as big as the one in IdiotGame.cpp, filled
+with curly strokes of half a second to two seconds at 120 Hz. Dabs are only counted, so
+this measures stroke log and engine, not drawing.
+*/
+
+constexpr int32 canvasWidth 	= 1080;
+constexpr int32 canvasHeight 	= 2000;
+constexpr int32 logCapacity 	= 256 * 1024;
+constexpr int32 replayRounds 	= 5;
+
+internal int32 benchStrokeIndex;
+
+internal v2 bench_stroke_path(float t)
+{
+	float phase 	= benchStrokeIndex * 0.7f;
+	v2 center 		= {540 + 300 * cosf(phase), 1000 + 600 * sinf(phase * 1.3f)};
+	float radius 	= 50 + 150 * t;
+	float angle 	= phase + 9 * t;
+	return center + v2{radius * cosf(angle), radius * sinf(angle)};
+}
+
+struct DabCounter
+{
+	Dab 	memory [256];
+	int64 	count;
+};
+
+internal void dab_counter_flush(void * data, DabBuffer * buffer)
+{
+	((DabCounter*)data)->count += buffer->count;
+	buffer->count = 0;
+}
+
+int main()
+{
+	static StrokeLogEntry memory [logCapacity];
+	StrokeLog log;
+	stroke_log_initialize(&log, memory, logCapacity);
+	log.width 	= canvasWidth;
+	log.height 	= canvasHeight;
+
+	static DabCounter counter;
+	DabBuffer dabs = {counter.memory, 0, 256, dab_counter_flush, &counter};
+
+	StrokeState stroke 	= {};
+	int64 time 			= 1'000'000'000;
+	int32 sampleCount 	= 0;
+
+	double recordStart = host_seconds();
+	while (log.count < logCapacity - 512)
+	{
+		HostStroke description 	= {bench_stroke_path, 0.5f + (benchStrokeIndex % 4) * 0.5f, 120, 40, strokeDynamicsNone};
+		time 					= host_draw_stroke(&log, &stroke, &dabs, description, time + 300'000'000);
+		sampleCount 			+= (int32)(description.durationSeconds * description.sampleRate);
+		benchStrokeIndex 		+= 1;
+	}
+	flush_dabs(&dabs);
+	double recordSeconds = host_seconds() - recordStart;
+
+	int64 liveDabCount 		= counter.count;
+	double bestReplaySeconds = 0;
+	for (int32 round = 0; round < replayRounds; ++round)
+	{
+		counter.count = 0;
+
+		double start = host_seconds();
+		replay_stroke_log(&log, 0, log.count, &dabs);
+		flush_dabs(&dabs);
+		double seconds = host_seconds() - start;
+
+		bestReplaySeconds = (round == 0 || seconds < bestReplaySeconds) ? seconds : bestReplaySeconds;
+	}
+
+	printf("stroke log: %d strokes, %d entries, %lld dabs\n", benchStrokeIndex, log.count, (long long)counter.count);
+	printf("record and draw live: %.1f ms, %.0f ns per sample\n", recordSeconds * 1000, recordSeconds * 1e9 / sampleCount);
+	printf("replay full log, best of %d: %.1f ms, %.1f M entries/s, %.1f M dabs/s\n", replayRounds,
+			bestReplaySeconds * 1000, log.count / bestReplaySeconds / 1e6, counter.count / bestReplaySeconds / 1e6);
+
+	// Replay is only useful if it draws what was drawn live
+	if (counter.count != liveDabCount)
+	{
+		fprintf(stderr, "replay gave %lld dabs, live drawing %lld\n", (long long)counter.count, (long long)liveDabCount);
+		return 1;
+	}
+	return 0;
+}
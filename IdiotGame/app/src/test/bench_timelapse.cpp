@@ -0,0 +1,134 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/profiler.cpp"
+#include "../main/stroke.cpp"
+#include "../main/stroke_log.cpp"
+
+#include "host_strokes.h"
+
+/*
+Converting stroke log to time-lapse frames, like export_timelapse does, without compositing
+or encoding them, see bench_compositor and bench_png_encode for those. Drawing has strokes
+of different lengths with pauses between them, some longer than time-lapse keeps. Checks
+that frames come at right times, and that replaying frame by frame gives same dabs as
+replaying whole log at once.
+*/
+
+constexpr int32 canvasWidth 		= 1080;
+constexpr int32 canvasHeight 		= 2000;
+constexpr int32 strokeCount 		= 1000;
+constexpr int32 logCapacity 		= 256 * 1024;
+constexpr float framesPerSecond 	= 30;
+constexpr int32 timelapseSpeed 		= 4;
+
+internal int32 benchStrokeIndex;
+
+internal v2 bench_stroke_path(float t)
+{
+	float phase = benchStrokeIndex * 0.9f;
+	v2 start 	= {540 + 400 * cosf(phase), 1000 + 800 * sinf(phase * 1.7f)};
+	return start + v2{300 * t * cosf(phase * 2.3f + 4 * t), 300 * t * sinf(phase * 2.3f + 4 * t)};
+}
+
+struct DabCounter
+{
+	Dab 	memory [256];
+	int64 	count;
+};
+
+internal void dab_counter_flush(void * data, DabBuffer * buffer)
+{
+	((DabCounter*)data)->count += buffer->count;
+	buffer->count = 0;
+}
+
+int main()
+{
+	static StrokeLogEntry memory [logCapacity];
+	StrokeLog log;
+	stroke_log_initialize(&log, memory, logCapacity);
+	log.width 	= canvasWidth;
+	log.height 	= canvasHeight;
+
+	static DabCounter counter;
+	DabBuffer dabs = {counter.memory, 0, 256, dab_counter_flush, &counter};
+
+	// Every seventh pause is long, and is cut short in time-lapse
+	StrokeState stroke 	= {};
+	int64 time 			= 1'000'000'000;
+	for (benchStrokeIndex = 0; benchStrokeIndex < strokeCount; ++benchStrokeIndex)
+	{
+		int64 pause 			= benchStrokeIndex % 7 == 0 ? 2'000'000'000 : 200'000'000;
+		HostStroke description 	= {bench_stroke_path, 0.3f + (benchStrokeIndex % 5) * 0.2f, 120, 40, strokeDynamicsNone};
+		time 					= host_draw_stroke(&log, &stroke, &dabs, description, time + pause);
+	}
+
+	flush_dabs(&dabs);
+
+	counter.count = 0;
+	replay_stroke_log(&log, 0, log.count, &dabs);
+	flush_dabs(&dabs);
+	int64 wholeDabCount = counter.count;
+
+	double start 			= host_seconds();
+	float drawingSeconds 	= stroke_log_timelapse_seconds(&log);
+	float frameSeconds 		= timelapseSpeed / framesPerSecond;
+
+	StrokeLogTimelapse timelapse;
+	stroke_log_timelapse_begin(&timelapse, frameSeconds);
+
+	int32 frameCount 	= 0;
+	int32 entryIndex;
+	while ((entryIndex = stroke_log_timelapse_next_frame(&log, &timelapse)) >= 0)
+	{
+		frameCount += 1;
+	}
+	double scheduleSeconds = host_seconds() - start;
+
+	counter.count 			= 0;
+	int64 maxFrameDabCount 	= 0;
+	int32 lastEntryIndex 	= -1;
+	bool32 ordered 			= true;
+
+	start = host_seconds();
+
+	StrokeLogReplay replay;
+	stroke_log_replay_begin(&replay, 0);
+	stroke_log_timelapse_begin(&timelapse, frameSeconds);
+
+	while ((entryIndex = stroke_log_timelapse_next_frame(&log, &timelapse)) >= 0)
+	{
+		int64 before = counter.count;
+		stroke_log_replay_continue(&log, &replay, entryIndex, &dabs);
+		flush_dabs(&dabs);
+
+		int64 frameDabCount = counter.count - before;
+		maxFrameDabCount 	= frameDabCount > maxFrameDabCount ? frameDabCount : maxFrameDabCount;
+		ordered 			= ordered && entryIndex > lastEntryIndex;
+		lastEntryIndex 		= entryIndex;
+	}
+	double replaySeconds = host_seconds() - start;
+
+	float realSeconds = (time - 1'000'000'000) / 1e9f;
+	printf("%d strokes, %d entries, drawn in %.0f s, %.0f s in time-lapse\n", strokeCount, log.count, realSeconds, drawingSeconds);
+	printf("%d frames at %dx: scheduling %.3f ms, replay frame by frame %.1f ms, at most %lld dabs in a frame\n",
+			frameCount, timelapseSpeed, scheduleSeconds * 1000, replaySeconds * 1000, (long long)maxFrameDabCount);
+
+	/*
+	At most a frame for every 'frameSeconds' that passes, and one after the last entry. Entry
+	that spans many frame times, like a pause, gives only one frame, so there can be fewer.
+	*/
+	int32 maxFrameCount = (int32)(drawingSeconds / frameSeconds) + 2;
+	bool32 ok = ordered
+				&& lastEntryIndex == log.count
+				&& frameCount > 0 && frameCount <= maxFrameCount
+				&& counter.count == wholeDabCount;
+
+	if (ok == false)
+	{
+		fprintf(stderr, "Expected at most %d frames and %lld dabs, got %d frames and %lld dabs\n",
+				maxFrameCount, (long long)wholeDabCount, frameCount, (long long)counter.count);
+	}
+	return ok ? 0 : 1;
+}
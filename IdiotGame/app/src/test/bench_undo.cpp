@@ -0,0 +1,136 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/profiler.cpp"
+#include "../main/stroke.cpp"
+#include "../main/stroke_log.cpp"
+#include "../main/undo_history.cpp"
+
+#include "host_strokes.h"
+
+#include <algorithm>
+
+/*
+Cpu side of undo and redo latency: finding the base checkpoint, replaying entries from it
+through stroke engine, and moving cursor. Copying checkpoint and drawing replayed dabs are
+done by GPU on device, so they are not timed here; how many dabs each step replays tells
+how much drawing it costs. Same is measured without checkpoints, where every step replays
+from start, to see what they bound.
+
+History is set up like on a 1080 x 2000 screen with the game's 32 MiB checkpoint budget.
+*/
+
+constexpr int32 canvasWidth 		= 1080;
+constexpr int32 canvasHeight 		= 2000;
+constexpr int32 checkpointBudget 	= 32 * 1024 * 1024;
+constexpr int32 strokeCount 		= 300;
+constexpr int32 logCapacity 		= 256 * 1024;
+
+internal int32 benchStrokeIndex;
+
+internal v2 bench_stroke_path(float t)
+{
+	float phase = benchStrokeIndex * 0.9f;
+	v2 start 	= {540 + 400 * cosf(phase), 1000 + 800 * sinf(phase * 1.7f)};
+	return start + v2{300 * t * cosf(phase * 2.3f + 4 * t), 300 * t * sinf(phase * 2.3f + 4 * t)};
+}
+
+struct DabCounter
+{
+	Dab 	memory [256];
+	int64 	count;
+};
+
+internal void dab_counter_flush(void * data, DabBuffer * buffer)
+{
+	((DabCounter*)data)->count += buffer->count;
+	buffer->count = 0;
+}
+
+struct UndoTiming
+{
+	double 	seconds [2 * strokeCount];
+	int64 	dabCounts [2 * strokeCount];
+	int32 	count;
+};
+
+// Moves cursor like move_undo_cursor in IdiotGame.cpp does, without pixels
+internal void timed_move_cursor(UndoHistory * history, StrokeLog const * log, int32 cursor, DabBuffer * dabs, UndoTiming * timing)
+{
+	DabCounter * counter 	= (DabCounter*)dabs->flushData;
+	counter->count 			= 0;
+
+	double start = host_seconds();
+
+	int32 checkpointSlot;
+	int32 replayStart = undo_history_find_base(history, log, cursor, &checkpointSlot);
+	replay_stroke_log(log, replayStart, cursor, dabs);
+	flush_dabs(dabs);
+	undo_history_move_cursor(history, log, cursor, replayStart);
+
+	timing->seconds[timing->count] 		= host_seconds() - start;
+	timing->dabCounts[timing->count] 	= counter->count;
+	timing->count 						+= 1;
+}
+
+internal void report(char const * name, UndoTiming * timing)
+{
+	std::sort(timing->seconds, timing->seconds + timing->count);
+	std::sort(timing->dabCounts, timing->dabCounts + timing->count);
+
+	int32 median = timing->count / 2;
+	printf("%-22s %3d steps, cpu median %6.3f ms, max %6.3f ms, dabs replayed median %6lld, max %6lld\n",
+			name, timing->count, timing->seconds[median] * 1000, timing->seconds[timing->count - 1] * 1000,
+			(long long)timing->dabCounts[median], (long long)timing->dabCounts[timing->count - 1]);
+}
+
+internal void run(char const * name, int32 checkpointMemoryBudget)
+{
+	static StrokeLogEntry memory [logCapacity];
+	StrokeLog log;
+	stroke_log_initialize(&log, memory, logCapacity);
+	log.width 	= canvasWidth;
+	log.height 	= canvasHeight;
+
+	UndoHistory history = {};
+	undo_history_initialize(&history, checkpointMemoryBudget, canvasWidth * canvasHeight * 4);
+
+	static DabCounter counter;
+	DabBuffer dabs = {counter.memory, 0, 256, dab_counter_flush, &counter};
+
+	StrokeState stroke 	= {};
+	int64 time 			= 1'000'000'000;
+	for (benchStrokeIndex = 0; benchStrokeIndex < strokeCount; ++benchStrokeIndex)
+	{
+		HostStroke description 	= {bench_stroke_path, 1.0f, 120, 40, strokeDynamicsNone};
+		time 					= host_draw_stroke(&log, &stroke, &dabs, description, time + 300'000'000);
+		undo_history_commit_step(&history, &log);
+	}
+
+	static UndoTiming undoTiming;
+	undoTiming.count = 0;
+	for (int32 cursor = undo_history_previous_step(&history, &log); cursor >= 0; cursor = undo_history_previous_step(&history, &log))
+	{
+		timed_move_cursor(&history, &log, cursor, &dabs, &undoTiming);
+	}
+
+	static UndoTiming redoTiming;
+	redoTiming.count = 0;
+	for (int32 cursor = undo_history_next_step(&history, &log); cursor >= 0; cursor = undo_history_next_step(&history, &log))
+	{
+		timed_move_cursor(&history, &log, cursor, &dabs, &redoTiming);
+	}
+
+	char undoName [64], redoName [64];
+	snprintf(undoName, sizeof(undoName), "%s undo", name);
+	snprintf(redoName, sizeof(redoName), "%s redo", name);
+	report(undoName, &undoTiming);
+	report(redoName, &redoTiming);
+}
+
+int main()
+{
+	run("checkpoints", checkpointBudget);
+	run("no checkpoints", 0);
+	return 0;
+}
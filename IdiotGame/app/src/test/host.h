@@ -0,0 +1,104 @@
+/*
+Host build of game modules, for tests and benchmarks that do not need a device. Same
+prelude as top of IdiotGame.cpp, with android logging and properties going to stdio.
+Modules are included after this in same order as IdiotGame.cpp includes them.
+*/
+
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <time.h>
+#include <cmath>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cassert>
+#include <type_traits>
+
+// libstdc++ does not have std::fmodf, which libc++ of NDK has
+#include <math.h>
+namespace std { using ::fmodf; }
+
+#include <android/log.h>
+
+#define internal static
+
+using bool32 	= __int32_t;
+using int32 	= __int32_t;
+using uint8 	= __uint8_t;
+using uint16 	= __uint16_t;
+using uint32 	= __uint32_t;
+using int64 	= __int64_t;
+
+// Set HOST_LOG=1 to see what modules log, it is mostly noise in tests
+inline bool32 host_log_enabled()
+{
+	static bool32 enabled = getenv("HOST_LOG") != nullptr && getenv("HOST_LOG")[0] == '1';
+	return enabled;
+}
+
+extern "C" inline int __android_log_write(int priority, char const * tag, char const * text)
+{
+	if (host_log_enabled() || priority >= ANDROID_LOG_ERROR)
+	{
+		fprintf(stderr, "%s: %s\n", tag, text);
+	}
+	return 0;
+}
+
+extern "C" inline int __android_log_print(int priority, char const * tag, char const * format, ...)
+{
+	if (host_log_enabled() || priority >= ANDROID_LOG_ERROR)
+	{
+		fprintf(stderr, "%s: ", tag);
+		va_list args;
+		va_start(args, format);
+		vfprintf(stderr, format, args);
+		va_end(args);
+		fprintf(stderr, "\n");
+	}
+	return 0;
+}
+
+/// ----------------------------------------------------------------------------
+/// CHECKS
+
+internal int32 hostFailedCheckCount;
+
+#define CHECK(condition) host_check((condition), #condition, __FILE__, __LINE__)
+
+internal void host_check(bool condition, char const * text, char const * file, int line)
+{
+	if (condition == false)
+	{
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+		hostFailedCheckCount += 1;
+	}
+}
+
+internal int host_check_result(char const * name)
+{
+	if (hostFailedCheckCount > 0)
+	{
+		fprintf(stderr, "%s: %d checks failed\n", name, hostFailedCheckCount);
+		return 1;
+	}
+	printf("%s: ok\n", name);
+	return 0;
+}
+
+internal double host_seconds()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1'000'000'000.0;
+}
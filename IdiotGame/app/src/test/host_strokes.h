@@ -0,0 +1,105 @@
+/*
+Strokes for tests and benchmarks. These are drawn like IdiotGame.cpp draws touches: every
+sample is recorded to stroke log first, and stroke engine gets positions, dynamics and times
+as they were stored, so that replaying log gives same dabs. Include after stroke_log.cpp.
+*/
+
+#include <vector>
+
+// Dab buffer that keeps everything flushed to it
+struct HostDabs
+{
+	static constexpr int capacity = 256;
+
+	Dab 				memory [capacity];
+	DabBuffer 			buffer;
+	std::vector<Dab> 	all;
+};
+
+internal void host_dabs_flush(void * data, DabBuffer * buffer)
+{
+	HostDabs * dabs = (HostDabs*)data;
+	dabs->all.insert(dabs->all.end(), buffer->dabs, buffer->dabs + buffer->count);
+	buffer->count = 0;
+}
+
+internal void host_dabs_initialize(HostDabs * dabs)
+{
+	dabs->buffer = {dabs->memory, 0, dabs->capacity, host_dabs_flush, dabs};
+	dabs->all.clear();
+}
+
+internal std::vector<Dab> const & host_dabs_finish(HostDabs * dabs)
+{
+	flush_dabs(&dabs->buffer);
+	return dabs->all;
+}
+
+internal bool32 dab_equals(Dab a, Dab b)
+{
+	return a.position.x == b.position.x && a.position.y == b.position.y
+		&& a.size == b.size && a.gradientPosition == b.gradientPosition
+		&& a.mode == b.mode && a.gradientIndex == b.gradientIndex && a.opacity == b.opacity;
+}
+
+// Position and dynamics along a stroke at 0..1 of its duration
+using HostStrokePath 		= v2 (float t);
+using HostStrokeDynamics 	= StrokeDynamics (float t);
+
+// If 'dynamicsPath' is set, it is used instead of constant 'dynamics'
+struct HostStroke
+{
+	HostStrokePath * 		path;
+	float 					durationSeconds;
+	float 					sampleRate;
+	float 					width;
+	StrokeDynamics 			dynamics;
+	bool32 					stylus;
+	HostStrokeDynamics * 	dynamicsPath;
+};
+
+internal StrokeDynamics host_stroke_dynamics(HostStroke const & description, float t)
+{
+	StrokeDynamics dynamics = description.dynamicsPath != nullptr ? description.dynamicsPath(t) : description.dynamics;
+	return stroke_log_quantize_dynamics(dynamics);
+}
+
+// Records one stroke to 'log' starting at 'startTime' nanoseconds, feeding it to 'stroke' as it goes. Returns end time.
+internal int64 host_draw_stroke(StrokeLog * log, StrokeState * stroke, DabBuffer * dabs, HostStroke const & description, int64 startTime)
+{
+	int64 sampleInterval 	= (int64)(1'000'000'000.0 / description.sampleRate);
+	int32 sampleCount 		= (int32)(description.durationSeconds * description.sampleRate);
+	float width 			= stroke_log_quantize_width(description.width);
+	StrokeDynamics dynamics = host_stroke_dynamics(description, 0);
+
+	v2 position = stroke_log_record_begin(log, description.path(0), dynamics, description.stylus, BRUSH_DRAW, 0, startTime);
+	stroke_begin(stroke, position, dynamics, description.stylus, BRUSH_DRAW, 0);
+
+	int64 time = startTime;
+	for (int32 i = 1; i <= sampleCount; ++i)
+	{
+		float t 	= (float)i / sampleCount;
+		time 		= startTime + i * sampleInterval;
+		dynamics 	= host_stroke_dynamics(description, t);
+		position 	= stroke_log_record_sample(log, description.path(t), dynamics, time);
+		stroke_advance_time(stroke, stroke_log_last_time_step(log));
+		stroke_queue_position(stroke, position, dynamics, width, dabs);
+
+		if (stroke->strokeMoved)
+		{
+			stroke_log_record_width(log, stroke->strokeWidth);
+		}
+	}
+
+	if (stroke->strokeMoved == false)
+	{
+		stroke_log_record_width(log, width);
+	}
+
+	time += sampleInterval;
+	stroke_log_record_end(log, time);
+	stroke_advance_time(stroke, stroke_log_last_time_step(log));
+	stroke_end(stroke, width, dabs);
+
+	return time;
+}
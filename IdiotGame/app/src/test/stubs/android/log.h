@@ -0,0 +1,11 @@
+#pragma once
+
+// Host stand in for NDK header, functions are defined in host.h
+enum
+{
+	ANDROID_LOG_VERBOSE = 2,
+	ANDROID_LOG_DEBUG,
+	ANDROID_LOG_INFO,
+	ANDROID_LOG_WARN,
+	ANDROID_LOG_ERROR,
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+// Host stand in for bionic header, every property reads as empty so modules use their defaults
+#define PROP_VALUE_MAX 92
+
+inline int __system_property_get(char const *, char * value)
+{
+	value[0] = 0;
+	return 0;
+}
@@ -0,0 +1,132 @@
+#include "host.h"
+
+struct ANativeWindow;
+struct AInputQueue;
+
+#include "../main/app_command_queue.cpp"
+
+/*
+Many producers push as fast as they can while one consumer waits on eventfd like game thread
+does with looper. Every command must arrive exactly once, in order per producer, and consumer
+must never sleep through a command, which would show up as poll timing out.
+*/
+
+constexpr int32 producerCount 			= 8;
+constexpr int32 commandsPerProducer 	= 200'000;
+
+struct Producer
+{
+	AppCommandQueue * 	queue;
+	int32 				index;
+	pthread_t 			thread;
+};
+
+internal void * producer_entry(void * data)
+{
+	Producer * producer = (Producer*)data;
+	for (int32 i = 0; i < commandsPerProducer; ++i)
+	{
+		AppCommand command 	= {};
+		command.type 		= producer->index;
+		command.window 		= (ANativeWindow*)(intptr_t)(i + 1);
+		app_command_queue_push(producer->queue, command);
+	}
+	return nullptr;
+}
+
+internal void test_single_thread_order_and_wraparound()
+{
+	AppCommandQueue * queue = new AppCommandQueue();
+	CHECK(app_command_queue_initialize(queue));
+
+	AppCommand command;
+	CHECK(app_command_queue_pop(queue, &command) == false);
+
+	// Several laps around ring, with ring full at the end of each
+	for (int32 lap = 0; lap < 5; ++lap)
+	{
+		for (uint32 i = 0; i < queue->capacity; ++i)
+		{
+			AppCommand pushed 	= {};
+			pushed.type 		= (int32)(lap * 1000 + i);
+			app_command_queue_push(queue, pushed);
+		}
+
+		app_command_queue_acknowledge(queue);
+		for (uint32 i = 0; i < queue->capacity; ++i)
+		{
+			CHECK(app_command_queue_pop(queue, &command));
+			CHECK(command.type == (int32)(lap * 1000 + i));
+		}
+		CHECK(app_command_queue_pop(queue, &command) == false);
+	}
+
+	app_command_queue_destroy(queue);
+	delete queue;
+}
+
+internal void test_many_producers()
+{
+	AppCommandQueue * queue = new AppCommandQueue();
+	CHECK(app_command_queue_initialize(queue));
+
+	Producer producers [producerCount];
+	for (int32 i = 0; i < producerCount; ++i)
+	{
+		producers[i] = {queue, i};
+		pthread_create(&producers[i].thread, nullptr, producer_entry, &producers[i]);
+	}
+
+	intptr_t lastReceived [producerCount] 	= {};
+	int64 receivedCount 					= 0;
+	int64 expectedCount 					= (int64)producerCount * commandsPerProducer;
+	int32 timeoutCount 						= 0;
+
+	while (receivedCount < expectedCount && timeoutCount == 0)
+	{
+		pollfd pollFd = {queue->eventFd, POLLIN, 0};
+		if (poll(&pollFd, 1, 2000) == 0)
+		{
+			timeoutCount += 1;
+			break;
+		}
+
+		app_command_queue_acknowledge(queue);
+
+		AppCommand command;
+		while (app_command_queue_pop(queue, &command))
+		{
+			bool32 validProducer = command.type >= 0 && command.type < producerCount;
+			CHECK(validProducer);
+			if (validProducer)
+			{
+				intptr_t sequence = (intptr_t)command.window;
+				CHECK(sequence == lastReceived[command.type] + 1);
+				lastReceived[command.type] = sequence;
+			}
+			receivedCount += 1;
+		}
+	}
+
+	for (int32 i = 0; i < producerCount; ++i)
+	{
+		pthread_join(producers[i].thread, nullptr);
+		CHECK(lastReceived[i] == commandsPerProducer);
+	}
+
+	AppCommand command;
+	CHECK(timeoutCount == 0);
+	CHECK(receivedCount == expectedCount);
+	CHECK(app_command_queue_pop(queue, &command) == false);
+
+	app_command_queue_destroy(queue);
+	delete queue;
+}
+
+int main()
+{
+	test_single_thread_order_and_wraparound();
+	test_many_producers();
+
+	return host_check_result("app_command_queue");
+}
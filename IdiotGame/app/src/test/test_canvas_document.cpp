@@ -0,0 +1,186 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/canvas_document.cpp"
+
+/*
+Canvas document against a real file system in a temporary directory. Pixels are filled with
+a pattern that depends on position, so that any misplaced or lost page shows.
+*/
+
+constexpr int32 width 			= 333;
+constexpr int32 height 			= 517;
+constexpr int32 previewWidth 	= width / 4;
+constexpr int32 previewHeight 	= height / 4;
+
+internal uint8 pattern(size_t index, uint8 seed)
+{
+	return (uint8)(index * 31 + (index >> 12) + seed);
+}
+
+internal bool32 write_document(char const * directory, uint8 seed, bool32 commit)
+{
+	CanvasDocument document;
+	if (canvas_document_begin_write(&document, directory, width, height, previewWidth, previewHeight) == false)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < (size_t)previewWidth * previewHeight * 4; ++i)
+	{
+		document.preview[i] = pattern(i, seed + 1);
+	}
+	for (size_t i = 0; i < (size_t)width * height * 4; ++i)
+	{
+		document.pixels[i] = pattern(i, seed);
+	}
+
+	if (commit == false)
+	{
+		canvas_document_abort(&document, directory);
+		return true;
+	}
+	return canvas_document_commit(&document, directory);
+}
+
+internal bool32 document_has(CanvasDocument const * document, uint8 seed)
+{
+	bool32 matches = document->header->width == width && document->header->height == height
+					&& document->header->previewWidth == previewWidth && document->header->previewHeight == previewHeight;
+
+	for (size_t i = 0; matches && i < (size_t)previewWidth * previewHeight * 4; ++i)
+	{
+		matches = document->preview[i] == pattern(i, seed + 1);
+	}
+	for (size_t i = 0; matches && i < (size_t)width * height * 4; ++i)
+	{
+		matches = document->pixels[i] == pattern(i, seed);
+	}
+	return matches;
+}
+
+internal bool32 file_exists(char const * directory, char const * fileName)
+{
+	char path [256];
+	canvas_document_path(path, sizeof(path), directory, fileName);
+	return access(path, F_OK) == 0;
+}
+
+internal void test_missing_document_does_not_open(char const * directory)
+{
+	CanvasDocument document;
+	CHECK(canvas_document_open(&document, directory) == false);
+	CHECK(document.mapping == nullptr && document.file == -1);
+}
+
+internal void test_commit_and_open(char const * directory)
+{
+	CHECK(write_document(directory, 7, true));
+	CHECK(file_exists(directory, canvasDocumentTemporaryFileName) == false);
+
+	CanvasDocument document;
+	CHECK(canvas_document_open(&document, directory));
+	CHECK(document_has(&document, 7));
+	canvas_document_close(&document);
+}
+
+internal void test_abort_keeps_previous_document(char const * directory)
+{
+	CHECK(write_document(directory, 7, true));
+	CHECK(write_document(directory, 9, false));
+	CHECK(file_exists(directory, canvasDocumentTemporaryFileName) == false);
+
+	CanvasDocument document;
+	CHECK(canvas_document_open(&document, directory));
+	CHECK(document_has(&document, 7));
+	canvas_document_close(&document);
+}
+
+internal void test_new_document_replaces_old(char const * directory)
+{
+	CHECK(write_document(directory, 7, true));
+	CHECK(write_document(directory, 11, true));
+
+	CanvasDocument document;
+	CHECK(canvas_document_open(&document, directory));
+	CHECK(document_has(&document, 11));
+	canvas_document_close(&document);
+}
+
+// Process may die between filling and commit, magic is only written on commit
+internal void test_unfinished_document_is_not_valid(char const * directory)
+{
+	CanvasDocument document;
+	CHECK(canvas_document_begin_write(&document, directory, width, height, previewWidth, previewHeight));
+	canvas_document_close(&document);
+
+	char temporaryPath [256];
+	char path [256];
+	canvas_document_path(temporaryPath, sizeof(temporaryPath), directory, canvasDocumentTemporaryFileName);
+	canvas_document_path(path, sizeof(path), directory, canvasDocumentFileName);
+	CHECK(rename(temporaryPath, path) == 0);
+
+	CHECK(canvas_document_open(&document, directory) == false);
+}
+
+internal void test_truncated_document_is_not_valid(char const * directory)
+{
+	CHECK(write_document(directory, 7, true));
+
+	char path [256];
+	canvas_document_path(path, sizeof(path), directory, canvasDocumentFileName);
+	CHECK(truncate(path, sizeof(CanvasDocumentHeader) + previewWidth * previewHeight * 4 + 100) == 0);
+
+	CanvasDocument document;
+	CHECK(canvas_document_open(&document, directory) == false);
+}
+
+// Restore drops pages behind it, content must still be there if they are touched again
+internal void test_dropped_pages_read_back(char const * directory)
+{
+	CHECK(write_document(directory, 13, true));
+
+	CanvasDocument document;
+	CHECK(canvas_document_open(&document, directory));
+
+	CHECK(canvas_document_drop_pages(&document, document.size / 2 + 123));
+	CHECK(canvas_document_drop_pages(&document, 100));
+	CHECK(canvas_document_drop_pages(&document, document.size * 2));
+	CHECK(document_has(&document, 13));
+
+	canvas_document_close(&document);
+}
+
+internal void test_delete(char const * directory)
+{
+	CHECK(write_document(directory, 7, true));
+	canvas_document_delete(directory);
+	CHECK(file_exists(directory, canvasDocumentFileName) == false);
+
+	// Nothing to delete is not an error
+	canvas_document_delete(directory);
+}
+
+int main()
+{
+	char directory [] = "/tmp/canvas_document_XXXXXX";
+	if (mkdtemp(directory) == nullptr)
+	{
+		fprintf(stderr, "Could not create temporary directory\n");
+		return 1;
+	}
+
+	test_missing_document_does_not_open(directory);
+	test_commit_and_open(directory);
+	test_abort_keeps_previous_document(directory);
+	test_new_document_replaces_old(directory);
+	test_unfinished_document_is_not_valid(directory);
+	test_truncated_document_is_not_valid(directory);
+	test_dropped_pages_read_back(directory);
+	test_delete(directory);
+
+	canvas_document_delete(directory);
+	rmdir(directory);
+
+	return host_check_result("canvas_document");
+}
@@ -0,0 +1,117 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/damage_history.cpp"
+
+internal bool32 rect_equals(rect a, rect b)
+{
+	return a.min.x == b.min.x && a.min.y == b.min.y && a.max.x == b.max.x && a.max.y == b.max.y;
+}
+
+internal rect make_rect(float minX, float minY, float maxX, float maxY)
+{
+	return {{minX, minY}, {maxX, maxY}};
+}
+
+internal void test_age_zero_is_unknown()
+{
+	DamageHistory history = {};
+	damage_history_push(&history, make_rect(0, 0, 10, 10));
+
+	rect damage = make_rect(-1, -1, -1, -1);
+	CHECK(damage_history_get(&history, 0, &damage) == false);
+	CHECK(damage_history_get(&history, -1, &damage) == false);
+	CHECK(rect_equals(damage, make_rect(-1, -1, -1, -1)));
+}
+
+internal void test_age_one_has_no_damage()
+{
+	DamageHistory history = {};
+	damage_history_push(&history, make_rect(0, 0, 10, 10));
+
+	rect damage;
+	CHECK(damage_history_get(&history, 1, &damage));
+	CHECK(rect_is_empty(damage));
+}
+
+internal void test_age_beyond_history_is_unknown()
+{
+	DamageHistory history = {};
+	damage_history_push(&history, make_rect(0, 0, 10, 10));
+	damage_history_push(&history, make_rect(5, 5, 20, 20));
+
+	rect damage;
+	CHECK(damage_history_get(&history, history.count + 1, &damage));
+	CHECK(damage_history_get(&history, history.count + 2, &damage) == false);
+
+	// Older frames than capacity are forgotten, even if more were pushed
+	for (int32 i = 0; i < 10; ++i)
+	{
+		damage_history_push(&history, make_rect(0, 0, 1, 1));
+	}
+	CHECK(history.count == DamageHistory::capacity);
+	CHECK(damage_history_get(&history, DamageHistory::capacity + 1, &damage));
+	CHECK(damage_history_get(&history, DamageHistory::capacity + 2, &damage) == false);
+}
+
+internal void test_union_of_frames_since_age()
+{
+	DamageHistory history = {};
+	damage_history_push(&history, make_rect(0, 0, 10, 10)); 	// 3 frames ago
+	damage_history_push(&history, make_rect(50, 50, 60, 60)); 	// 2 frames ago
+	damage_history_push(&history, make_rect(20, 5, 30, 15)); 	// previous frame
+
+	rect damage;
+	CHECK(damage_history_get(&history, 2, &damage));
+	CHECK(rect_equals(damage, make_rect(20, 5, 30, 15)));
+
+	CHECK(damage_history_get(&history, 3, &damage));
+	CHECK(rect_equals(damage, make_rect(20, 5, 60, 60)));
+
+	CHECK(damage_history_get(&history, 4, &damage));
+	CHECK(rect_equals(damage, make_rect(0, 0, 60, 60)));
+}
+
+internal void test_empty_frames_do_not_grow_damage()
+{
+	DamageHistory history = {};
+	damage_history_push(&history, make_rect(20, 20, 30, 30));
+	damage_history_push(&history, rect_empty());
+
+	rect damage;
+	CHECK(damage_history_get(&history, 2, &damage));
+	CHECK(rect_is_empty(damage));
+
+	CHECK(damage_history_get(&history, 3, &damage));
+	CHECK(rect_equals(damage, make_rect(20, 20, 30, 30)));
+}
+
+internal void test_reset_forgets_everything()
+{
+	DamageHistory history = {};
+	damage_history_push(&history, make_rect(0, 0, 10, 10));
+	damage_history_push(&history, make_rect(0, 0, 10, 10));
+	damage_history_reset(&history);
+
+	rect damage;
+	CHECK(history.count == 0);
+	CHECK(damage_history_get(&history, 1, &damage));
+	CHECK(rect_is_empty(damage));
+	CHECK(damage_history_get(&history, 2, &damage) == false);
+
+	damage_history_push(&history, make_rect(1, 2, 3, 4));
+	CHECK(damage_history_get(&history, 2, &damage));
+	CHECK(rect_equals(damage, make_rect(1, 2, 3, 4)));
+}
+
+int main()
+{
+	test_age_zero_is_unknown();
+	test_age_one_has_no_damage();
+	test_age_beyond_history_is_unknown();
+	test_union_of_frames_since_age();
+	test_empty_frames_do_not_grow_damage();
+	test_reset_forgets_everything();
+
+	return host_check_result("damage_history");
+}
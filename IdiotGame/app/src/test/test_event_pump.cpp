@@ -0,0 +1,194 @@
+#include "host.h"
+
+#include "../main/event_pump.cpp"
+
+// Looper stand in. Events are pending all at once, and frame may begin after a number of waits.
+struct FakeSource
+{
+	int32 	pendingCount;
+	bool32 	endless;
+
+	int32 	waitsUntilFrame;
+	int32 	waitCount;
+	int32 	lastWaitTimeout;
+
+	// Poll number that fails, or that makes 'running' false, -1 for never
+	int32 	errorOnPoll;
+	int32 	stopOnPoll;
+	bool32 * running;
+
+	int32 	pollCount;
+	int32 	handledCount;
+};
+
+internal EventPumpResult fake_poll(void * data, int timeout)
+{
+	FakeSource * source = (FakeSource*)data;
+
+	int32 poll = source->pollCount;
+	source->pollCount += 1;
+
+	if (poll == source->errorOnPoll)
+	{
+		return EVENT_PUMP_ERROR;
+	}
+
+	if (poll == source->stopOnPoll)
+	{
+		*source->running = false;
+	}
+
+	if (timeout != 0)
+	{
+		source->waitCount += 1;
+		source->lastWaitTimeout = timeout;
+	}
+
+	if (source->endless || source->pendingCount > 0)
+	{
+		source->pendingCount -= source->endless ? 0 : 1;
+		source->handledCount += 1;
+		return EVENT_PUMP_HANDLED;
+	}
+	return EVENT_PUMP_EMPTY;
+}
+
+internal int fake_frame_timeout(void * data)
+{
+	FakeSource * source = (FakeSource*)data;
+	return source->waitCount < source->waitsUntilFrame ? 16 : 0;
+}
+
+internal FakeSource make_source(bool32 * running)
+{
+	FakeSource source 	= {};
+	source.errorOnPoll 	= -1;
+	source.stopOnPoll 	= -1;
+	source.running 		= running;
+	return source;
+}
+
+internal void test_drains_everything_pending()
+{
+	bool32 running 		= true;
+	FakeSource source 	= make_source(&running);
+	source.pendingCount = 10;
+
+	EventPump pump = {fake_poll, fake_frame_timeout, &source};
+	CHECK(event_pump_run(&pump, &running) == 10);
+	CHECK(source.pendingCount == 0);
+	CHECK(source.waitCount == 0);
+}
+
+internal void test_waits_for_frame_before_draining()
+{
+	bool32 running 			= true;
+	FakeSource source 		= make_source(&running);
+	source.pendingCount 	= 5;
+	source.waitsUntilFrame 	= 2;
+
+	EventPump pump = {fake_poll, fake_frame_timeout, &source};
+	int32 drained = event_pump_run(&pump, &running);
+
+	// Two events were serviced while waiting, rest after
+	CHECK(source.waitCount == 2);
+	CHECK(source.lastWaitTimeout == 16);
+	CHECK(drained == 3);
+	CHECK(source.handledCount == 5);
+}
+
+internal void test_drain_is_capped()
+{
+	bool32 running 		= true;
+	FakeSource source 	= make_source(&running);
+	source.endless 		= true;
+
+	EventPump pump = {fake_poll, fake_frame_timeout, &source};
+	CHECK(event_pump_run(&pump, &running) == EventPump::maxDrainedEventCount);
+	CHECK(EventPump::maxDrainedEventCount == 64);
+	CHECK(source.pollCount == 64);
+
+	// Next frame gets the rest
+	CHECK(event_pump_run(&pump, &running) == 64);
+}
+
+internal void test_stops_when_running_goes_false_while_draining()
+{
+	bool32 running 		= true;
+	FakeSource source 	= make_source(&running);
+	source.endless 		= true;
+	source.stopOnPoll 	= 5;
+
+	EventPump pump = {fake_poll, fake_frame_timeout, &source};
+	int32 drained = event_pump_run(&pump, &running);
+
+	// Poll that stopped us was still serviced, and counted, but nothing after it
+	CHECK(drained == 6);
+	CHECK(source.pollCount == 6);
+	CHECK(running == false);
+}
+
+internal void test_stops_when_running_goes_false_while_waiting()
+{
+	bool32 running 			= true;
+	FakeSource source 		= make_source(&running);
+	source.endless 			= true;
+	source.waitsUntilFrame 	= 100;
+	source.stopOnPoll 		= 3;
+
+	EventPump pump = {fake_poll, fake_frame_timeout, &source};
+	CHECK(event_pump_run(&pump, &running) == 0);
+	CHECK(source.pollCount == 4);
+}
+
+internal void test_does_nothing_when_not_running()
+{
+	bool32 running 		= false;
+	FakeSource source 	= make_source(&running);
+	source.endless 		= true;
+
+	EventPump pump = {fake_poll, fake_frame_timeout, &source};
+	CHECK(event_pump_run(&pump, &running) == 0);
+	CHECK(source.pollCount == 0);
+}
+
+internal void test_error_while_waiting_skips_drain()
+{
+	bool32 running 			= true;
+	FakeSource source 		= make_source(&running);
+	source.pendingCount 	= 10;
+	source.waitsUntilFrame 	= 5;
+	source.errorOnPoll 		= 1;
+
+	EventPump pump = {fake_poll, fake_frame_timeout, &source};
+	CHECK(event_pump_run(&pump, &running) == 0);
+	CHECK(source.pollCount == 2);
+	CHECK(source.pendingCount == 9);
+}
+
+internal void test_error_while_draining_stops_drain()
+{
+	bool32 running 		= true;
+	FakeSource source 	= make_source(&running);
+	source.pendingCount = 10;
+	source.errorOnPoll 	= 4;
+
+	EventPump pump = {fake_poll, fake_frame_timeout, &source};
+	CHECK(event_pump_run(&pump, &running) == 4);
+	CHECK(source.pollCount == 5);
+	CHECK(source.pendingCount == 6);
+}
+
+int main()
+{
+	test_drains_everything_pending();
+	test_waits_for_frame_before_draining();
+	test_drain_is_capped();
+	test_stops_when_running_goes_false_while_draining();
+	test_stops_when_running_goes_false_while_waiting();
+	test_does_nothing_when_not_running();
+	test_error_while_waiting_skips_drain();
+	test_error_while_draining_stops_drain();
+
+	return host_check_result("event_pump");
+}
@@ -0,0 +1,206 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/memory.cpp"
+#include "../main/profiler.cpp"
+#include "../main/stroke.cpp"
+#include "../main/stroke_log.cpp"
+#include "../main/damage_history.cpp"
+#include "../main/input_samples.cpp"
+
+#include <vector>
+
+/*
+Runs what game thread does for touches every frame, and checks frames do not allocate, same
+as assert at end of frame in IdiotGame.cpp. This is a debug build, so operator new is counted
+along with memory_heap_allocate. Test plays input thread itself before each frame, and stroke
+log is small enough to become full on the way.
+*/
+
+constexpr int32 frameCount 			= 600;
+constexpr int32 samplesPerFrame 	= 2;
+constexpr int32 framesPerStroke 	= 45;
+constexpr int64 sampleInterval 		= 1'000'000'000 / 120;
+
+struct FrameDamage
+{
+	rect current;
+};
+
+internal void frame_damage_flush(void * data, DabBuffer * buffer)
+{
+	FrameDamage * damage = (FrameDamage*)data;
+	for (int32 i = 0; i < buffer->count; ++i)
+	{
+		Dab const & dab = buffer->dabs[i];
+		v2 extent 		= {dab.size / 2, dab.size / 2};
+		damage->current = rect_union(damage->current, {dab.position - extent, dab.position + extent});
+	}
+	buffer->count = 0;
+}
+
+internal InputSample frame_input_sample(int32 sampleIndex)
+{
+	int32 samplesPerStroke 	= framesPerStroke * samplesPerFrame;
+	int32 strokeIndex 		= sampleIndex / samplesPerStroke;
+	int32 indexInStroke 	= sampleIndex % samplesPerStroke;
+
+	float angle 	= 0.05f * indexInStroke + strokeIndex;
+	float radius 	= 100 + 10 * indexInStroke;
+
+	InputSample sample 	= {};
+	sample.type 		= indexInStroke == 0
+						? INPUT_SAMPLE_DOWN
+						: (indexInStroke == samplesPerStroke - 1 ? INPUT_SAMPLE_UP : INPUT_SAMPLE_MOVE);
+	sample.pointerCount = 1;
+	sample.position 	= {540 + radius * cosf(angle), 1000 + radius * sinf(angle)};
+	sample.eventTime 	= 1'000'000'000 + sampleIndex * sampleInterval;
+	sample.receiveTime 	= sample.eventTime;
+	sample.dynamics 	= strokeDynamicsNone;
+	return sample;
+}
+
+struct FrameState
+{
+	MemoryArena 		frameArena;
+	InputSampleQueue 	input;
+	StrokeLog 			log;
+	StrokeState 		stroke;
+	DamageHistory 		damageHistory;
+	FrameDamage 		damage;
+	Dab 				dabMemory [64];
+	DabBuffer 			dabs;
+	float 				width;
+};
+
+internal void frame_process_sample(FrameState * state, InputSample sample)
+{
+	switch (sample.type)
+	{
+		case INPUT_SAMPLE_DOWN:
+		{
+			v2 position = stroke_log_record_begin(&state->log, sample.position, sample.dynamics, false, BRUSH_DRAW, 0, sample.eventTime);
+			stroke_begin(&state->stroke, position, sample.dynamics, false, BRUSH_DRAW, 0);
+		} break;
+
+		case INPUT_SAMPLE_MOVE:
+		{
+			v2 position = stroke_log_record_sample(&state->log, sample.position, sample.dynamics, sample.eventTime);
+			stroke_advance_time(&state->stroke, stroke_log_last_time_step(&state->log));
+			stroke_queue_position(&state->stroke, position, sample.dynamics, state->width, &state->dabs);
+			if (state->stroke.strokeMoved)
+			{
+				stroke_log_record_width(&state->log, state->stroke.strokeWidth);
+			}
+		} break;
+
+		case INPUT_SAMPLE_UP:
+		{
+			stroke_log_record_end(&state->log, sample.eventTime);
+			stroke_advance_time(&state->stroke, stroke_log_last_time_step(&state->log));
+			stroke_end(&state->stroke, state->width, &state->dabs);
+		} break;
+
+		default:
+			break;
+	}
+}
+
+// Returns how many heap allocations frame did that were not expected
+internal int64 run_frame(FrameState * state, int32 frameIndex)
+{
+	arena_reset(&state->frameArena);
+	int64 unexpectedBefore = heapUnexpectedAllocationCount;
+
+	for (int32 i = 0; i < samplesPerFrame; ++i)
+	{
+		input_sample_queue_push(&state->input, frame_input_sample(frameIndex * samplesPerFrame + i));
+	}
+
+	state->damage.current = rect_empty();
+
+	InputSample sample;
+	while (input_sample_queue_pop(&state->input, &sample))
+	{
+		frame_process_sample(state, sample);
+	}
+	flush_dabs(&state->dabs);
+
+	// Scratch like compositing and drawing take it
+	Dab * scratch = arena_push_array<Dab>(&state->frameArena, 256);
+	CHECK(scratch != nullptr);
+
+	rect redraw;
+	if (damage_history_get(&state->damageHistory, 3, &redraw) == false)
+	{
+		redraw = {{0, 0}, {1080, 2000}};
+	}
+	damage_history_push(&state->damageHistory, state->damage.current);
+
+	return heapUnexpectedAllocationCount - unexpectedBefore;
+}
+
+internal void test_frames_do_not_allocate()
+{
+	static FrameState state;
+
+	// Setup allocates by design, like it does when window is created
+	memory_expect_heap_begin();
+	arena_initialize(&state.frameArena, 1024 * 1024);
+	StrokeLogEntry * logMemory = new StrokeLogEntry [1024];
+	stroke_log_initialize(&state.log, logMemory, 1024);
+	memory_expect_heap_end();
+
+	state.log.width 	= 1080;
+	state.log.height 	= 2000;
+	state.dabs 			= {state.dabMemory, 0, 64, frame_damage_flush, &state.damage};
+	state.width 		= stroke_log_quantize_width(40);
+
+	int64 totalBefore 			= heapAllocationCount;
+	int32 allocatingFrameCount 	= 0;
+	for (int32 frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+	{
+		allocatingFrameCount += run_frame(&state, frameIndex) > 0 ? 1 : 0;
+	}
+
+	CHECK(allocatingFrameCount == 0);
+	CHECK(heapAllocationCount == totalBefore);
+	CHECK(state.log.full);
+	CHECK(state.frameArena.highWaterMark > 0);
+
+	delete [] logMemory;
+}
+
+// Check that counting sees what it should, otherwise test above proves nothing
+internal void test_allocations_are_counted()
+{
+	int64 unexpectedBefore 	= heapUnexpectedAllocationCount;
+	int64 totalBefore 		= heapAllocationCount;
+
+	int32 * single = new int32;
+	CHECK(heapUnexpectedAllocationCount == unexpectedBefore + 1);
+	delete single;
+
+	std::vector<int32> values;
+	values.push_back(1);
+	CHECK(heapUnexpectedAllocationCount == unexpectedBefore + 2);
+
+	void * memory = memory_heap_allocate(64, MEMORY_CATEGORY_EXPORT);
+	CHECK(heapUnexpectedAllocationCount == unexpectedBefore + 3);
+	memory_heap_free(memory, 64, MEMORY_CATEGORY_EXPORT);
+
+	memory_expect_heap_begin();
+	int32 * expected = new int32 [16];
+	memory_expect_heap_end();
+	delete [] expected;
+
+	CHECK(heapUnexpectedAllocationCount == unexpectedBefore + 3);
+	CHECK(heapAllocationCount == totalBefore + 4);
+}
+
+int main()
+{
+	test_allocations_are_counted();
+	test_frames_do_not_allocate();
+	return host_check_result("frame_allocations");
+}
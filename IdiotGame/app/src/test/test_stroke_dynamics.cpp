@@ -0,0 +1,243 @@
+#include "host.h"
+
+#include "../main/math_and_utils.cpp"
+#include "../main/profiler.cpp"
+#include "../main/stroke.cpp"
+#include "../main/stroke_log.cpp"
+
+#include "host_strokes.h"
+
+/*
+Pressure, contact size and tilt going into dab width and opacity. Strokes are straight lines
+at constant speed, so that speed does not change width after start, and dabs of a stroke
+with dynamics can be compared to same stroke without them.
+*/
+
+constexpr int32 canvasWidth 	= 1080;
+constexpr int32 canvasHeight 	= 2000;
+
+// Past this distance from start, speed filter has settled on a straight constant speed line
+constexpr float settleDistance 	= 150;
+
+internal v2 straight_line(float t)
+{
+	return {100 + 800 * t, 1000};
+}
+
+internal StrokeDynamics full_pressure(float)
+{
+	return {1, 0, 0};
+}
+
+internal StrokeDynamics half_pressure(float)
+{
+	return {0.5f, 0, 0};
+}
+
+internal StrokeDynamics rising_pressure(float t)
+{
+	return {t, 0, 0};
+}
+
+internal StrokeDynamics lightest_pressure(float)
+{
+	return {0, 0, 0};
+}
+
+internal StrokeDynamics full_tilt(float)
+{
+	return {1, 0, strokeLogMaxTilt};
+}
+
+internal StrokeDynamics growing_contact(float t)
+{
+	return {1, 0.2f + 0.6f * t, 0};
+}
+
+struct DrawnStroke
+{
+	std::vector<Dab> live;
+	std::vector<Dab> replayed;
+};
+
+internal DrawnStroke draw(HostStrokeDynamics * dynamics, bool32 stylus)
+{
+	static StrokeLogEntry memory [4096];
+	StrokeLog log;
+	stroke_log_initialize(&log, memory, 4096);
+	log.width 	= canvasWidth;
+	log.height 	= canvasHeight;
+
+	HostStroke description = {straight_line, 1.0f, 120, 40, strokeDynamicsNone, stylus, dynamics};
+
+	static HostDabs dabs;
+	DrawnStroke result;
+
+	host_dabs_initialize(&dabs);
+	StrokeState stroke = {};
+	host_draw_stroke(&log, &stroke, &dabs.buffer, description, 1'000'000'000);
+	result.live = host_dabs_finish(&dabs);
+
+	host_dabs_initialize(&dabs);
+	replay_stroke_log(&log, 0, log.count, &dabs.buffer);
+	result.replayed = host_dabs_finish(&dabs);
+
+	return result;
+}
+
+internal bool32 replay_matches(DrawnStroke const & stroke)
+{
+	bool32 matches = stroke.live.size() == stroke.replayed.size();
+	for (size_t i = 0; matches && i < stroke.live.size(); ++i)
+	{
+		matches = dab_equals(stroke.live[i], stroke.replayed[i]);
+	}
+	return matches;
+}
+
+// Width of reference stroke at 'x' along the line
+internal float width_at(std::vector<Dab> const & dabs, float x)
+{
+	Dab const * nearest = &dabs[0];
+	for (Dab const & dab : dabs)
+	{
+		if (fabsf(dab.position.x - x) < fabsf(nearest->position.x - x))
+		{
+			nearest = &dab;
+		}
+	}
+	return nearest->size;
+}
+
+// Largest ratio of width scale of 'dabs' to 'expectedScale' compared to reference, after settling
+internal float max_width_scale_error(std::vector<Dab> const & dabs, std::vector<Dab> const & reference, float expectedScale)
+{
+	float maxError = 0;
+	for (Dab const & dab : dabs)
+	{
+		if (dab.position.x - straight_line(0).x < settleDistance)
+		{
+			continue;
+		}
+		float scale = dab.size / width_at(reference, dab.position.x);
+		float error = fabsf(scale - expectedScale);
+		maxError 	= error > maxError ? error : maxError;
+	}
+	return maxError;
+}
+
+internal void test_finger_without_dynamics_is_opaque()
+{
+	DrawnStroke stroke = draw(nullptr, false);
+
+	CHECK(stroke.live.size() > 100);
+	CHECK(replay_matches(stroke));
+
+	bool32 opaque = true;
+	for (Dab const & dab : stroke.live)
+	{
+		opaque = opaque && dab.opacity == 1;
+	}
+	CHECK(opaque);
+}
+
+internal void test_stylus_pressure_scales_width_and_opacity()
+{
+	DrawnStroke full = draw(full_pressure, true);
+	DrawnStroke half = draw(half_pressure, true);
+
+	CHECK(replay_matches(full));
+	CHECK(replay_matches(half));
+
+	// Pressure is stored in 8 bits, 0.5 becomes 128/255
+	float pressure 		= 128 / 255.0f;
+	float widthScale 	= float_lerp(0.3f, 1.0f, pressure);
+	float opacity 		= float_lerp(0.4f, 1.0f, pressure);
+
+	CHECK(max_width_scale_error(half.live, full.live, widthScale) < 0.01f);
+
+	bool32 opacityMatches = true;
+	for (Dab const & dab : half.live)
+	{
+		opacityMatches = opacityMatches && fabsf(dab.opacity - opacity) < 1e-5f;
+	}
+	CHECK(opacityMatches);
+}
+
+internal void test_rising_pressure_rises_smoothly()
+{
+	DrawnStroke stroke = draw(rising_pressure, true);
+	CHECK(replay_matches(stroke));
+
+	/*
+	Interpolated along sections, so it never steps back by anything that shows. Section joins
+	can step back a tiny bit, since dabs are placed along curve and not at exact sample points.
+	*/
+	bool32 rising 	= true;
+	float previous 	= 0;
+	for (Dab const & dab : stroke.live)
+	{
+		rising 		= rising && dab.opacity >= previous - 0.5f / 255;
+		previous 	= dab.opacity;
+	}
+	CHECK(rising);
+	CHECK(stroke.live.front().opacity < 0.45f);
+	CHECK(stroke.live.back().opacity > 0.99f);
+}
+
+// Dabs are spaced by narrowest end, so thinnest line still overlaps itself
+internal void test_light_pressure_does_not_break_into_dots()
+{
+	DrawnStroke stroke = draw(lightest_pressure, true);
+
+	float maxGapRatio = 0;
+	for (size_t i = 1; i < stroke.live.size(); ++i)
+	{
+		Dab const & a = stroke.live[i - 1];
+		Dab const & b = stroke.live[i];
+		float gap 	= v2_magnitude(b.position - a.position);
+		float ratio = gap / (a.size < b.size ? a.size : b.size);
+		maxGapRatio = ratio > maxGapRatio ? ratio : maxGapRatio;
+	}
+	CHECK(maxGapRatio <= 0.15f);
+}
+
+internal void test_stylus_tilt_widens()
+{
+	DrawnStroke flat 	= draw(full_pressure, true);
+	DrawnStroke tilted 	= draw(full_tilt, true);
+
+	CHECK(replay_matches(tilted));
+	CHECK(max_width_scale_error(tilted.live, flat.live, 1.6f) < 0.01f);
+}
+
+// Finger contact is compared to touch down, and clamped
+internal void test_finger_contact_size_is_relative_and_clamped()
+{
+	DrawnStroke plain 		= draw(nullptr, false);
+	DrawnStroke growing 	= draw(growing_contact, false);
+
+	CHECK(replay_matches(growing));
+
+	float maxScale = 0;
+	for (Dab const & dab : growing.live)
+	{
+		float scale = dab.size / width_at(plain.live, dab.position.x);
+		maxScale 	= scale > maxScale ? scale : maxScale;
+		CHECK(dab.opacity == 1);
+	}
+
+	// Contact grows to four times its start, scale stops at 1.4
+	CHECK(maxScale > 1.35f && maxScale < 1.42f);
+}
+
+int main()
+{
+	test_finger_without_dynamics_is_opaque();
+	test_stylus_pressure_scales_width_and_opacity();
+	test_rising_pressure_rises_smoothly();
+	test_light_pressure_does_not_break_into_dots();
+	test_stylus_tilt_widens();
+	test_finger_contact_size_is_relative_and_clamped();
+	return host_check_result("stroke_dynamics");
+}